@@ -64,6 +64,13 @@ typedef const char     *(*rp_ws_get_signals_func)(void);
 typedef int		(*rp_ws_set_params_func)(const char *_params);
 typedef int		(*rp_ws_set_signals_func)(const char *_signals);
 typedef void	(*rp_ws_gzip_func)(const char *_in, void* _data, size_t* _size);
+typedef int		(*rp_ws_get_signals_frames_func)(const char **_json, const char **_binary, size_t *_binary_size);
+typedef int		(*rp_ws_get_params_frames_func)(const char **_json, const char **_delta, int *_ids_version);
+typedef const char     *(*rp_ws_get_params_ids_func)(void);
+typedef int		(*rp_ws_subscribe_signals_func)(const char *_names, int _points, int _max_rate, int _binary);
+typedef void	(*rp_ws_unsubscribe_signals_func)(int _id);
+typedef int		(*rp_ws_update_signal_subscriptions_func)(void);
+typedef int		(*rp_ws_get_subscription_frame_func)(int _id, const char **_data, size_t *_size);
 
 typedef struct rp_bazaar_app_s {
     /* Initialization function - called when app. is loaded */
@@ -98,6 +105,13 @@ typedef struct rp_bazaar_app_s {
 	rp_ws_set_params_interval_func ws_set_params_demo_func;
 	rp_ws_set_params_func verify_app_license_func;
 	rp_ws_gzip_func ws_gzip_func;
+	rp_ws_get_signals_frames_func ws_get_signals_frames_func; // optional
+	rp_ws_get_params_frames_func ws_get_params_frames_func; // optional
+	rp_ws_get_params_ids_func ws_get_params_ids_func; // optional
+	rp_ws_subscribe_signals_func ws_subscribe_signals_func; // optional
+	rp_ws_unsubscribe_signals_func ws_unsubscribe_signals_func; // optional
+	rp_ws_update_signal_subscriptions_func ws_update_signal_subscriptions_func; // optional
+	rp_ws_get_subscription_frame_func ws_get_subscription_frame_func; // optional
 
     /* Dynamic library handle */
     void            *handle;
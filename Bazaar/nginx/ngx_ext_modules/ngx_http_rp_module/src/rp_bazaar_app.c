@@ -48,6 +48,13 @@ const char *c_ws_get_params_str   = "ws_get_params";
 const char *c_ws_set_signals_str  = "ws_set_signals";
 const char *c_ws_get_signals_str  = "ws_get_signals";
 const char* c_ws_gzip_str = "ws_gzip";
+const char* c_ws_get_signals_frames_str = "ws_get_signals_frames";
+const char* c_ws_get_params_frames_str = "ws_get_params_frames";
+const char* c_ws_get_params_ids_str = "ws_get_params_ids";
+const char* c_ws_subscribe_signals_str = "ws_subscribe_signals";
+const char* c_ws_unsubscribe_signals_str = "ws_unsubscribe_signals";
+const char* c_ws_update_signal_subscriptions_str = "ws_update_signal_subscriptions";
+const char* c_ws_get_subscription_frame_str = "ws_get_subscription_frame";
 // end web socket function str
 
 /** Get MAC address of a specific NIC via sysfs */
@@ -466,6 +473,19 @@ int rp_bazaar_app_load_module(const char *app_file, rp_bazaar_app_t *app)
         fprintf(stderr, "Cannot resolve '%s' function.\n", c_ws_gzip_str);
     }
 
+    /* Optional - older applications send signals in JSON only */
+    app->ws_get_signals_frames_func = dlsym(app->handle, c_ws_get_signals_frames_str);
+
+    /* Optional - older applications send parameters in JSON only */
+    app->ws_get_params_frames_func = dlsym(app->handle, c_ws_get_params_frames_str);
+    app->ws_get_params_ids_func = dlsym(app->handle, c_ws_get_params_ids_str);
+
+    /* Optional - older applications send all signals to every client */
+    app->ws_subscribe_signals_func = dlsym(app->handle, c_ws_subscribe_signals_str);
+    app->ws_unsubscribe_signals_func = dlsym(app->handle, c_ws_unsubscribe_signals_str);
+    app->ws_update_signal_subscriptions_func = dlsym(app->handle, c_ws_update_signal_subscriptions_str);
+    app->ws_get_subscription_frame_func = dlsym(app->handle, c_ws_get_subscription_frame_str);
+
     // end web socket functionality
 
     app->file_name = (char *)malloc(strlen(app_file)+1);
@@ -530,6 +530,13 @@ int rp_bazaar_start(ngx_http_request_t *r,
         params.get_signals_func = rp_module_ctx.app.ws_get_signals_func;
         params.set_signals_func = rp_module_ctx.app.ws_set_signals_func;
         params.gzip_func = rp_module_ctx.app.ws_gzip_func;
+        params.get_signals_frames_func = rp_module_ctx.app.ws_get_signals_frames_func;
+        params.get_params_frames_func = rp_module_ctx.app.ws_get_params_frames_func;
+        params.get_params_ids_func = rp_module_ctx.app.ws_get_params_ids_func;
+        params.subscribe_signals_func = rp_module_ctx.app.ws_subscribe_signals_func;
+        params.unsubscribe_signals_func = rp_module_ctx.app.ws_unsubscribe_signals_func;
+        params.update_signal_subscriptions_func = rp_module_ctx.app.ws_update_signal_subscriptions_func;
+        params.get_subscription_frame_func = rp_module_ctx.app.ws_get_subscription_frame_func;
         fprintf(stderr, "Starting WS-server\n");
 
         start_ws_server(&params);
@@ -409,13 +409,22 @@ int rp_data_get_params(ngx_http_request_t *r, cJSON **json_root)
 }
 
 
+/*----------------------------------------------------------------------------*/
+static long rp_data_elapsed_us(struct timespec *from, struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000000L +
+        (to->tv_nsec - from->tv_nsec) / 1000L;
+}
+
+
 /*----------------------------------------------------------------------------*/
 int rp_data_get_signals(ngx_http_request_t *r, cJSON **json_root)
 {
     int rp_sig_num, rp_sig_len, ret_val;
     cJSON *data_root, *sig_root, *d1, *d2, *g1;
     /* TODO: Make it configurable */
-    int retries = 200; /* Approx in [ms] */
+    const long timeout_us = 200000;
+    struct timespec start, call, now;
 
     if(rp_signals == NULL) {
         int i;
@@ -432,21 +441,26 @@ int rp_data_get_signals(ngx_http_request_t *r, cJSON **json_root)
                                    r->pool);
     }
     
+    clock_gettime(CLOCK_MONOTONIC, &start);
     ret_val =
         rp_module_ctx.app.get_signals_func((float ***)&rp_signals, &rp_sig_num, 
                                            &rp_sig_len);
 
     while(ret_val == -1) {
+        clock_gettime(CLOCK_MONOTONIC, &call);
         ret_val =
             rp_module_ctx.app.get_signals_func((float ***)&rp_signals, 
                                                &rp_sig_num, &rp_sig_len);
 
         if(ret_val == -2) 
             break;
-        if(retries-- <= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if(rp_data_elapsed_us(&start, &now) >= timeout_us) {
             /* Use old signals */
             break;
-        } else {
+        } else if((ret_val == -1) && (rp_data_elapsed_us(&call, &now) < 1000)) {
+            /* Controllers which block until new signals are published
+             * return late on their own, others are polled each [ms] */
             usleep(1000);
         }
     }
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <string>
 #include <libjson.h>
 
+#include "JSONWriter.h"
+#include "JSONReader.h"
+
 class CBaseParameter  //base class for parameter and signal
 {
 public:
@@ -17,14 +21,48 @@ public:
 		AccessModes
 	};
 
+	CBaseParameter() : m_Id(-1) {}
 	virtual ~CBaseParameter(){};
 	virtual const char* GetName() const = 0;
 	virtual void Update() = 0;		//apply change of value
 	virtual JSONNode GetJSONObject() = 0;	//get JSON-formatted string with parameters or signals
+	virtual JSONNode GetJSONValue() { return GetJSONObject(); }	//get value only, for delta messages
+	virtual bool AppendBinaryObject(std::string& _out) { return false; }	//append to binary signal frame, false if not supported
+	virtual JSONNode GetDecimatedJSONObject(size_t _points) { return GetJSONObject(); }	//signals reduced to _points, 0 - all
+	virtual bool AppendDecimatedBinaryObject(std::string& _out, size_t _points) { return AppendBinaryObject(_out); }
 	virtual void SetValueFromJSON(JSONNode _node) = 0;	// set the m_TmpValue->value from JSON object
+
+	//streaming versions of the above, by default through libjson
+	virtual void WriteJSONObject(JSONWriter& _w) { _w.Raw(GetName(), GetJSONObject().write()); }
+	virtual void WriteJSONValue(JSONWriter& _w, const std::string& _key)	//as GetJSONValue(), libjson writes objects and arrays only
+	{
+		JSONNode n = GetJSONValue();
+		if(n.type() == JSON_NODE || n.type() == JSON_ARRAY)
+			return _w.Raw(_key, n.write());
+		JSONNode array(JSON_ARRAY);
+		array.push_back(n);
+		std::string text = array.write();
+		_w.Raw(_key, text.substr(1, text.size() - 2));
+	}
+	virtual void WriteDecimatedJSONObject(JSONWriter& _w, size_t _points) { _w.Raw(GetName(), GetDecimatedJSONObject(_points).write()); }
+	virtual bool ReadValueFromJSON(JSONReader& _reader)	// the parameter object at the reader, false if it has no value
+	{
+		const char* begin;
+		const char* end;
+		if(!_reader.SkipValue(&begin, &end))
+			return false;
+		SetValueFromJSON(libjson::parse(std::string(begin, end)));
+		return true;
+	}
 	virtual AccessMode GetAccessMode() const = 0;
 	virtual bool IsValueChanged() const = 0;
 	virtual bool IsNewValue() const = 0;
 	virtual void ClearNewValue() = 0;
 	virtual bool NeedSend(bool _no_need=false) const { return _no_need; };
+
+	int GetId() const { return m_Id; }	// stable numeric ID, -1 if not registered
+	void SetId(int _id) { m_Id = _id; }
+
+protected:
+	int m_Id;
 };
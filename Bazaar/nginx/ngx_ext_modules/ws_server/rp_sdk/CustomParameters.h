@@ -4,6 +4,9 @@
 #include <string.h>
 
 #include "Parameter.h"
+#include "SignalFrame.h"
+#include "SignalDecimation.h"
+#include "SignalBuffer.h"
 
 template <typename Type> class CDecoderParameter : public CParameter<Type, Type>
 {
@@ -16,6 +19,7 @@ public:
 	void Set(const Type& _value)
 	{
 		this->m_Value.value = _value;
+		this->NotifyChanged();
 	}
 
 	bool IsValueChanged() const
@@ -74,6 +78,27 @@ public:
 		return n;
 	}
 
+	void WriteJSONObject(JSONWriter& _w)
+	{
+		_w.BeginObject(this->m_Value.name);
+		_w.Member("value", this->m_Value.value);
+		_w.Member("min", this->m_Value.min);
+		_w.Member("max", this->m_Value.max);
+		_w.Member("access_mode", this->m_Value.access_mode);
+		_w.Member("fpga_update", this->m_Value.fpga_update);
+		_w.EndObject();
+	}
+
+	JSONNode GetJSONValue()
+	{
+		return JSONNode("", this->m_Value.value);
+	}
+
+	void WriteJSONValue(JSONWriter& _w, const std::string& _key)
+	{
+		_w.Member(_key, this->m_Value.value);
+	}
+
 	Type CheckMinMax(Type _value)
 	{
 		Type value = _value;
@@ -95,6 +120,7 @@ public:
 	void Set(const Type& _value)
 	{
 		this->m_Value.value = CheckMinMax(_value);
+		this->NotifyChanged();
 	}
 
 	// void SendValue(const Type& _value)
@@ -121,6 +147,7 @@ public:
 	{
 		this->m_Value.value = CheckMinMax(_value);
 		m_NeedSend = true;
+		this->NotifyChanged();
 	}
 
 	bool NeedSend(bool _no_need=false) const
@@ -139,17 +166,57 @@ protected:
 };
 
 
+//JSON object of a signal: {"size":n,"value":[...]}
+template <typename Type> JSONNode MakeSignalJSONObject(const std::string& _name, const Type* _values, size_t _size)
+{
+	JSONNode n(JSON_NODE);
+	n.set_name(_name);
+	n.push_back(JSONNode("size", _size));
+
+	JSONNode child(JSON_ARRAY);
+	child.set_name("value");
+	for(size_t i=0; i < _size; i++)
+	{
+		Type res = _values[i];
+		child.push_back(JSONNode("", res));
+	}
+	n.push_back(child);
+	return n;
+}
+
+//the same written straight into a message
+template <typename Type> void WriteSignalJSONObject(JSONWriter& _w, const std::string& _name, const Type* _values, size_t _size)
+{
+	_w.BeginObject(_name);
+	_w.Member("size", _size);
+	_w.Key("value");
+	_w.Array(_values, _size);
+	_w.EndObject();
+}
+
+//binary signal frame entry, false for sample types without one
+template <typename Type> bool AppendSignalBinary(std::string& _out, const std::string& _name,
+												 const Type* _values, size_t _size, uint32_t _version)
+{
+	if(SignalFrameTypeOf<Type>::value < 0)
+		return false;
+	SignalFrameAppend(_out, _name, SignalFrameTypeOf<Type>::value, _values, _size, sizeof(Type), _version);
+	return true;
+}
+
 //template for signals
 template <typename Type> class CCustomSignal : public CParameter<Type, std::vector<Type> >
 {
 public:
 	CCustomSignal(std::string _name, int _size, Type _def_value)
 		:CParameter<Type, std::vector<Type> >(_name, CBaseParameter::RO, std::vector<Type>(_size, _def_value)),
-		m_Dirty(true){}
+		m_Dirty(true),
+		m_Version(0){}
 
 	CCustomSignal(std::string _name, CBaseParameter::AccessMode _access_mode, int _size, Type _def_value)
 		:CParameter<Type, std::vector<Type> >(_name, _access_mode, std::vector<Type>(_size, _def_value)),
-		m_Dirty(true) {}
+		m_Dirty(true),
+		m_Version(0) {}
 
 	~CCustomSignal()
 	{
@@ -160,19 +227,41 @@ public:
 
 	JSONNode GetJSONObject()
 	{
-		JSONNode n(JSON_NODE);
-		n.set_name(this->m_Value.name);
-		n.push_back(JSONNode("size", this->m_Value.value.size()));
+		return MakeJSONObject(this->m_Value.value);
+	}
 
-		JSONNode child(JSON_ARRAY);
-		child.set_name("value");
-		for(unsigned int i=0; i < this->m_Value.value.size(); i++)
-		{
-			Type res = this->m_Value.value.at(i);
-			child.push_back(JSONNode("", res));
-		}
-		n.push_back(child);
-		return n;
+	void WriteJSONObject(JSONWriter& _w)
+	{
+		WriteSignalJSONObject(_w, this->m_Value.name, this->m_Value.value.data(), this->m_Value.value.size());
+	}
+
+	bool AppendBinaryObject(std::string& _out)
+	{
+		return AppendBinary(_out, this->m_Value.value);
+	}
+
+	JSONNode GetDecimatedJSONObject(size_t _points)
+	{
+		if(_points == 0 || this->m_Value.value.size() <= _points)
+			return GetJSONObject();
+		DecimatePeaks(this->m_Value.value.data(), this->m_Value.value.size(), _points, m_Decimated);
+		return MakeJSONObject(m_Decimated);
+	}
+
+	void WriteDecimatedJSONObject(JSONWriter& _w, size_t _points)
+	{
+		if(_points == 0 || this->m_Value.value.size() <= _points)
+			return WriteJSONObject(_w);
+		DecimatePeaks(this->m_Value.value.data(), this->m_Value.value.size(), _points, m_Decimated);
+		WriteSignalJSONObject(_w, this->m_Value.name, m_Decimated.data(), m_Decimated.size());
+	}
+
+	bool AppendDecimatedBinaryObject(std::string& _out, size_t _points)
+	{
+		if(_points == 0 || this->m_Value.value.size() <= _points)
+			return AppendBinaryObject(_out);
+		DecimatePeaks(this->m_Value.value.data(), this->m_Value.value.size(), _points, m_Decimated);
+		return AppendBinary(_out, m_Decimated);
 	}
 
 	const Type& operator [](int _index) const
@@ -207,6 +296,7 @@ public:
 	void Update()
 	{
 		m_Dirty = false;
+		m_Version++;
 	}
 
 	int GetSize()
@@ -229,7 +319,192 @@ public:
 		m_Dirty = true;
 	}
 private:
+	JSONNode MakeJSONObject(const std::vector<Type>& _values)
+	{
+		return MakeSignalJSONObject(this->m_Value.name, _values.data(), _values.size());
+	}
+
+	bool AppendBinary(std::string& _out, const std::vector<Type>& _values)
+	{
+		return AppendSignalBinary(_out, this->m_Value.name, _values.data(), _values.size(), m_Version);
+	}
+
+	bool m_Dirty;
+	uint32_t m_Version; // incremented every time the signal was sent after a change
+	std::vector<Type> m_Decimated; // scratch buffer, reused between frames
+};
+
+//template for signals in preallocated aligned buffers, double buffered:
+//the samples are written into Back(), Swap() in UpdateSignals() publishes
+//them and the previous samples become the back buffer. Data() is what gets
+//sent. Nothing is copied or allocated after construction. Read only for the
+//client.
+//Not synchronized: Back(), Swap(), Set() and Resize() must be called from
+//the thread which calls UpdateSignals(), the signals are sent from it. An
+//acquisition thread hands its samples over by its own means, e.g. a
+//CSignalBuffer passed through a lock, and UpdateSignals() Set()s it.
+template <typename Type> class CBufferedSignal : public CBaseParameter
+{
+public:
+	CBufferedSignal(std::string _name, int _size, Type _def_value)
+		: m_Name(_name)
+		, m_Front(_size, _def_value)
+		, m_Back(_size, _def_value)
+		, m_Dirty(true)
+		, m_Version(0)
+	{
+		CDataManager * man = CDataManager::GetInstance();
+		if(man)
+			man->RegisterSignal(this);
+	}
+
+	const char* GetName() const
+	{
+		return m_Name.c_str();
+	}
+
+	//samples being sent, unchecked
+	SignalSpan<const Type> Data() const
+	{
+		return m_Front.Span();
+	}
+
+	const Type& operator [](size_t _index) const
+	{
+		return m_Front.Data()[_index];
+	}
+
+	//samples of the next update, unchecked
+	SignalSpan<Type> Back()
+	{
+		return m_Back.Span();
+	}
+
+	void Swap()
+	{
+		m_Front.Swap(m_Back);
+		m_Dirty = true;
+	}
+
+	//moves the samples in, _buffer gets the previous ones for reuse. False
+	//(and nothing moved) if its capacity is not Capacity(), both buffers
+	//keep the capacity given at construction.
+	bool Set(CSignalBuffer<Type>&& _buffer)
+	{
+		if(_buffer.Capacity() != m_Back.Capacity())
+			return false;
+		m_Front.Swap(_buffer);
+		m_Dirty = true;
+		return true;
+	}
+
+	void Set(const Type* _value, size_t _size)
+	{
+		m_Back.Assign(_value, _size);
+		Swap();
+	}
+
+	void Set(const std::vector<Type>& _value)
+	{
+		Set(_value.data(), _value.size());
+	}
+
+	//both buffers, false (and neither resized) over Capacity()
+	bool Resize(size_t _new_size)
+	{
+		if(_new_size > m_Front.Capacity() || _new_size > m_Back.Capacity())
+			return false;
+		m_Dirty = true;
+		return m_Front.Resize(_new_size) && m_Back.Resize(_new_size);
+	}
+
+	int GetSize()
+	{
+		return m_Front.Size();
+	}
+
+	//the size given at construction
+	size_t Capacity() const
+	{
+		return m_Back.Capacity();
+	}
+
+	void Update()
+	{
+		m_Dirty = false;
+		m_Version++;
+	}
+
+	JSONNode GetJSONObject()
+	{
+		return MakeSignalJSONObject(m_Name, m_Front.Data(), m_Front.Size());
+	}
+
+	void WriteJSONObject(JSONWriter& _w)
+	{
+		WriteSignalJSONObject(_w, m_Name, m_Front.Data(), m_Front.Size());
+	}
+
+	bool AppendBinaryObject(std::string& _out)
+	{
+		return AppendSignalBinary(_out, m_Name, m_Front.Data(), m_Front.Size(), m_Version);
+	}
+
+	JSONNode GetDecimatedJSONObject(size_t _points)
+	{
+		if(_points == 0 || m_Front.Size() <= _points)
+			return GetJSONObject();
+		DecimatePeaks(m_Front.Data(), m_Front.Size(), _points, m_Decimated);
+		return MakeSignalJSONObject(m_Name, m_Decimated.data(), m_Decimated.size());
+	}
+
+	void WriteDecimatedJSONObject(JSONWriter& _w, size_t _points)
+	{
+		if(_points == 0 || m_Front.Size() <= _points)
+			return WriteJSONObject(_w);
+		DecimatePeaks(m_Front.Data(), m_Front.Size(), _points, m_Decimated);
+		WriteSignalJSONObject(_w, m_Name, m_Decimated.data(), m_Decimated.size());
+	}
+
+	bool AppendDecimatedBinaryObject(std::string& _out, size_t _points)
+	{
+		if(_points == 0 || m_Front.Size() <= _points)
+			return AppendBinaryObject(_out);
+		DecimatePeaks(m_Front.Data(), m_Front.Size(), _points, m_Decimated);
+		return AppendSignalBinary(_out, m_Name, m_Decimated.data(), m_Decimated.size(), m_Version);
+	}
+
+	void SetValueFromJSON(JSONNode _node) {}
+
+	AccessMode GetAccessMode() const
+	{
+		return CBaseParameter::RO;
+	}
+
+	bool IsValueChanged() const
+	{
+		return m_Dirty;
+	}
+
+	bool IsNewValue() const
+	{
+		return false;
+	}
+
+	void ClearNewValue() {}
+
+	void ForceSend()
+	{
+		m_Dirty = true;
+	}
+
+private:
+	std::string m_Name;
+	CSignalBuffer<Type> m_Front;
+	CSignalBuffer<Type> m_Back;
 	bool m_Dirty;
+	uint32_t m_Version; // incremented every time the signal was sent after a change
+	std::vector<Type> m_Decimated; // scratch buffer, reused between frames
 };
 
 //custom CIntParameter
@@ -274,6 +549,7 @@ public:
 	void Set(const std::string& _value)
 	{
 		this->m_Value.value = _value;
+		this->NotifyChanged();
 	}
 };
 
@@ -323,6 +599,30 @@ public:
 		:CCustomSignal(_name, _access_mode, _size, _def_value){};
 };
 
+//custom CIntBufferedSignal
+class CIntBufferedSignal : public CBufferedSignal<int>
+{
+public:
+	CIntBufferedSignal(std::string _name, int _size, int _def_value)
+		:CBufferedSignal(_name, _size, _def_value){};
+};
+
+//custom CFloatBufferedSignal
+class CFloatBufferedSignal : public CBufferedSignal<float>
+{
+public:
+	CFloatBufferedSignal(std::string _name, int _size, float _def_value)
+		:CBufferedSignal(_name, _size, _def_value){};
+};
+
+//custom CDoubleBufferedSignal
+class CDoubleBufferedSignal : public CBufferedSignal<double>
+{
+public:
+	CDoubleBufferedSignal(std::string _name, int _size, double _def_value)
+		:CBufferedSignal(_name, _size, _def_value){};
+};
+
 extern CBooleanParameter IsDemoParam;		// special default parameter to check mode (demo or not)
 extern CStringParameter InCommandParam;		// special default parameter to receive a string command from WEB UI
 extern CStringParameter OutCommandParam;	// special default parameter to send a string command to WEB UI
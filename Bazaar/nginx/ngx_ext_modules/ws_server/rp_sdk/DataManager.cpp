@@ -1,25 +1,50 @@
 #include <stdio.h>
 #include <cstring>
 #include <map>
+#include <algorithm>
+#include <unordered_set>
+#include <time.h>
 #include "DataManager.h"
 #include "CustomParameters.h"
 #include "misc.h"
 
 #include "gziping.h"
+#include "redpitaya/rp_log.h"
+
+// Full scan of the parameters every that many GetParams() calls, picks up
+// values changed through Value() which bypass the change journal
+#define PARAM_RESCAN_TICKS	50
 
 CStringParameter InCommandParam("in_command", CBaseParameter::WO, "", 1);
 CStringParameter OutCommandParam("out_command", CBaseParameter::RO, "", 1);
 
+// Messages are queued and written to the log file by the rp_log thread,
+// so logging on the parameter and signal paths does not wait for the disk
+static bool dbg_open()
+{
+	if(rp_log_open("/var/log/redpitaya_nginx/rp_sdk.log") != 0)
+		return false;
+	rp_log_set_level(LOG_DEBUG);
+	return true;
+}
+
+// rp_sdk is linked into every application, which nginx unloads with
+// dlclose() (also after just listing it): its rp_log thread is stopped
+// first, it would run unmapped code otherwise
+__attribute__((destructor)) static void dbg_close()
+{
+	rp_log_stop();
+}
+
 int dbg_printf(const char * format, ...)
 {
-	static FILE* log = fopen("/var/log/redpitaya_nginx/rp_sdk.log", "wt");
-	if(log)
+	static bool log = dbg_open();
+	if(log && rp_log_enabled(LOG_DEBUG))
 	{
 		va_list va;
 		va_start(va, format);
-		vfprintf(log, format, va);
+		rp_log_vwrite(LOG_DEBUG, format, va);
 		va_end(va);
-		fflush(log);
 	}
 
 	return 0;
@@ -40,6 +65,9 @@ CDataManager::CDataManager()
 	, m_param_interval(20)
 	, m_signal_interval(20)
 	, m_send_all_params(true)
+	, m_ids_version(0)
+	, m_rescan_ticks(PARAM_RESCAN_TICKS)
+	, m_next_subscription(0)
 {
 }
 
@@ -52,7 +80,19 @@ CDataManager* CDataManager::GetInstance()
 void CDataManager::RegisterParam(CBaseParameter * _param)
 {
 	dbg_printf("RegisterParam: %s\n", _param->GetName());
+	int id = m_param_table.size();
+	_param->SetId(id);
 	m_params.push_back(_param);
+	m_param_table.push_back(_param);
+	m_param_ids[_param->GetName()] = id;
+
+	CBaseParameter::AccessMode mode = _param->GetAccessMode();
+	if(mode == CBaseParameter::AccessMode::RWSA || mode == CBaseParameter::AccessMode::ROSA)
+		m_param_always.push_back(id);
+	m_ids_version++;
+
+	std::lock_guard<std::mutex> lock(m_journal_mutex);
+	m_journaled.push_back(false);
 	dbg_printf("Registered params: %d\n", m_params.size());
 }
 
@@ -60,29 +100,37 @@ void CDataManager::RegisterSignal(CBaseParameter * _signal)
 {
 	dbg_printf("RegisterSignal: %s\n", _signal->GetName());
 	m_signals.push_back(_signal);
+	for(std::map<int, SignalSubscription>::iterator it = m_subscriptions.begin(); it != m_subscriptions.end(); ++it)
+		ResolveSubscription(it->second);
 	dbg_printf("Registered signals: %d\n", m_signals.size());
 }
 
 void CDataManager::UnRegisterParam(const char * _name)
 {
-	for (std::vector<CBaseParameter *>::iterator it =  m_params.begin() ; it !=  m_params.end(); ++it)
-	{
-		if(strcmp((*it)->GetName(),_name)==0)
-		{
-			m_params.erase(it);
-			dbg_printf("UnRegisterParam: %s\n", _name);
-			return;
-		}
-	}
+	std::unordered_map<std::string, int>::iterator id = m_param_ids.find(_name);
+	if(id == m_param_ids.end())
+		return;
+
+	CBaseParameter* param = m_param_table[id->second];
+	m_param_table[id->second] = NULL;
+	m_param_always.erase(std::remove(m_param_always.begin(), m_param_always.end(), id->second), m_param_always.end());
+	m_new_ids.erase(std::remove(m_new_ids.begin(), m_new_ids.end(), id->second), m_new_ids.end());
+	m_params.erase(std::remove(m_params.begin(), m_params.end(), param), m_params.end());
+	m_param_ids.erase(id);
+	param->SetId(-1);
+	m_ids_version++;
+	dbg_printf("UnRegisterParam: %s\n", _name);
 }
 
 void CDataManager::UnRegisterSignal(const char * _name)
 {
-	for (std::vector<CBaseParameter *>::iterator it =  m_signals.begin() ; it !=  m_params.end(); ++it)
+	for (std::vector<CBaseParameter *>::iterator it =  m_signals.begin() ; it !=  m_signals.end(); ++it)
 	{
 		if(strcmp((*it)->GetName(),_name)==0)
 		{
 			m_signals.erase(it);
+			for(std::map<int, SignalSubscription>::iterator sub = m_subscriptions.begin(); sub != m_subscriptions.end(); ++sub)
+				ResolveSubscription(sub->second);
 			dbg_printf("UnRegisterSignal: %s\n", _name);
 			return;
 		}
@@ -103,72 +151,324 @@ void CDataManager::UpdateAllSignals()
         }
 }
 
+int CDataManager::GetParamId(const std::string& _name) const
+{
+	std::unordered_map<std::string, int>::const_iterator it = m_param_ids.find(_name);
+	return it != m_param_ids.end() ? it->second : -1;
+}
+
+void CDataManager::MarkChanged(int _id)
+{
+	std::lock_guard<std::mutex> lock(m_journal_mutex);
+	if(_id < (int)m_journaled.size() && !m_journaled[_id])
+	{
+		m_journaled[_id] = true;
+		m_journal.push_back(_id);
+	}
+}
+
 std::string CDataManager::GetParamsJson()
+{
+	std::string json;
+	GetParams(&json, NULL);
+	return json;
+}
+
+// Only parameters in the change journal and the RWSA/ROSA ones are checked,
+// unless all parameters are requested or a periodic full scan is due
+size_t CDataManager::GetParams(std::string* _json, std::string* _delta)
 {
 	UpdateParams();
-	JSONNode params(JSON_NODE);
-	params.set_name("parameters");
-	for(size_t i=0; i < m_params.size(); i++) {
-		if(NeedSend(*m_params[i])) {
-			JSONNode n(JSON_NODE);
-			n = m_params[i]->GetJSONObject();
-			m_params[i]->NeedSend(true); // no need
-			params.push_back(n);
+
+	std::vector<int> ids;
+	{
+		std::lock_guard<std::mutex> lock(m_journal_mutex);
+		ids.swap(m_journal);
+		for(size_t i=0; i < ids.size(); i++)
+			m_journaled[ids[i]] = false;
+	}
+
+	if(m_send_all_params || --m_rescan_ticks <= 0)
+	{
+		ids.clear();
+		for(size_t i=0; i < m_params.size(); i++)
+			ids.push_back(m_params[i]->GetId());
+		m_rescan_ticks = PARAM_RESCAN_TICKS;
+	}
+	else
+	{
+		// RWSA/ROSA parameters are appended once, even if they were set
+		size_t n = 0;
+		for(size_t i=0; i < ids.size(); i++)
+		{
+			CBaseParameter* param = m_param_table[ids[i]];
+			if(param && param->GetAccessMode() != CBaseParameter::AccessMode::RWSA
+				&& param->GetAccessMode() != CBaseParameter::AccessMode::ROSA)
+				ids[n++] = ids[i];
 		}
+		ids.resize(n);
+		ids.insert(ids.end(), m_param_always.begin(), m_param_always.end());
+	}
+
+	// written straight into the caller's strings, which keep their capacity
+	std::string unused;
+	JSONWriter json(_json ? *_json : unused);
+	JSONWriter delta(_delta ? *_delta : unused);
+	size_t count = 0;
+
+	if(_json) {
+		_json->clear();
+		json.BeginObject();
+		json.BeginObject("parameters");
+	}
+	if(_delta) {
+		_delta->clear();
+		delta.BeginObject();
+		delta.BeginObject("delta");
 	}
 
-	JSONNode data_node(JSON_NODE);
-	data_node.set_name("data");
-	data_node.push_back(params);
+	for(size_t i=0; i < ids.size(); i++) {
+		CBaseParameter* param = m_param_table[ids[i]];
+		if(param && NeedSend(*param)) {
+			if(_json)
+				param->WriteJSONObject(json);
+			if(_delta)
+				param->WriteJSONValue(delta, std::to_string(ids[i]));
+			param->NeedSend(true); // no need
+			count++;
+		}
+	}
+
+	if(_json) {
+		json.EndObject();
+		json.EndObject();
+	}
+	if(_delta) {
+		delta.EndObject();
+		delta.EndObject();
+	}
 	m_send_all_params = false;
-	return data_node.write();
+	return count;
+}
+
+// {"ids":{"name":{"id":3,"value":...,"min":...},...}} - the full description
+// of every parameter with its ID, delta messages refer to parameters by ID
+std::string CDataManager::GetParamsIds()
+{
+	JSONNode ids(JSON_NODE);
+	ids.set_name("ids");
+	for(size_t i=0; i < m_params.size(); i++) {
+		JSONNode n(JSON_NODE);
+		n = m_params[i]->GetJSONObject();
+		n.push_back(JSONNode("id", m_params[i]->GetId()));
+		ids.push_back(n);
+	}
+
+	JSONNode ids_node(JSON_NODE);
+	ids_node.push_back(ids);
+	return ids_node.write();
+}
+
+int CDataManager::GetParamsIdsVersion()
+{
+	return m_ids_version;
 }
 
 std::string CDataManager::GetSignalsJson()
+{
+	std::string json;
+	GetSignals(&json, NULL);
+	return json;
+}
+
+void CDataManager::GetSignals(std::string* _json, std::string* _binary)
 {
 	UpdateSignals();
-	JSONNode signals(JSON_NODE);
-	signals.set_name("signals");
+	std::string unused;
+	JSONWriter json(_json ? *_json : unused);
+	uint16_t count = 0;
+
+	if(_binary)
+		SignalFrameBegin(*_binary);
+	if(_json) {
+		_json->clear();
+		json.BeginObject();
+		json.BeginObject("signals");
+	}
+
 	for(size_t i=0; i < m_signals.size(); i++) {
 		if(NeedSend(*m_signals[i])) {
-			JSONNode n(JSON_NODE);
-			n = m_signals[i]->GetJSONObject();
-			signals.push_back(n);
+			if(_json)
+				m_signals[i]->WriteJSONObject(json);
+			if(_binary && m_signals[i]->AppendBinaryObject(*_binary))
+				count++;
 			m_signals[i]->Update();
 		}
 	}
 
-	JSONNode data_node(JSON_NODE);
-	data_node.set_name("data");
-	data_node.push_back(signals);
+	if(_binary)
+		SignalFrameEnd(*_binary, count);
+
+	if(_json) {
+		json.EndObject();
+		json.EndObject();
+	}
 	PostUpdateSignals();
-	return data_node.write();
 }
 
-void CDataManager::OnNewParams(std::string _params)
+int CDataManager::Subscribe(const std::string& _names, size_t _points, int _max_rate, bool _binary)
 {
-	JSONNode n(JSON_NODE);
-	n = libjson::parse(_params);
-	JSONNode m(JSON_NODE);
+	int interval = _max_rate > 0 ? 1000 / _max_rate : 0;
 
-	for (size_t i=0; i < m_params.size(); ++i)
-		m_params[i]->ClearNewValue();
+	for(std::map<int, SignalSubscription>::iterator it = m_subscriptions.begin(); it != m_subscriptions.end(); ++it)
+	{
+		SignalSubscription& sub = it->second;
+		if(sub.names == _names && sub.points == _points && sub.interval == interval && sub.binary == _binary)
+		{
+			// the new client needs every signal once
+			sub.refs++;
+			sub.pending.assign(sub.signals.size(), true);
+			return it->first;
+		}
+	}
 
-	for (size_t i=0; i < n.size(); ++i)
+	int id = m_next_subscription++;
+	SignalSubscription& sub = m_subscriptions[id];
+	sub.names = _names;
+	sub.points = _points;
+	sub.interval = interval;
+	sub.binary = _binary;
+	sub.refs = 1;
+	sub.last = 0;
+	sub.ready = false;
+	ResolveSubscription(sub);
+	dbg_printf("Subscribe %d: '%s' points %d interval %d\n", id, _names.c_str(), (int)_points, interval);
+	return id;
+}
+
+void CDataManager::Unsubscribe(int _id)
+{
+	std::map<int, SignalSubscription>::iterator it = m_subscriptions.find(_id);
+	if(it != m_subscriptions.end() && --it->second.refs <= 0)
 	{
-		m = n.at(i);
-		std::string name = m.name();
+		m_subscriptions.erase(it);
+		dbg_printf("Unsubscribe %d\n", _id);
+	}
+}
 
-		for (size_t j=0; j < m_params.size(); ++j)
+void CDataManager::ResolveSubscription(SignalSubscription& _sub)
+{
+	std::string list = "," + _sub.names + ",";
+	_sub.signals.clear();
+	for(size_t i=0; i < m_signals.size(); i++)
+	{
+		if(_sub.names.empty() || list.find(std::string(",") + m_signals[i]->GetName() + ",") != std::string::npos)
+			_sub.signals.push_back(m_signals[i]);
+	}
+	_sub.pending.assign(_sub.signals.size(), true);
+}
+
+// UpdateSignals() runs once for all subscriptions. Changes are collected per
+// subscription until it is due, so a rate limited subscription gets every
+// signal which changed since its last frame, not only those of this tick.
+int CDataManager::UpdateSubscriptions()
+{
+	UpdateSignals();
+
+	std::unordered_set<CBaseParameter*> changed;
+	for(size_t i=0; i < m_signals.size(); i++) {
+		if(NeedSend(*m_signals[i])) {
+			changed.insert(m_signals[i]);
+			m_signals[i]->Update();
+		}
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	long long now = ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+	int frames = 0;
+
+	for(std::map<int, SignalSubscription>::iterator it = m_subscriptions.begin(); it != m_subscriptions.end(); ++it)
+	{
+		SignalSubscription& sub = it->second;
+		bool pending = false;
+		sub.ready = false;
+		for(size_t i=0; i < sub.signals.size(); i++) {
+			if(!sub.pending[i] && changed.count(sub.signals[i]))
+				sub.pending[i] = true;
+			pending |= sub.pending[i];
+		}
+		if(!pending || (sub.interval && now - sub.last < sub.interval))
+			continue;
+
+		if(sub.binary) {
+			uint16_t count = 0;
+			SignalFrameBegin(sub.frame);
+			for(size_t i=0; i < sub.signals.size(); i++) {
+				if(sub.pending[i] && sub.signals[i]->AppendDecimatedBinaryObject(sub.frame, sub.points))
+					count++;
+			}
+			SignalFrameEnd(sub.frame, count);
+		} else {
+			JSONWriter json(sub.frame);
+			sub.frame.clear();
+			json.BeginObject();
+			json.BeginObject("signals");
+			for(size_t i=0; i < sub.signals.size(); i++) {
+				if(sub.pending[i])
+					sub.signals[i]->WriteDecimatedJSONObject(json, sub.points);
+			}
+			json.EndObject();
+			json.EndObject();
+		}
+
+		sub.pending.assign(sub.signals.size(), false);
+		sub.last = now;
+		sub.ready = true;
+		frames++;
+	}
+
+	PostUpdateSignals();
+	return frames;
+}
+
+const std::string* CDataManager::GetSubscriptionFrame(int _id)
+{
+	std::map<int, SignalSubscription>::iterator it = m_subscriptions.find(_id);
+	if(it == m_subscriptions.end() || !it->second.ready)
+		return NULL;
+	return &it->second.frame;
+}
+
+// Single pass over the message: every value is read straight into the
+// parameter's new value, without building a JSONNode tree first
+void CDataManager::OnNewParams(std::string _params)
+{
+	JSONReader reader(_params.c_str(), _params.size());
+	std::string name;
+
+	// Only parameters set by the previous message can hold a new value
+	for (size_t i=0; i < m_new_ids.size(); ++i)
+		m_param_table[m_new_ids[i]]->ClearNewValue();
+	m_new_ids.clear();
+
+	if (reader.BeginObject())
+	{
+		while (reader.NextKey(name))
 		{
-			if (m_params[j]->GetAccessMode() != CBaseParameter::AccessMode::RO)
+			std::unordered_map<std::string, int>::iterator id = m_param_ids.find(name);
+			CBaseParameter* param = id == m_param_ids.end() ? NULL : m_param_table[id->second];
+			if (!param || param->GetAccessMode() == CBaseParameter::AccessMode::RO)
 			{
-				std::string param_name = m_params[j]->GetName();
-				if (name == param_name)
-					m_params[j]->SetValueFromJSON(m);
+				reader.SkipValue();
+				continue;
 			}
+			if (param->ReadValueFromJSON(reader))
+				m_new_ids.push_back(id->second);
 		}
 	}
+	if (reader.Error())
+		dbg_printf("Malformed parameters: %s\n", _params.c_str());
 
 	if(InCommandParam.IsNewValue())
 		m_send_all_params |= InCommandParam.NewValue() == "send_all_params";
@@ -257,12 +557,46 @@ extern "C" const char * ws_get_params(void)
 	static std::string res = "";
 	if(man)
 	{
-		res = man->GetParamsJson();
+		man->GetParams(&res, NULL);
 		return res.c_str();
 	}
 	return res.c_str();
 }
 
+// Builds the changed parameters once for all connections, in the JSON format
+// and/or as a delta keyed by parameter ID: {"delta":{"3":1000,"7":true}}.
+// Pass NULL for the format which is not needed, returns the parameter count.
+// Delta clients need the ID dictionary again when _ids_version changes.
+extern "C" int ws_get_params_frames(const char** _json, const char** _delta, int* _ids_version)
+{
+	CDataManager * man = CDataManager::GetInstance();
+	static std::string json = "";
+	static std::string delta = "";
+	int count = 0;
+	if(man)
+	{
+		count = man->GetParams(_json ? &json : NULL, _delta ? &delta : NULL);
+		if(_ids_version)
+			*_ids_version = man->GetParamsIdsVersion();
+	}
+	if(_json)
+		*_json = json.c_str();
+	if(_delta)
+		*_delta = delta.c_str();
+	return count;
+}
+
+// Dictionary which delta clients need before the first delta and whenever
+// the version returned by ws_get_params_frames() changes
+extern "C" const char * ws_get_params_ids(void)
+{
+	CDataManager * man = CDataManager::GetInstance();
+	static std::string res = "";
+	if(man)
+		res = man->GetParamsIds();
+	return res.c_str();
+}
+
 extern "C" int ws_set_signals(const char *_signals)
 {
 	CDataManager * man = CDataManager::GetInstance();
@@ -283,12 +617,75 @@ extern "C" const char* ws_get_signals(void)
 	static std::string res = "";
 	if(man)
 	{
-		res = man->GetSignalsJson();
+		man->GetSignals(&res, NULL);
 		return res.c_str();
 	}
 	return res.c_str();
 }
 
+// Builds the signals once for all connections, in JSON and/or binary frame
+// format - pass NULL for the format which is not needed
+extern "C" int ws_get_signals_frames(const char** _json, const char** _binary, size_t* _binary_size)
+{
+	CDataManager * man = CDataManager::GetInstance();
+	static std::string json = "";
+	static std::string binary = "";
+	if(man)
+	{
+		man->GetSignals(_json ? &json : NULL, _binary ? &binary : NULL);
+		if(_json)
+			*_json = json.c_str();
+		if(_binary)
+		{
+			*_binary = binary.data();
+			*_binary_size = binary.size();
+		}
+		return 1;
+	}
+	return 0;
+}
+
+// Signal subscriptions: _names is a comma separated list of signal names
+// (empty - all), _points the point count for peak preserving decimation
+// (0 - full resolution), _max_rate the maximum frames per second (0 - every
+// signal tick). Returns the subscription ID.
+extern "C" int ws_subscribe_signals(const char* _names, int _points, int _max_rate, int _binary)
+{
+	CDataManager * man = CDataManager::GetInstance();
+	if(man)
+		return man->Subscribe(_names ? _names : "", _points > 0 ? _points : 0, _max_rate, _binary != 0);
+	return -1;
+}
+
+extern "C" void ws_unsubscribe_signals(int _id)
+{
+	CDataManager * man = CDataManager::GetInstance();
+	if(man)
+		man->Unsubscribe(_id);
+}
+
+// Replaces ws_get_signals() on every signal tick when subscriptions are used
+extern "C" int ws_update_signal_subscriptions(void)
+{
+	CDataManager * man = CDataManager::GetInstance();
+	if(man)
+		return man->UpdateSubscriptions();
+	return 0;
+}
+
+// Frame of the subscription built by the last ws_update_signal_subscriptions(),
+// returns 0 if the subscription has no new frame
+extern "C" int ws_get_subscription_frame(int _id, const char** _data, size_t* _size)
+{
+	CDataManager * man = CDataManager::GetInstance();
+	const std::string* frame = man ? man->GetSubscriptionFrame(_id) : NULL;
+	if(!frame)
+		return 0;
+	*_data = frame->data();
+	*_size = frame->size();
+	return 1;
+}
+
 extern "C" void ws_set_params_interval(int _interval)
 {
 	CDataManager * man = CDataManager::GetInstance();
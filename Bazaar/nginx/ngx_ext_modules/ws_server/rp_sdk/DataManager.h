@@ -2,6 +2,9 @@
 
 #include <vector>
 #include <map>
+#include <string>
+#include <unordered_map>
+#include <mutex>
 #include "BaseParameter.h"
 
 struct Data {
@@ -9,6 +12,21 @@ struct Data {
 	size_t size;
 };
 
+// Signals one or more clients asked for, at a point count and maximum rate
+struct SignalSubscription {
+	std::string names;	// comma separated, empty - all signals
+	std::vector<CBaseParameter*> signals;	// resolved names, in registration order
+	size_t points;	// peak preserving decimation to this many points, 0 - none
+	int interval;	// minimum time between frames in milliseconds, 0 - every tick
+	bool binary;	// binary signal frame instead of JSON
+	int refs;
+
+	std::vector<bool> pending;	// signals[i] changed since the last frame
+	long long last;	// time of the last frame in milliseconds
+	bool ready;	// frame was built in the last UpdateSubscriptions()
+	std::string frame;
+};
+
 class CDataManager
 {
 private:
@@ -24,6 +42,24 @@ private:
 	int m_signal_interval; //signals send time interval in milliseconds
 	bool m_send_all_params;
 
+	// Parameter registry: IDs index m_param_table and are never reused
+	std::unordered_map<std::string, int> m_param_ids;
+	std::vector<CBaseParameter*> m_param_table; // NULL after UnRegisterParam
+	std::vector<int> m_param_always; // RWSA/ROSA parameters, sent every time
+	int m_ids_version; // incremented when the registry changes
+
+	// Change journal: IDs of parameters set since the last GetParams()
+	std::mutex m_journal_mutex;
+	std::vector<int> m_journal;
+	std::vector<bool> m_journaled;
+	int m_rescan_ticks; // ticks until a full scan for values changed through Value()
+
+	std::vector<int> m_new_ids; // parameters with a new value from the client
+
+	std::map<int, SignalSubscription> m_subscriptions;
+	int m_next_subscription;
+	void ResolveSubscription(SignalSubscription& _sub);
+
 public:
 	static CDataManager* GetInstance();
 	void UpdateAllParams(void); // involves Update function for registered parameter
@@ -34,8 +70,20 @@ public:
 	void UnRegisterParam(const char * _name);
 	void UnRegisterSignal(const char * _name);
 
+	int GetParamId(const std::string& _name) const; // -1 if not registered
+	void MarkChanged(int _id); // called by parameters when their value is set
+
 	std::string GetParamsJson(); //get all parameters in JSON-formatted string
+	size_t GetParams(std::string* _json, std::string* _delta); //get changed parameters in JSON and/or delta format (NULL if not needed), returns their count
+	std::string GetParamsIds(); //get the name to ID dictionary for delta clients
+	int GetParamsIdsVersion(); //incremented when parameters are (un)registered
 	std::string GetSignalsJson(); //get all signals in JSON-formatted string
+	void GetSignals(std::string* _json, std::string* _binary); //get signals in JSON and/or binary frame format (NULL if not needed)
+
+	int Subscribe(const std::string& _names, size_t _points, int _max_rate, bool _binary); //returns subscription ID, identical subscriptions are shared
+	void Unsubscribe(int _id);
+	int UpdateSubscriptions(); //one signal tick for all subscriptions, returns the number of new frames
+	const std::string* GetSubscriptionFrame(int _id); //frame built by the last UpdateSubscriptions(), NULL if none
 
 	void OnNewParams(std::string _params); //is involved when new data received from server, data is JSON-formatted string
 	void OnNewSignals(std::string _signals); //is involved when new data received from server, data is JSON-formatted string
@@ -68,6 +116,13 @@ extern "C" int ws_get_params_interval(void);
 extern "C" int ws_get_signals_interval(void);
 extern "C" const char * ws_get_params(void);
 extern "C" const char * ws_get_signals(void);
+extern "C" int ws_get_params_frames(const char** _json, const char** _delta, int* _ids_version);
+extern "C" const char * ws_get_params_ids(void);
+extern "C" int ws_get_signals_frames(const char** _json, const char** _binary, size_t* _binary_size);
+extern "C" int ws_subscribe_signals(const char* _names, int _points, int _max_rate, int _binary);
+extern "C" void ws_unsubscribe_signals(int _id);
+extern "C" int ws_update_signal_subscriptions(void);
+extern "C" int ws_get_subscription_frame(int _id, const char** _data, size_t* _size);
 extern "C" int ws_set_params(const char *_params);
 extern "C" int ws_set_signals(const char *_signals);
 extern "C" void ws_gzip(const char* _in, void* _out, size_t* size_);
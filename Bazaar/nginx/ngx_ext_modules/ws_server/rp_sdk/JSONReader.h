@@ -0,0 +1,356 @@
+#pragma once
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <string>
+
+// Single pass pull reader for incoming messages: the caller walks the
+// document key by key and reads the values it needs straight into their
+// destination, everything else is skipped without building a JSONNode tree.
+// The text must stay valid while it is read and be followed by a non-number
+// character (a std::string's terminating zero is enough).
+//
+//   JSONReader r(json, size);
+//   std::string key;
+//   if(r.BeginObject())
+//       while(r.NextKey(key))
+//           key == "value" ? r.ReadNumber(value) : r.SkipValue();
+//
+// A value of another type than asked for (null for a number, a number for
+// an object, ...) is skipped: the call returns false, Error() stays false
+// and the rest of the document can still be read. After an error (malformed
+// text) every call returns false.
+class JSONReader
+{
+public:
+	JSONReader(const char* _json, size_t _size)
+		: m_Pos(_json), m_End(_json + _size), m_Error(false), m_First(true) {}
+
+	bool Error() const { return m_Error; }
+
+	bool BeginObject()
+	{
+		return Open('{');
+	}
+
+	// Next key of the current object, false at its end (which is consumed)
+	bool NextKey(std::string& _key)
+	{
+		if(!Next('}'))
+			return false;
+		if(!Expect('"') || !ReadQuoted(_key) || !Expect(':'))
+			return false;
+		return true;
+	}
+
+	bool BeginArray()
+	{
+		return Open('[');
+	}
+
+	// true if the current array has one more element, false at its end
+	bool NextElement()
+	{
+		return Next(']');
+	}
+
+	// Skips the next value of any type, _begin/_end get its text
+	bool SkipValue(const char** _begin = NULL, const char** _end = NULL)
+	{
+		if(!SkipSpace())
+			return false;
+		const char* begin = m_Pos;
+		int depth = 0;
+		do
+		{
+			if(!SkipSpace())
+				return false;
+			char c = *m_Pos;
+			if(c == '"')
+			{
+				if(!SkipString())
+					return false;
+			}
+			else if(c == '{' || c == '[')
+			{
+				depth++;
+				m_Pos++;
+			}
+			else if(c == '}' || c == ']')
+			{
+				if(--depth < 0)
+					return Fail();
+				m_Pos++;
+			}
+			else if(c == ',' || c == ':')
+			{
+				if(depth == 0)
+					return Fail();
+				m_Pos++;
+			}
+			else
+			{
+				const char* start = m_Pos;
+				while(m_Pos < m_End && (isalnum((unsigned char)*m_Pos) || *m_Pos == '-' || *m_Pos == '+' || *m_Pos == '.'))
+					m_Pos++;
+				if(m_Pos == start)
+					return Fail();
+			}
+		} while(depth > 0);
+
+		if(_begin)
+			*_begin = begin;
+		if(_end)
+			*_end = m_Pos;
+		m_First = false;
+		return true;
+	}
+
+	// Number, or a string holding one
+	bool ReadNumber(double& _value)
+	{
+		if(!SkipSpace())
+			return false;
+		if(*m_Pos == '"')
+		{
+			std::string text;
+			if(!ReadString(text))
+				return false;
+			_value = strtod(text.c_str(), NULL);
+			return true;
+		}
+		if(*m_Pos != '-' && !isdigit((unsigned char)*m_Pos))
+			return Mismatch();
+		char* end;
+		_value = strtod(m_Pos, &end);
+		if(end == m_Pos || end > m_End)
+			return Fail();
+		m_Pos = end;
+		m_First = false;
+		return true;
+	}
+
+	// true/false, a number (not 0) or a string holding one of them
+	bool ReadBool(bool& _value)
+	{
+		if(!SkipSpace())
+			return false;
+		if(Literal("true"))
+			_value = true;
+		else if(Literal("false"))
+			_value = false;
+		else if(*m_Pos == '"')
+		{
+			std::string text;
+			if(!ReadString(text))
+				return false;
+			_value = text == "true" || strtod(text.c_str(), NULL) != 0;
+			return true;
+		}
+		else if(*m_Pos != '-' && !isdigit((unsigned char)*m_Pos))
+			return Mismatch();
+		else
+		{
+			double value;
+			if(!ReadNumber(value))
+				return false;
+			_value = value != 0;
+			return true;
+		}
+		m_First = false;
+		return true;
+	}
+
+	bool ReadString(std::string& _value)
+	{
+		if(!SkipSpace())
+			return false;
+		if(*m_Pos != '"')
+			return Mismatch();
+		m_Pos++;
+		return ReadQuoted(_value);
+	}
+
+private:
+	bool Fail()
+	{
+		m_Error = true;
+		m_Pos = m_End;
+		return false;
+	}
+
+	// Skips a value of an unexpected type, not an error in the document
+	bool Mismatch()
+	{
+		SkipValue();
+		return false;
+	}
+
+	// The rest of a string after its opening quote
+	bool ReadQuoted(std::string& _value)
+	{
+		_value.clear();
+		const char* start = m_Pos;
+		while(m_Pos < m_End && *m_Pos != '"')
+		{
+			if(*m_Pos != '\\')
+			{
+				m_Pos++;
+				continue;
+			}
+			_value.append(start, m_Pos);
+			if(++m_Pos == m_End)
+				return Fail();
+			switch(*m_Pos++)
+			{
+			case 'b': _value += '\b'; break;
+			case 'f': _value += '\f'; break;
+			case 'n': _value += '\n'; break;
+			case 'r': _value += '\r'; break;
+			case 't': _value += '\t'; break;
+			case 'u':
+				if(!ReadUnicode(_value))
+					return false;
+				break;
+			default: _value += m_Pos[-1]; break; // " \ /
+			}
+			start = m_Pos;
+		}
+		if(m_Pos == m_End)
+			return Fail();
+		_value.append(start, m_Pos);
+		m_Pos++;
+		m_First = false;
+		return true;
+	}
+
+	bool SkipSpace()
+	{
+		if(m_Error)
+			return false;
+		while(m_Pos < m_End && (*m_Pos == ' ' || *m_Pos == '\t' || *m_Pos == '\n' || *m_Pos == '\r'))
+			m_Pos++;
+		return m_Pos < m_End || Fail();
+	}
+
+	bool Expect(char _c)
+	{
+		if(!SkipSpace())
+			return false;
+		if(*m_Pos != _c)
+			return Fail();
+		m_Pos++;
+		return true;
+	}
+
+	bool Open(char _c)
+	{
+		if(!SkipSpace())
+			return false;
+		if(*m_Pos != _c)
+			return Mismatch();
+		m_Pos++;
+		m_First = true;
+		return true;
+	}
+
+	// Consumes the separator before the next member or the closing bracket
+	bool Next(char _close)
+	{
+		if(!SkipSpace())
+			return false;
+		if(*m_Pos == _close)
+		{
+			m_Pos++;
+			m_First = false;
+			return false;
+		}
+		return m_First || Expect(',');
+	}
+
+	bool Literal(const char* _text)
+	{
+		size_t len = strlen(_text);
+		if((size_t)(m_End - m_Pos) < len || strncmp(m_Pos, _text, len) != 0)
+			return false;
+		m_Pos += len;
+		return true;
+	}
+
+	bool SkipString()
+	{
+		m_Pos++;
+		while(m_Pos < m_End && *m_Pos != '"')
+			m_Pos += *m_Pos == '\\' ? 2 : 1;
+		if(m_Pos >= m_End)
+			return Fail();
+		m_Pos++;
+		return true;
+	}
+
+	bool ReadHex(unsigned& _code)
+	{
+		if(m_End - m_Pos < 4)
+			return Fail();
+		_code = 0;
+		for(int i = 0; i < 4; i++)
+		{
+			char c = *m_Pos++;
+			_code <<= 4;
+			if(c >= '0' && c <= '9') _code |= c - '0';
+			else if(c >= 'a' && c <= 'f') _code |= c - 'a' + 10;
+			else if(c >= 'A' && c <= 'F') _code |= c - 'A' + 10;
+			else return Fail();
+		}
+		return true;
+	}
+
+	// \uXXXX (and a following low surrogate) as UTF-8, a surrogate which is
+	// not part of a pair as U+FFFD
+	bool ReadUnicode(std::string& _value)
+	{
+		unsigned code, low;
+		if(!ReadHex(code))
+			return false;
+		if(code >= 0xD800 && code < 0xDC00 && m_End - m_Pos >= 6 && m_Pos[0] == '\\' && m_Pos[1] == 'u')
+		{
+			const char* pos = m_Pos;
+			m_Pos += 2;
+			if(!ReadHex(low))
+				return false;
+			if(low >= 0xDC00 && low < 0xE000)
+				code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+			else
+				m_Pos = pos; // read on its own
+		}
+		if(code >= 0xD800 && code < 0xE000)
+			code = 0xFFFD;
+		if(code < 0x80)
+			_value += (char)code;
+		else if(code < 0x800)
+		{
+			_value += (char)(0xC0 | code >> 6);
+			_value += (char)(0x80 | (code & 0x3F));
+		}
+		else if(code < 0x10000)
+		{
+			_value += (char)(0xE0 | code >> 12);
+			_value += (char)(0x80 | (code >> 6 & 0x3F));
+			_value += (char)(0x80 | (code & 0x3F));
+		}
+		else
+		{
+			_value += (char)(0xF0 | code >> 18);
+			_value += (char)(0x80 | (code >> 12 & 0x3F));
+			_value += (char)(0x80 | (code >> 6 & 0x3F));
+			_value += (char)(0x80 | (code & 0x3F));
+		}
+		return true;
+	}
+
+	const char* m_Pos;
+	const char* m_End;
+	bool m_Error;
+	bool m_First;   // no member of the current object or array read yet
+};
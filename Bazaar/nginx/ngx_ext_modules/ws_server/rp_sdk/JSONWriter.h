@@ -0,0 +1,310 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+#define JSON_FLOAT_DIGITS	7	// significant digits of float values
+#define JSON_DOUBLE_DIGITS	15	// significant digits of double values
+
+static const double JSONPow10[] = {
+	1e-4, 1e-3, 1e-2, 1e-1,
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+	1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+};
+#define JSON_POW10(e)	JSONPow10[(e) + 4]
+
+// Writes the decimal digits of _value backwards from _end, returns the start
+inline char* JSONFormatDigits(char* _end, uint64_t _value, int _min_digits = 1)
+{
+	char* p = _end;
+	while(_value || _min_digits > 0)
+	{
+		*--p = '0' + _value % 10;
+		_value /= 10;
+		_min_digits--;
+	}
+	return p;
+}
+
+inline size_t JSONFormatInt(char* _buf, long long _value)
+{
+	char tmp[24];
+	char* end = tmp + sizeof(tmp);
+	uint64_t abs = _value < 0 ? 0 - (uint64_t)_value : (uint64_t)_value;
+	char* p = JSONFormatDigits(end, abs);
+	if(_value < 0)
+		*--p = '-';
+	memcpy(_buf, p, end - p);
+	return end - p;
+}
+
+// _abs * 10^_decimals (< 2^53) rounded to the nearest integer, ties to even
+// as printf rounds. With 15 digits the product is not exact, its rounding
+// error is computed exactly (fma() where it is fast, Dekker's product
+// otherwise) and decides the rounding.
+inline uint64_t JSONScaleDigits(double _abs, int _decimals)
+{
+	double scale = JSON_POW10(_decimals);
+	double scaled = _abs * scale;
+#ifdef FP_FAST_FMA
+	double error = fma(_abs, scale, -scaled);
+#else
+	const double split = 134217729.0; // 2^27 + 1
+	double a = split * _abs, b = split * scale;
+	double a_hi = a - (a - _abs), a_lo = _abs - a_hi;
+	double b_hi = b - (b - scale), b_lo = scale - b_hi;
+	double error = ((a_hi * b_hi - scaled) + a_hi * b_lo + a_lo * b_hi) + a_lo * b_lo;
+#endif
+	uint64_t digits = (uint64_t)scaled;
+	double rest = (scaled - (double)digits - 0.5) + error;
+	if(rest > 0 || (rest == 0 && (digits & 1)))
+		digits++;
+	return digits;
+}
+
+// Formats _value with _digits significant digits, without exponent and
+// trailing zeros when 1e-4 <= |value| < 10^_digits, with printf %g
+// otherwise. The digits are scaled into one integer instead of being
+// produced one by one with floating point divisions, the result parses
+// back to the same value as printf's. JSON has no NaN or infinity: null.
+inline size_t JSONFormatFloat(char* _buf, double _value, int _digits)
+{
+	if(isnan(_value) || isinf(_value))
+	{
+		memcpy(_buf, "null", 4);
+		return 4;
+	}
+	if(_value == 0)
+	{
+		_buf[0] = '0';
+		return 1;
+	}
+
+	double abs = fabs(_value);
+	if(abs < 1e-4 || abs >= JSON_POW10(_digits))
+		return snprintf(_buf, 32, "%.*g", _digits, _value);
+
+	// exponent of the leading digit, then the decimals which give _digits
+	int exp = -4;
+	while(exp < 14 && abs >= JSON_POW10(exp + 1))
+		exp++;
+	int decimals = _digits - 1 - exp;
+	if(decimals < 0)
+		decimals = 0;
+	uint64_t digits = JSONScaleDigits(abs, decimals);
+
+	// 9.9999999 rounds up to one more digit
+	if(digits >= (uint64_t)JSON_POW10(_digits) && decimals > 0)
+	{
+		decimals--;
+		digits = JSONScaleDigits(abs, decimals);
+	}
+
+	uint64_t scale = (uint64_t)JSON_POW10(decimals);
+	uint64_t integer = digits / scale;
+	uint64_t fraction = digits % scale;
+
+	char tmp[48];
+	char* end = tmp + sizeof(tmp);
+	char* p = end;
+	if(fraction)
+	{
+		while(fraction % 10 == 0)
+		{
+			fraction /= 10;
+			decimals--;
+		}
+		p = JSONFormatDigits(p, fraction, decimals);
+		*--p = '.';
+	}
+	p = JSONFormatDigits(p, integer);
+	if(_value < 0)
+		*--p = '-';
+	memcpy(_buf, p, end - p);
+	return end - p;
+}
+
+// Streaming JSON writer: appends straight to a string which is reused
+// between messages, instead of building a JSONNode tree with an allocation
+// per node and writing it afterwards. Separators are inserted as needed:
+//
+//   w.BeginObject(); w.Key("size"); w.Value(3); w.Key("value"); w.Array(v, 3); w.EndObject();
+class JSONWriter
+{
+public:
+	JSONWriter(std::string& _out) : m_Out(_out), m_First(true), m_AfterKey(false) {}
+
+	void BeginObject()
+	{
+		Separator();
+		m_Out += '{';
+		m_First = true;
+	}
+
+	void BeginObject(const std::string& _key)
+	{
+		Key(_key);
+		BeginObject();
+	}
+
+	void EndObject()
+	{
+		m_Out += '}';
+		m_First = false;
+	}
+
+	void BeginArray()
+	{
+		Separator();
+		m_Out += '[';
+		m_First = true;
+	}
+
+	void BeginArray(const std::string& _key)
+	{
+		Key(_key);
+		BeginArray();
+	}
+
+	void EndArray()
+	{
+		m_Out += ']';
+		m_First = false;
+	}
+
+	void Key(const std::string& _key)
+	{
+		Separator();
+		String(_key.data(), _key.size());
+		m_Out += ':';
+		m_AfterKey = true;
+	}
+
+	void Value(bool _value)
+	{
+		Separator();
+		if(_value)
+			m_Out.append("true", 4);
+		else
+			m_Out.append("false", 5);
+	}
+
+	void Value(char _value) { Integer(_value); }
+	void Value(signed char _value) { Integer(_value); }
+	void Value(unsigned char _value) { Integer(_value); }
+	void Value(short _value) { Integer(_value); }
+	void Value(unsigned short _value) { Integer(_value); }
+	void Value(int _value) { Integer(_value); }
+	void Value(unsigned int _value) { Integer(_value); }
+	void Value(long _value) { Integer(_value); }
+	void Value(unsigned long _value) { Integer(_value); }
+	void Value(long long _value) { Integer(_value); }
+
+	void Value(float _value)
+	{
+		char buf[32];
+		Separator();
+		m_Out.append(buf, JSONFormatFloat(buf, _value, JSON_FLOAT_DIGITS));
+	}
+
+	void Value(double _value)
+	{
+		char buf[32];
+		Separator();
+		m_Out.append(buf, JSONFormatFloat(buf, _value, JSON_DOUBLE_DIGITS));
+	}
+
+	void Value(const std::string& _value)
+	{
+		Separator();
+		String(_value.data(), _value.size());
+	}
+
+	void Value(const char* _value)
+	{
+		Separator();
+		String(_value, strlen(_value));
+	}
+
+	template <typename Type> void Member(const std::string& _key, const Type& _value)
+	{
+		Key(_key);
+		Value(_value);
+	}
+
+	// Array of numbers, the output is reserved for the whole array at once
+	template <typename Type> void Array(const Type* _values, size_t _size)
+	{
+		BeginArray();
+		m_Out.reserve(m_Out.size() + _size * 12 + 1);
+		for(size_t i = 0; i < _size; i++)
+			Value(_values[i]);
+		EndArray();
+	}
+
+	// Already written JSON
+	void Raw(const std::string& _json)
+	{
+		Separator();
+		m_Out += _json;
+	}
+
+	void Raw(const std::string& _key, const std::string& _json)
+	{
+		Key(_key);
+		Raw(_json);
+	}
+
+private:
+	void Separator()
+	{
+		if(m_AfterKey)
+			m_AfterKey = false;
+		else if(!m_First)
+			m_Out += ',';
+		m_First = false;
+	}
+
+	void Integer(long long _value)
+	{
+		char buf[24];
+		Separator();
+		m_Out.append(buf, JSONFormatInt(buf, _value));
+	}
+
+	void String(const char* _value, size_t _size)
+	{
+		static const char hex[] = "0123456789abcdef";
+		m_Out += '"';
+		size_t start = 0;
+		for(size_t i = 0; i < _size; i++)
+		{
+			unsigned char c = _value[i];
+			if(c >= 0x20 && c != '"' && c != '\\')
+				continue;
+			m_Out.append(_value + start, i - start);
+			start = i + 1;
+			switch(c)
+			{
+			case '"':  m_Out.append("\\\"", 2); break;
+			case '\\': m_Out.append("\\\\", 2); break;
+			case '\n': m_Out.append("\\n", 2); break;
+			case '\r': m_Out.append("\\r", 2); break;
+			case '\t': m_Out.append("\\t", 2); break;
+			default:
+				m_Out.append("\\u00", 4);
+				m_Out += hex[c >> 4];
+				m_Out += hex[c & 15];
+			}
+		}
+		m_Out.append(_value + start, _size - start);
+		m_Out += '"';
+	}
+
+	std::string& m_Out;
+	bool m_First;       // nothing written in the current object or array yet
+	bool m_AfterKey;    // the value of a key comes next, no separator
+};
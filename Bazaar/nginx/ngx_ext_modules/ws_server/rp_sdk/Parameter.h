@@ -24,6 +24,7 @@ public:
 
 	virtual JSONNode GetJSONObject() = 0; //get JSON-formatted string with parameters or signals
 	void SetValueFromJSON(JSONNode _node);// set the m_TmpValue->value from JSON object
+	bool ReadValueFromJSON(JSONReader& _reader);// the same from an incoming message, without libjson
 
 	AccessMode GetAccessMode() const;
 
@@ -32,6 +33,8 @@ public:
 	void ClearNewValue();
 
 protected:
+	void NotifyChanged(); //add to the change journal of the data manager
+
 	TParam<T, ValueT> m_Value; //parameter or signal struct data
 	std::shared_ptr<TParam<T, ValueT>> m_TmpValue; //temp storage of parameter or signal data received from server
 
@@ -108,6 +111,14 @@ inline void CParameter<T, ValueT>::Update()
 	}
 }
 
+template <typename T, typename ValueT>
+inline void CParameter<T, ValueT>::NotifyChanged()
+{
+	CDataManager * man = CDataManager::GetInstance();
+	if(man && this->m_Id >= 0)
+		man->MarkChanged(this->m_Id);
+}
+
 template <typename T, typename ValueT>
 inline void CParameter<T, ValueT>::SetValueFromJSON(JSONNode _node)
 {
@@ -116,6 +127,31 @@ inline void CParameter<T, ValueT>::SetValueFromJSON(JSONNode _node)
 	m_TmpValue.get()->value = value;
 }
 
+template <typename T, typename ValueT>
+inline bool CParameter<T, ValueT>::ReadValueFromJSON(JSONReader& _reader)
+{
+	std::string key;
+	bool found = false;
+
+	if(!_reader.BeginObject())
+		return false;
+	while(_reader.NextKey(key))
+	{
+		if(key != "value")
+		{
+			_reader.SkipValue();
+			continue;
+		}
+		ValueT value;
+		if(!ReadJSONValue(_reader, value))
+			continue; // of another type and skipped, or malformed
+		m_TmpValue.reset(new TParam<T, ValueT>);
+		m_TmpValue.get()->value = value;
+		found = true;
+	}
+	return found && !_reader.Error();
+}
+
 template <typename T, typename ValueT>
 inline CBaseParameter::AccessMode CParameter<T, ValueT>::GetAccessMode() const
 {
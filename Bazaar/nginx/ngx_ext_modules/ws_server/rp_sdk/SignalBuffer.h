@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <type_traits>
+
+#define SIGNAL_BUFFER_ALIGN	64	// cache line, and enough for any SIMD load
+
+// View of signal samples, indexing is not bounds checked
+template <typename Type> class SignalSpan
+{
+public:
+	SignalSpan(Type* _data, size_t _size) : m_Data(_data), m_Size(_size) {}
+
+	Type& operator [](size_t _index) const { return m_Data[_index]; }
+	Type* Data() const { return m_Data; }
+	size_t Size() const { return m_Size; }
+	Type* begin() const { return m_Data; }
+	Type* end() const { return m_Data + m_Size; }
+
+private:
+	Type* m_Data;
+	size_t m_Size;
+};
+
+// Sample buffer allocated once with SIGNAL_BUFFER_ALIGN alignment. It can be
+// moved and swapped but not copied, the size can change up to the capacity
+// without reallocating. A failed allocation throws std::bad_alloc, like the
+// std::vector of CCustomSignal.
+template <typename Type> class CSignalBuffer
+{
+	static_assert(std::is_arithmetic<Type>::value, "signal samples must be arithmetic");
+
+public:
+	CSignalBuffer() : m_Data(NULL), m_Size(0), m_Capacity(0) {}
+
+	CSignalBuffer(size_t _capacity, Type _value)
+		: m_Data(NULL), m_Size(0), m_Capacity(0)
+	{
+		void* data = NULL;
+		if(_capacity == 0)
+			return;
+		if(_capacity > (size_t)-1 / sizeof(Type) ||
+		   posix_memalign(&data, SIGNAL_BUFFER_ALIGN, _capacity * sizeof(Type)) != 0)
+			throw std::bad_alloc();
+		m_Data = (Type*)data;
+		m_Size = m_Capacity = _capacity;
+		for(size_t i = 0; i < m_Size; i++)
+			m_Data[i] = _value;
+	}
+
+	CSignalBuffer(CSignalBuffer&& _other)
+		: m_Data(_other.m_Data), m_Size(_other.m_Size), m_Capacity(_other.m_Capacity)
+	{
+		_other.m_Data = NULL;
+		_other.m_Size = _other.m_Capacity = 0;
+	}
+
+	CSignalBuffer& operator =(CSignalBuffer&& _other)
+	{
+		Swap(_other);
+		return *this;
+	}
+
+	~CSignalBuffer()
+	{
+		free(m_Data);
+	}
+
+	void Swap(CSignalBuffer& _other)
+	{
+		Type* data = m_Data;
+		size_t size = m_Size;
+		size_t capacity = m_Capacity;
+		m_Data = _other.m_Data;
+		m_Size = _other.m_Size;
+		m_Capacity = _other.m_Capacity;
+		_other.m_Data = data;
+		_other.m_Size = size;
+		_other.m_Capacity = capacity;
+	}
+
+	// false if _size is over the capacity
+	bool Resize(size_t _size)
+	{
+		if(_size > m_Capacity)
+			return false;
+		m_Size = _size;
+		return true;
+	}
+
+	// Copies at most the capacity, returns the number of samples copied
+	size_t Assign(const Type* _value, size_t _size)
+	{
+		m_Size = _size < m_Capacity ? _size : m_Capacity;
+		if(m_Size)
+			memcpy(m_Data, _value, m_Size * sizeof(Type));
+		return m_Size;
+	}
+
+	Type* Data() { return m_Data; }
+	const Type* Data() const { return m_Data; }
+	size_t Size() const { return m_Size; }
+	size_t Capacity() const { return m_Capacity; }
+
+	SignalSpan<Type> Span() { return SignalSpan<Type>(m_Data, m_Size); }
+	SignalSpan<const Type> Span() const { return SignalSpan<const Type>(m_Data, m_Size); }
+
+private:
+	CSignalBuffer(const CSignalBuffer&);
+	CSignalBuffer& operator =(const CSignalBuffer&);
+
+	Type* m_Data;
+	size_t m_Size;
+	size_t m_Capacity;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Peak preserving decimation for clients which display fewer points than a
+// signal has: every bucket of samples is reduced to its minimum and maximum,
+// in the order they occur, so spikes and the envelope stay visible where
+// plain subsampling would lose them. _points is rounded down to even.
+template <typename Type>
+inline void DecimatePeaks(const Type* _in, size_t _size, size_t _points, std::vector<Type>& _out)
+{
+	if(_points < 2 || _size <= _points)
+	{
+		_out.assign(_in, _in + _size);
+		return;
+	}
+
+	size_t buckets = _points / 2;
+	_out.resize(buckets * 2);
+	for(size_t b = 0; b < buckets; b++)
+	{
+		size_t begin = b * _size / buckets;
+		size_t end = (b + 1) * _size / buckets;
+		size_t imin = begin, imax = begin;
+		for(size_t i = begin + 1; i < end; i++)
+		{
+			if(_in[i] < _in[imin])
+				imin = i;
+			if(_in[i] > _in[imax])
+				imax = i;
+		}
+		_out[2 * b] = _in[imin < imax ? imin : imax];
+		_out[2 * b + 1] = _in[imin < imax ? imax : imin];
+	}
+}
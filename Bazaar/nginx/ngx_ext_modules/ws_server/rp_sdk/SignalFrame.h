@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// Binary signal frame, sent instead of the JSON "signals" object to clients
+// which asked for it with {"protocol":{"signals":"binary"}}.
+// All fields are little-endian, payloads are 8 byte aligned so the client can
+// view them as typed arrays without copying:
+//
+//   frame:   char magic[4] = "RPSG", uint16 version, uint16 count, signal[count]
+//   signal:  uint8 name_len, uint8 type, uint16 reserved, uint32 size,
+//            uint32 version, name, padding, payload[size], padding
+
+#define SIGNAL_FRAME_MAGIC		"RPSG"
+#define SIGNAL_FRAME_VERSION	1
+#define SIGNAL_FRAME_ALIGN		8
+
+enum SignalFrameType
+{
+	SIGNAL_TYPE_UINT8 = 0,
+	SIGNAL_TYPE_INT32,
+	SIGNAL_TYPE_FLOAT32,
+	SIGNAL_TYPE_FLOAT64
+};
+
+// Signals of other sample types are sent in JSON only
+template <typename T> struct SignalFrameTypeOf { static const int value = -1; };
+template <> struct SignalFrameTypeOf<uint8_t> { static const int value = SIGNAL_TYPE_UINT8; };
+template <> struct SignalFrameTypeOf<int>     { static const int value = SIGNAL_TYPE_INT32; };
+template <> struct SignalFrameTypeOf<float>   { static const int value = SIGNAL_TYPE_FLOAT32; };
+template <> struct SignalFrameTypeOf<double>  { static const int value = SIGNAL_TYPE_FLOAT64; };
+
+inline void SignalFramePad(std::string& _out)
+{
+	_out.append((SIGNAL_FRAME_ALIGN - _out.size() % SIGNAL_FRAME_ALIGN) % SIGNAL_FRAME_ALIGN, '\0');
+}
+
+// Starts a frame, the signal count is patched by SignalFrameEnd()
+inline void SignalFrameBegin(std::string& _out)
+{
+	const uint16_t version = SIGNAL_FRAME_VERSION;
+	const uint16_t count = 0;
+
+	_out.clear();
+	_out.append(SIGNAL_FRAME_MAGIC, 4);
+	_out.append((const char*)&version, sizeof(version));
+	_out.append((const char*)&count, sizeof(count));
+}
+
+inline void SignalFrameEnd(std::string& _out, uint16_t _count)
+{
+	_out.replace(6, sizeof(_count), (const char*)&_count, sizeof(_count));
+}
+
+// Appends one signal, the host is little-endian (ARM, x86) so the samples
+// are copied as they are
+inline void SignalFrameAppend(std::string& _out, const std::string& _name, uint8_t _type,
+							  const void* _data, uint32_t _size, uint32_t _elem_size, uint32_t _version)
+{
+	const uint8_t name_len = _name.size() < 255 ? _name.size() : 255;
+	const uint16_t reserved = 0;
+
+	_out.append((const char*)&name_len, sizeof(name_len));
+	_out.append((const char*)&_type, sizeof(_type));
+	_out.append((const char*)&reserved, sizeof(reserved));
+	_out.append((const char*)&_size, sizeof(_size));
+	_out.append((const char*)&_version, sizeof(_version));
+	_out.append(_name.data(), name_len);
+	SignalFramePad(_out);
+	_out.append((const char*)_data, (size_t)_size * _elem_size);
+	SignalFramePad(_out);
+}
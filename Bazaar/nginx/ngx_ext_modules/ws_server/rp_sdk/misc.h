@@ -1,8 +1,12 @@
 #pragma once
 
 #include <vector>
+#include <string>
+#include <type_traits>
 #include <stdio.h>
 
+#include "JSONReader.h"
+
 extern int dbg_printf(const char * format, ...);
 
 template <typename BaseT, typename ValueT>
@@ -107,3 +111,59 @@ inline std::vector<double> GetValueFromJSON<std::vector<double> >(JSONNode _node
 
 	return res;
 }
+
+//To read a value straight from an incoming message
+template <typename T>
+inline bool ReadJSONValue(JSONReader& _reader, T& _value, std::true_type) //numbers
+{
+	double value;
+	if(!_reader.ReadNumber(value))
+		return false;
+	_value = (T)value;
+	return true;
+}
+
+template <typename T>
+inline bool ReadJSONValue(JSONReader& _reader, T& _value, std::false_type) //other types through libjson
+{
+	const char* begin;
+	const char* end;
+	if(!_reader.SkipValue(&begin, &end))
+		return false;
+	JSONNode n = libjson::parse("{\"value\":" + std::string(begin, end) + "}");
+	_value = GetValueFromJSON<T>(n, "value");
+	return true;
+}
+
+template <typename T>
+inline bool ReadJSONValue(JSONReader& _reader, T& _value)
+{
+	return ReadJSONValue(_reader, _value, typename std::is_arithmetic<T>::type());
+}
+
+inline bool ReadJSONValue(JSONReader& _reader, bool& _value)
+{
+	return _reader.ReadBool(_value);
+}
+
+inline bool ReadJSONValue(JSONReader& _reader, std::string& _value)
+{
+	return _reader.ReadString(_value);
+}
+
+template <typename T>
+inline bool ReadJSONValue(JSONReader& _reader, std::vector<T>& _value)
+{
+	if(!_reader.BeginArray())
+		return false;
+	_value.clear();
+	while(_reader.NextElement())
+	{
+		T value;
+		if(ReadJSONValue(_reader, value))
+			_value.push_back(value);
+		else if(_reader.Error())
+			return false;
+	}
+	return !_reader.Error();
+}
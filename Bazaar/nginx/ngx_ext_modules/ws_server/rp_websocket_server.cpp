@@ -5,14 +5,19 @@
 #include "libjson/libjson.h"
 #include "libjson/_internal/Source/JSONGlobals.h"
 #include "libjson/JSONOptions.h"
+#include "rp_sdk/JSONReader.h"
 
 #include <fstream>
 #include <iostream>
 #include <streambuf>
+#include <sstream>
 #include <string>
+#include <cstring>
 #include <future>
 
 #include <math.h>
+#include <time.h>
+#include <unistd.h>
 
 using websocketpp::lib::thread;
 using websocketpp::lib::placeholders::_1;
@@ -21,13 +26,27 @@ using websocketpp::lib::bind;
 
 rp_websocket_server::rp_websocket_server()
     : m_params(NULL)
+    , m_running(false)
+    , m_overflowed(false)
+    , m_drain_posted(false)
+    , m_batch_held(false)
+    , m_throttled(false)
     , m_OnClosed(false)
 {
+    sem_init(&m_wake, 0, 0);
 }
 
 rp_websocket_server::rp_websocket_server(struct server_parameters* params)
     : m_params(params)
+    , m_running(false)
+    , m_overflowed(false)
+    , m_drain_posted(false)
+    , m_batch_held(false)
+    , m_signal_rate(params->signal_budget ? params->signal_budget : WS_LOAD_BUDGET)
+    , m_throttled(false)
 {
+    sem_init(&m_wake, 0, 0);
+
     // set up access channels to only log interesting things
     m_endpoint.clear_access_channels(websocketpp::log::alevel::all);
     m_endpoint.set_access_channels(websocketpp::log::alevel::access_core);
@@ -48,12 +67,14 @@ rp_websocket_server::rp_websocket_server(struct server_parameters* params)
     m_endpoint.get_alog().write(websocketpp::log::alevel::app, "ws_server constructor");
 
     std::stringstream ss;
-    ss << "default params: signal_interval = "<< params->signal_interval <<", param_interval =" << params->param_interval;
+    ss << "default params: signal_interval = "<< params->signal_interval <<", param_interval =" << params->param_interval
+       << ", signal_budget = " << params->signal_budget << "%";
     m_endpoint.get_alog().write(websocketpp::log::alevel::app,ss.str());
 }
 
 rp_websocket_server::~rp_websocket_server()
 {
+    sem_destroy(&m_wake);
     if(m_params)
     {
 	free(m_params);
@@ -83,101 +104,536 @@ void rp_websocket_server::run(std::string docroot, uint16_t port) {
 	}
 }
 
-void rp_websocket_server::set_signal_timer() {
+int rp_websocket_server::signal_interval() const {
+	return m_params->get_signals_interval_func != 0 ? m_params->get_signals_interval_func() : m_params->signal_interval;
+}
 
-	if(m_signal_timer!=NULL)
-		m_signal_timer->cancel();
-	int interval = m_params->get_signals_interval_func != 0 ? m_params->get_signals_interval_func() : m_params->signal_interval;
-	// fprintf(stderr, "set_signal_timer interval %d\n", interval);
-	m_signal_timer = m_endpoint.set_timer(
-		interval,
-		websocketpp::lib::bind(
-			&rp_websocket_server::on_signal_timer,
-			this,
-			websocketpp::lib::placeholders::_1
-		)
-	);
+int rp_websocket_server::param_interval() const {
+	return m_params->get_params_interval_func != 0 ?  m_params->get_params_interval_func() : m_params->param_interval;
 }
 
-void rp_websocket_server::set_param_timer() {
+// Worker thread: runs the commands from the server thread as soon as they
+// arrive, produces the parameters and signals on their ticks and hands the
+// frames over to the server thread
+void rp_websocket_server::work()
+{
+	double next_signal = ws_interval_controller::now_ms();
+	double next_param = next_signal;
+
+	while (m_running) {
+		double now = ws_interval_controller::now_ms();
+		double next = next_signal < next_param ? next_signal : next_param;
+		if (next > now)
+			wait(next - now);
+		if (!m_running)
+			break;
+
+		run_commands(next_signal, next_param);
+
+		now = ws_interval_controller::now_ms();
+		if (now >= next_param) {
+			produce_params();
+			double end = ws_interval_controller::now_ms();
+			m_signal_rate.add_busy(end - now);
+			next_param = end + param_interval();
+		}
+
+		now = ws_interval_controller::now_ms();
+		if (now >= next_signal) {
+			if (subscriptions())
+				produce_subscribed_signals();
+			else
+				produce_signals();
+			m_batch.signal_tick = true;
+
+			// the interval is stretched while the ticks would take more
+			// than the budget of the thread
+			int requested = signal_interval();
+			double end = ws_interval_controller::now_ms();
+			int delay = m_signal_rate.tick(requested, now, end);
+			bool throttled = m_signal_rate.interval() > requested;
+			if (throttled != m_throttled) {
+				m_throttled = throttled;
+				std::stringstream ss;
+				ss << "signal interval " << m_signal_rate.interval() << " ms (requested " << requested
+				   << " ms, tick " << m_signal_rate.cost() << " ms, " << m_signal_rate.fps() << " fps, "
+				   << m_signal_rate.skipped() << " ticks skipped)";
+				m_endpoint.get_alog().write(websocketpp::log::alevel::app, ss.str());
+			}
+			next_signal = end + delay;
+		}
 
-	if(m_param_timer!=NULL)
-		m_param_timer->cancel();
-	int interval = m_params->get_params_interval_func != 0 ?  m_params->get_params_interval_func() : m_params->param_interval;
-	// fprintf(stderr, "set_param_timer interval %d\n", interval);
-	m_param_timer = m_endpoint.set_timer(
-		interval,
-		websocketpp::lib::bind(
-			&rp_websocket_server::on_param_timer,
-			this,
-			websocketpp::lib::placeholders::_1
-		)
-	);
+		publish();
+	}
 }
 
-void rp_websocket_server::on_signal_timer(websocketpp::lib::error_code const & ec) {
+// Sleeps until the time is up or a command is posted
+void rp_websocket_server::wait(double ms)
+{
+	struct timespec ts;
+	long sec = (long)(ms / 1000);
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += sec;
+	ts.tv_nsec += (long)((ms - sec * 1000) * 1e6);
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	sem_timedwait(&m_wake, &ts);
+}
 
-	if (ec) {
-		m_endpoint.get_alog().write(websocketpp::log::alevel::app,
-				"Timer Error: "+ec.message());
-		return;
+// Commands in the order they were posted. While m_overflow holds commands
+// the server thread does not push to m_commands, so whatever is left in
+// m_commands is older than the overflow.
+bool rp_websocket_server::pop_command(command& cmd)
+{
+	if (m_commands.pop(cmd))
+		return true;
+	if (!m_overflowed.load(std::memory_order_acquire))
+		return false;
+
+	scoped_lock guard(m_overflow_lock);
+	if (m_commands.pop(cmd))
+		return true;
+	if (m_overflow.empty())
+		return false;
+	cmd = std::move(m_overflow.front());
+	m_overflow.pop_front();
+	m_overflowed = !m_overflow.empty();
+	return true;
+}
+
+// A message from the client restarts the timer of its kind, as the timers
+// did when they ran on the server thread
+void rp_websocket_server::run_commands(double& next_signal, double& next_param)
+{
+	double start = ws_interval_controller::now_ms();
+	command cmd;
+	bool any = false;
+
+	while (pop_command(cmd)) {
+		any = true;
+		switch (cmd.type) {
+		case command::OPEN: {
+			client_state& client = m_clients[cmd.hdl];
+			client.deflate = cmd.deflate;
+			subscribe(client);
+			break;
+		}
+		case command::CLOSE: {
+			client_list::iterator it = m_clients.find(cmd.hdl);
+			if (it != m_clients.end()) {
+				if (it->second.subscription >= 0)
+					m_params->unsubscribe_signals_func(it->second.subscription);
+				m_clients.erase(it);
+			}
+			break;
+		}
+		case command::PARAMS:
+			m_params->set_params_func(cmd.data.c_str());
+			next_param = ws_interval_controller::now_ms() + param_interval();
+			break;
+		case command::SIGNALS:
+			m_params->set_signals_func(cmd.data.c_str());
+			next_signal = ws_interval_controller::now_ms() + m_signal_rate.delay(signal_interval());
+			break;
+		case command::PROTOCOL: {
+			client_list::iterator it = m_clients.find(cmd.hdl);
+			if (it != m_clients.end()) {
+				JSONNode protocol = libjson::parse(cmd.data);
+				on_protocol(it->second, protocol);
+			}
+			break;
+		}
+		}
 	}
+	if (any)
+		m_signal_rate.add_busy(ws_interval_controller::now_ms() - start);
+}
 
-	con_list::iterator it;
-	const char* signals = m_params->get_signals_func();
+// Signals of applications without subscriptions: all signals to every client
+void rp_websocket_server::produce_signals()
+{
+	client_list::iterator it;
+	size_t json_clients = 0, binary_clients = 0;
+	for (it = m_clients.begin(); it != m_clients.end(); ++it) {
+		if (it->second.binary_signals)
+			binary_clients++;
+		else
+			json_clients++;
+	}
+
+	// Signals are produced once per tick in the formats the clients asked for
+	const char* signals = NULL;
+	const char* binary = NULL;
+	size_t binary_size = 0;
+	if (m_params->get_signals_frames_func != 0 && binary_clients > 0) {
+		m_params->get_signals_frames_func(json_clients > 0 ? &signals : NULL, &binary, &binary_size);
+	} else {
+		signals = m_params->get_signals_func();
+	}
 
 //	m_endpoint.get_alog().write(websocketpp::log::alevel::app, "on_signal_timer");
 	static int once = 1;
-	if(once)
+	if(once && signals)
 	{
 		once = 0;
 		m_endpoint.get_alog().write(websocketpp::log::alevel::app, signals);
 	}
 
-	std::string js(signals);
-	static char buf[1000000];
-	size_t size;
-	m_params->gzip_func(js.c_str(), buf, &size);
+	if (signals)
+		send_json(signals, &client_state::binary_signals, true);
 
-	if (size) {
-		for (it = m_connections.begin(); it != m_connections.end(); ++it) {
-			m_endpoint.send(*it, buf, size, websocketpp::frame::opcode::binary);
+	if (binary && binary_size) {
+		shared_frame frame(binary, binary_size, websocketpp::frame::opcode::binary,
+						   m_binary_policy.should_compress(binary, binary_size));
+		for (it = m_clients.begin(); it != m_clients.end(); ++it) {
+			if (it->second.binary_signals)
+				emit(it->first, frame.get(it->second.deflate), true);
 		}
 	}
-	// set timer for next check
-	set_signal_timer();
 }
 
-void rp_websocket_server::on_param_timer(websocketpp::lib::error_code const & ec) {
+void rp_websocket_server::produce_params()
+{
+	client_list::iterator it;
+	size_t json_clients = 0, delta_clients = 0;
+	for (it = m_clients.begin(); it != m_clients.end(); ++it) {
+		if (it->second.delta_params)
+			delta_clients++;
+		else
+			json_clients++;
+	}
 
-	if (ec) {
-		m_endpoint.get_alog().write(websocketpp::log::alevel::app,
-				"Timer Error: "+ec.message());
-		return;
+	// Parameters are produced once per tick in the formats the clients asked
+	// for. Applications with ws_get_params_frames() report how many changed,
+	// nothing is sent when none did.
+	const char* params = NULL;
+	const char* delta = NULL;
+	int count = -1, ids_version = 0;
+	if (m_params->get_params_frames_func != 0) {
+		count = m_params->get_params_frames_func(json_clients > 0 ? &params : NULL,
+			delta_clients > 0 ? &delta : NULL, &ids_version);
+		if (count == 0)
+			params = NULL;
+	} else {
+		params = m_params->get_params_func();
 	}
 
-	con_list::iterator it;
-	const char* params = m_params->get_params_func();
 //	m_endpoint.get_alog().write(websocketpp::log::alevel::app, "on_param_timer");
 	static int once = 1;
-	if(once)
+	if(once && params)
 	{
 		once = 0;
 		m_endpoint.get_alog().write(websocketpp::log::alevel::app, params);
 	}
 
-	std::string js(params);
-	static char buf[1000000];
-	size_t size;
-	m_params->gzip_func(js.c_str(), buf, &size);
+	if (params)
+		send_json(params, &client_state::delta_params, false);
+
+	if (delta) {
+		// The dictionary is built after the delta, so it holds current values
+		// and a client receiving it instead of the delta does not miss a change
+		std::string ids;
+		shared_frame ids_frame(NULL, 0, websocketpp::frame::opcode::text, true);
+		shared_frame delta_frame(delta, strlen(delta), websocketpp::frame::opcode::text,
+								 strlen(delta) >= WS_DEFLATE_MIN_SIZE);
+		for (it = m_clients.begin(); it != m_clients.end(); ++it) {
+			if (!it->second.delta_params)
+				continue;
+			if (it->second.ids_version != ids_version) {
+				if (ids.empty()) {
+					ids = m_params->get_params_ids_func();
+					ids_frame = shared_frame(ids.data(), ids.size(), websocketpp::frame::opcode::text,
+											 ids.size() >= WS_DEFLATE_MIN_SIZE);
+				}
+				emit(it->first, ids_frame.get(it->second.deflate), false);
+				it->second.ids_version = ids_version;
+			} else if (count > 0) {
+				emit(it->first, delta_frame.get(it->second.deflate), false);
+			}
+		}
+	}
+}
+
+// Signals of every connection's subscription: one application tick for all
+// subscriptions, then each frame is shared by the connections subscribed to it
+void rp_websocket_server::produce_subscribed_signals()
+{
+	m_params->update_signal_subscriptions_func();
+
+	std::map<int, shared_frame> binary_frames;
+	std::map<int, json_frame> json_frames;
+	for (client_list::iterator it = m_clients.begin(); it != m_clients.end(); ++it) {
+		const char* data;
+		size_t size;
+		int id = it->second.subscription;
+		if (id < 0 || !m_params->get_subscription_frame_func(id, &data, &size))
+			continue;
+
+		if (it->second.binary_signals) {
+			std::map<int, shared_frame>::iterator frame = binary_frames.find(id);
+			if (frame == binary_frames.end())
+				frame = binary_frames.insert(std::make_pair(id, shared_frame(data, size,
+					websocketpp::frame::opcode::binary, m_binary_policy.should_compress(data, size)))).first;
+			emit(it->first, frame->second.get(it->second.deflate), true);
+		} else {
+			std::map<int, json_frame>::iterator frame = json_frames.find(id);
+			if (frame == json_frames.end())
+				frame = json_frames.insert(std::make_pair(id, json_frame(data, size))).first;
+			server::message_ptr msg = json_message(frame->second, it->second.plain_json);
+			if (msg)
+				emit(it->first, msg, true);
+		}
+	}
+}
+
+rp_websocket_server::json_frame::json_frame(const char* json, size_t size)
+	: json(json)
+	, size(size)
+	, text(json, size, websocketpp::frame::opcode::text, size >= WS_DEFLATE_MIN_SIZE)
+	, gzipped(NULL, 0, websocketpp::frame::opcode::binary, false)
+	, gzip_done(false)
+{
+}
+
+// Text frame compressed by permessage-deflate for clients which asked for
+// it, otherwise the gzipped JSON. The gzip output is copied into the message
+// right away, so the compressor can be reused for the next payload.
+rp_websocket_server::server::message_ptr rp_websocket_server::json_message(json_frame& frame, bool plain_json)
+{
+	if (plain_json)
+		return frame.text.get(true);
+
+	if (!frame.gzip_done) {
+		frame.gzip_done = true;
+		if (m_gzip.gzip(frame.json, frame.size))
+			frame.gzipped = shared_frame(m_gzip.data(), m_gzip.size(), websocketpp::frame::opcode::binary, false);
+		else
+			m_endpoint.get_alog().write(websocketpp::log::alevel::app, "gzip failed");
+	}
+	return frame.gzipped.get(false);
+}
+
+// Sends JSON to the clients which do not use the other format (skip).
+// Signals are queued latest-wins.
+void rp_websocket_server::send_json(const char* json, bool (client_state::*skip), bool signals)
+{
+	json_frame frame(json, strlen(json));
+
+	for (client_list::iterator it = m_clients.begin(); it != m_clients.end(); ++it) {
+		if (it->second.*skip)
+			continue;
+
+		server::message_ptr msg = json_message(frame, it->second.plain_json);
+		if (msg)
+			emit(it->first, msg, signals);
+	}
+}
+
+// A signal frame replaces one for the same connection still in a batch
+// which could not be published yet, parameter frames are all kept
+void rp_websocket_server::emit(connection_hdl hdl, server::message_ptr msg, bool signals)
+{
+	if (signals && m_batch_held) {
+		for (size_t i = 0; i < m_batch.frames.size(); i++) {
+			dispatch& held = m_batch.frames[i];
+			if (held.signals && !held.hdl.owner_before(hdl) && !hdl.owner_before(held.hdl)) {
+				held.msg = msg;
+				return;
+			}
+		}
+	}
+
+	dispatch d;
+	d.hdl = hdl;
+	d.msg = msg;
+	d.signals = signals;
+	m_batch.frames.push_back(d);
+}
 
-	if (size) {
-		for (it = m_connections.begin(); it != m_connections.end(); ++it) {
-			m_endpoint.send(*it, buf, size, websocketpp::frame::opcode::binary);
+// Hands the frames of this pass to the server thread. If the server thread
+// fell WS_FRAME_QUEUE passes behind the batch is kept and the next passes
+// are added to it, newer signal frames replacing older ones (see emit()).
+// on_frames() wakes the worker to publish it once there is room.
+void rp_websocket_server::publish()
+{
+	if (m_batch.frames.empty() && !m_batch.signal_tick)
+		return;
+
+	m_batch.rate.fps = m_signal_rate.fps();
+	m_batch.rate.interval = m_signal_rate.interval();
+	m_batch.rate.skipped = m_signal_rate.skipped();
+	m_batch.rate.load = m_signal_rate.load();
+	if (!m_frames.push(m_batch)) {
+		m_batch_held = true;
+		return;
+	}
+	m_batch.frames.clear();
+	m_batch.signal_tick = false;
+
+	if (!m_drain_posted.exchange(true))
+		m_endpoint.get_io_service().post(bind(&rp_websocket_server::on_frames, this));
+}
+
+// Server thread: commands are never dropped, connection events and
+// parameter changes must reach the application. While the worker is stuck
+// in the application and m_commands is full, they wait in m_overflow.
+void rp_websocket_server::post_command(command& cmd)
+{
+	if (m_overflowed.load(std::memory_order_acquire) || !m_commands.push(cmd)) {
+		scoped_lock guard(m_overflow_lock);
+		if (!m_overflow.empty() || !m_commands.push(cmd)) {
+			if (m_overflow.empty())
+				m_endpoint.get_alog().write(websocketpp::log::alevel::app, "command queue full, worker is behind");
+			m_overflow.push_back(std::move(cmd));
+			m_overflowed = true;
 		}
 	}
-	// set timer for next check
-	set_param_timer();
+	sem_post(&m_wake);
+}
+
+void rp_websocket_server::on_frames()
+{
+	// cleared first, a batch published while draining posts again
+	m_drain_posted = false;
+
+	frame_batch batch;
+	while (m_frames.pop(batch)) {
+		m_rate = batch.rate;
+		for (size_t i = 0; i < batch.frames.size(); i++) {
+			con_list::iterator it = m_connections.find(batch.frames[i].hdl);
+			if (it == m_connections.end())
+				continue;
+			if (batch.frames[i].signals)
+				queue_signals(it, batch.frames[i].msg);
+			else
+				send_param(it, batch.frames[i].msg);
+		}
+
+		// Also sends frames held back on earlier ticks to clients which caught up
+		if (batch.signal_tick) {
+			for (con_list::iterator it = m_connections.begin(); it != m_connections.end(); ++it)
+				flush_signals(it);
+		}
+	}
+
+	if (m_batch_held.exchange(false))
+		sem_post(&m_wake);
+}
+
+rp_websocket_server::shared_frame::shared_frame(const void* data, size_t size,
+		websocketpp::frame::opcode::value op, bool compressible)
+	: data(data)
+	, size(size)
+	, op(op)
+	, compressible(compressible)
+{
+}
+
+// The payload is copied into the message on first use, the caller's buffer
+// may change afterwards
+rp_websocket_server::server::message_ptr rp_websocket_server::shared_frame::get(bool deflate)
+{
+	if (!data)
+		return server::message_ptr();
+	if (deflate && compressible) {
+		if (!compressed)
+			compressed = make_message(data, size, op, true);
+		return compressed;
+	}
+	if (!plain)
+		plain = make_message(data, size, op, false);
+	return plain;
+}
+
+// Already compressed payloads must not go through permessage-deflate again,
+// so the compression is chosen per message. Server frames are not masked, so
+// an uncompressed message is framed here once and websocketpp writes the same
+// header and payload to every socket instead of framing a copy per connection.
+rp_websocket_server::server::message_ptr rp_websocket_server::make_message(const void* data, size_t size,
+		websocketpp::frame::opcode::value op, bool compress)
+{
+	server::message_ptr msg = websocketpp::lib::make_shared<deflate_config::message_type>(
+		deflate_config::con_msg_manager_type::ptr(), op, size);
+	msg->append_payload(data, size);
+	msg->set_compressed(compress);
+	if (!compress) {
+		msg->set_header(websocketpp::frame::prepare_header(
+			websocketpp::frame::basic_header(op, size, true, false),
+			websocketpp::frame::extended_header(size)));
+		msg->set_prepared(true);
+	}
+	return msg;
+}
+
+bool rp_websocket_server::send(con_list::iterator it, server::message_ptr msg)
+{
+	websocketpp::lib::error_code ec;
+	m_endpoint.send(it->first, msg, ec);
+	if (ec) {
+		m_endpoint.get_alog().write(websocketpp::log::alevel::app, "Send error: " + ec.message());
+		return false;
+	}
+	it->second.bytes_sent += msg->get_payload().size();
+	return true;
+}
+
+// Parameters are never dropped: they are small, and a client which missed
+// a change would show a stale value until the parameter changes again
+void rp_websocket_server::send_param(con_list::iterator it, server::message_ptr msg)
+{
+	if (msg && send(it, msg))
+		it->second.params_sent++;
+}
+
+// Latest-wins: a frame which was not sent yet is replaced by the newer one
+void rp_websocket_server::queue_signals(con_list::iterator it, server::message_ptr msg)
+{
+	if (it->second.pending_signals)
+		it->second.signals_dropped++;
+	it->second.pending_signals = msg;
+}
+
+// Sends the held back frame unless the client still has more than
+// WS_MAX_BUFFERED bytes waiting for its socket, which bounds the memory
+// websocketpp uses for a slow client to about one frame over the limit
+void rp_websocket_server::flush_signals(con_list::iterator it)
+{
+	connection_state& state = it->second;
+	if (!state.pending_signals)
+		return;
+
+	websocketpp::lib::error_code ec;
+	server::connection_ptr con = m_endpoint.get_con_from_hdl(it->first, ec);
+	if (ec)
+		return;
+
+	size_t buffered = con->get_buffered_amount();
+	if (buffered > state.max_buffered)
+		state.max_buffered = buffered;
+	if (buffered > WS_MAX_BUFFERED)
+		return;
+
+	if (send(it, state.pending_signals))
+		state.signals_sent++;
+	state.pending_signals.reset();
+}
+
+std::string rp_websocket_server::get_stats(const connection_state& state, size_t buffered)
+{
+	std::stringstream ss;
+	ss << "{\"stats\":{\"signals_sent\":" << state.signals_sent
+	   << ",\"signals_dropped\":" << state.signals_dropped
+	   << ",\"params_sent\":" << state.params_sent
+	   << ",\"bytes_sent\":" << state.bytes_sent
+	   << ",\"buffered\":" << buffered
+	   << ",\"max_buffered\":" << state.max_buffered
+	   << ",\"fps\":" << m_rate.fps
+	   << ",\"interval\":" << m_rate.interval
+	   << ",\"skipped_ticks\":" << m_rate.skipped
+	   << ",\"load\":" << m_rate.load << "}}";
+	return ss.str();
 }
 
 void rp_websocket_server::on_http(connection_hdl hdl) {
@@ -231,12 +687,22 @@ void rp_websocket_server::on_http(connection_hdl hdl) {
 void rp_websocket_server::on_open(connection_hdl hdl)
 {
 	m_endpoint.get_alog().write(websocketpp::log::alevel::app, "ws server on connection");
-	m_connections.insert(hdl);
+	command cmd(command::OPEN, hdl);
+	server::connection_ptr con = m_endpoint.get_con_from_hdl(hdl);
+	cmd.deflate = con->get_response_header("Sec-WebSocket-Extensions").find("permessage-deflate") != std::string::npos;
+	m_connections[hdl] = connection_state();
+	post_command(cmd);
 }
 
 void rp_websocket_server::on_close(connection_hdl hdl) {
 	m_endpoint.get_alog().write(websocketpp::log::alevel::app, "ws server connection closed");
-	m_connections.erase(hdl);
+	con_list::iterator it = m_connections.find(hdl);
+	if (it != m_connections.end()) {
+		m_endpoint.get_alog().write(websocketpp::log::alevel::app, get_stats(it->second, 0));
+		m_connections.erase(it);
+		command cmd(command::CLOSE, hdl);
+		post_command(cmd);
+	}
 
 	if (!m_OnClosed) {
 		exit(-1);
@@ -248,27 +714,159 @@ void rp_websocket_server::on_message(connection_hdl hdl, server::message_ptr msg
 //	std::stringstream ss;
 //	ss << "Detected " << msg->get_payload() << " test cases.";
 //	m_endpoint.get_alog().write(websocketpp::log::alevel::app,ss.str());
-	//get child, it is always only one: "parameters" or "signals"
-	JSONNode n = libjson::parse(msg->get_payload());
-
-	JSONNode child = n.at(0);
-	std::string name = child.name();
+	//get child, it is always only one: "parameters", "signals" or "protocol".
+	//Its text is passed on as it is, without a parse and write round trip
+	const std::string& payload = msg->get_payload();
+	JSONReader reader(payload.data(), payload.size());
+	std::string name;
+	const char* begin;
+	const char* end;
+	if(!reader.BeginObject() || !reader.NextKey(name) || !reader.SkipValue(&begin, &end))
+	{
+		m_endpoint.get_alog().write(websocketpp::log::alevel::app, "malformed message: " + payload);
+		return;
+	}
 
-	std::string data = child.write();
-	const char * data_str = data.c_str();
+	// the application is called by the worker
 	if(name == "parameters")
 	{
-		set_param_timer();
-		m_params->set_params_func(data_str);
+		command cmd(command::PARAMS, hdl);
+		cmd.data.assign(begin, end);
+		post_command(cmd);
 	}
 	else if(name == "signals")
 	{
-		set_signal_timer();
-		m_params->set_signals_func(data_str);
+		command cmd(command::SIGNALS, hdl);
+		cmd.data.assign(begin, end);
+		post_command(cmd);
+	}
+	else if(name == "protocol")
+	{
+		// statistics are kept here, the rest of the protocol by the worker
+		command cmd(command::PROTOCOL, hdl);
+		cmd.data.assign(begin, end);
+		JSONNode child = libjson::parse(cmd.data);
+		JSONNode::iterator stats = child.find("stats");
+		con_list::iterator it = m_connections.find(hdl);
+		if (stats != child.end() && stats->as_bool() && it != m_connections.end()) {
+			websocketpp::lib::error_code ec;
+			server::connection_ptr con = m_endpoint.get_con_from_hdl(hdl, ec);
+			std::string reply = get_stats(it->second, ec ? 0 : con->get_buffered_amount());
+			send(it, make_message(reply.data(), reply.size(), websocketpp::frame::opcode::text, false));
+		}
+		post_command(cmd);
 	}
 
 }
 
+// {"protocol":{"signals":"binary"}} switches the connection to binary signal
+// frames (rp_sdk/SignalFrame.h), "json" switches it back. Binary frames need
+// an application built with ws_get_signals_frames(), otherwise the connection
+// stays on JSON.
+//
+// {"protocol":{"params":"delta"}} switches the connection to parameter deltas:
+// the client first gets {"ids":{"name":{"id":3,"value":...},...}} with every
+// parameter, then only {"delta":{"3":1000}} with the changed values, as text
+// frames. The dictionary is sent again when parameters are (un)registered.
+// Needs an application built with ws_get_params_frames().
+//
+// {"protocol":{"compression":"deflate"}} makes JSON signals and parameters
+// plain text frames, compressed by permessage-deflate with a zlib stream per
+// connection, instead of gzipped binary frames. Only for connections which
+// negotiated permessage-deflate, "gzip" switches back. Binary signal frames
+// and parameter deltas use permessage-deflate whenever it was negotiated.
+//
+// {"protocol":{"subscribe":{"signals":["ch1","ch2"],"points":800,"rate":25}}}
+// limits the signals sent to the connection: only the listed signals (all
+// if missing), reduced to that many points by peak preserving decimation (0
+// or missing - full resolution), at most rate frames per second (0 or
+// missing - every signal tick). Needs an application built with
+// ws_subscribe_signals(), otherwise all signals are sent.
+//
+// {"protocol":{"stats":true}} returns the statistics of the connection as
+// {"stats":{"signals_sent":...,"signals_dropped":...,...}} in a text frame,
+// together with the achieved signal rate of the server ("fps", "interval" in
+// ms, "skipped_ticks" and "load", the busy fraction of the worker thread).
+void rp_websocket_server::on_protocol(client_state& client, JSONNode& protocol)
+{
+	JSONNode::iterator signals = protocol.find("signals");
+	if (signals != protocol.end()) {
+		client.binary_signals = m_params->get_signals_frames_func != 0 &&
+			signals->as_string() == "binary";
+		m_endpoint.get_alog().write(websocketpp::log::alevel::app,
+			client.binary_signals ? "signals protocol: binary" : "signals protocol: json");
+		subscribe(client);
+	}
+
+	JSONNode::iterator subscription = protocol.find("subscribe");
+	if (subscription != protocol.end())
+		on_subscribe(client, *subscription);
+
+	JSONNode::iterator compression = protocol.find("compression");
+	if (compression != protocol.end()) {
+		client.plain_json = client.deflate && compression->as_string() == "deflate";
+		m_endpoint.get_alog().write(websocketpp::log::alevel::app,
+			client.plain_json ? "compression: permessage-deflate" : "compression: gzip");
+	}
+
+	JSONNode::iterator params = protocol.find("params");
+	if (params != protocol.end()) {
+		client.delta_params = m_params->get_params_frames_func != 0 &&
+			m_params->get_params_ids_func != 0 && params->as_string() == "delta";
+		client.ids_version = -1;
+		m_endpoint.get_alog().write(websocketpp::log::alevel::app,
+			client.delta_params ? "params protocol: delta" : "params protocol: json");
+	}
+}
+
+bool rp_websocket_server::subscriptions() const
+{
+	return m_params->subscribe_signals_func != 0 && m_params->unsubscribe_signals_func != 0 &&
+		m_params->update_signal_subscriptions_func != 0 && m_params->get_subscription_frame_func != 0;
+}
+
+// (Re)subscribes with the connection's current settings and format. The new
+// subscription is taken before the old one is released, so a subscription
+// shared with other clients is not destroyed and created again.
+void rp_websocket_server::subscribe(client_state& client)
+{
+	if (!subscriptions())
+		return;
+
+	int old = client.subscription;
+	client.subscription = m_params->subscribe_signals_func(client.signals.c_str(),
+		client.points, client.max_rate, client.binary_signals);
+	if (old >= 0)
+		m_params->unsubscribe_signals_func(old);
+}
+
+void rp_websocket_server::on_subscribe(client_state& client, JSONNode& subscription)
+{
+	client.signals.clear();
+	client.points = 0;
+	client.max_rate = 0;
+
+	JSONNode::iterator signals = subscription.find("signals");
+	if (signals != subscription.end()) {
+		for (JSONNode::iterator name = signals->begin(); name != signals->end(); ++name) {
+			if (!client.signals.empty())
+				client.signals += ",";
+			client.signals += name->as_string();
+		}
+	}
+	JSONNode::iterator points = subscription.find("points");
+	if (points != subscription.end() && points->as_int() > 0)
+		client.points = points->as_int();
+	JSONNode::iterator rate = subscription.find("rate");
+	if (rate != subscription.end() && rate->as_int() > 0)
+		client.max_rate = rate->as_int();
+
+	std::stringstream ss;
+	ss << "subscribe: signals '" << client.signals << "' points " << client.points << " rate " << client.max_rate;
+	m_endpoint.get_alog().write(websocketpp::log::alevel::app, ss.str());
+	subscribe(client);
+}
+
 rp_websocket_server* rp_websocket_server::create(struct server_parameters* params) {
   return new rp_websocket_server(params);
 }
@@ -277,8 +875,8 @@ void rp_websocket_server::start(std::string docroot, uint16_t port)
 {
 	m_endpoint.get_alog().write(websocketpp::log::alevel::app, "start ws_server");
 	m_thread = thread(bind(&rp_websocket_server::run,this, docroot,  port));
-	set_signal_timer();
-	set_param_timer();
+	m_running = true;
+	m_worker = thread(bind(&rp_websocket_server::work,this));
 }
 
 void rp_websocket_server::join()
@@ -294,14 +892,17 @@ void rp_websocket_server::stop()
 
 	m_endpoint.get_alog().write(websocketpp::log::alevel::app, "stop ws_server");
 
+	m_running = false;
+	sem_post(&m_wake);
+	if (m_worker.joinable())
+		m_worker.join();
+
 	m_endpoint.stop_listening();
 	m_endpoint.stop();
-	m_param_timer->cancel();
-	m_signal_timer->cancel();
 	con_list::iterator it;
 
 	for (it = m_connections.begin(); it != m_connections.end(); ++it) {
-		connection_hdl hdl = *it;
+		connection_hdl hdl = it->first;
 
 		try{
               		m_endpoint.close(hdl, websocketpp::close::status::normal, "shutdown");
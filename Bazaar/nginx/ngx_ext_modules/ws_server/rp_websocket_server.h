@@ -2,21 +2,63 @@
 #include <websocketpp/config/asio_no_tls.hpp>
 #include <websocketpp/server.hpp>
 #include <websocketpp/common/thread.hpp>
-//#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
-#include <set>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <map>
+#include <vector>
+#include <deque>
+#include <atomic>
 #include <fstream>
+#include <semaphore.h>
 
 #include "libjson/_internal/Source/JSONNode.h"
 #include "ws_server.h"
+#include "ws_compressor.h"
+#include "ws_scheduler.h"
+#include "ws_queue.h"
 
-//class config2{};
+// Bytes a client may have queued in websocketpp, not yet written to its
+// socket, before new signal frames are held back for it (latest-wins)
+#define WS_MAX_BUFFERED (512 * 1024)
+
+#define WS_COMMAND_QUEUE 256   // client messages waiting for the worker, more go to m_overflow
+#define WS_FRAME_QUEUE   16    // produced passes waiting for the server thread
+
+// asio config with the permessage-deflate extension, websocketpp keeps a
+// zlib stream per connection which compresses with context takeover
+struct deflate_config : public websocketpp::config::asio {
+    typedef deflate_config type;
+    typedef websocketpp::config::asio base;
+
+    typedef base::concurrency_type concurrency_type;
+    typedef base::request_type request_type;
+    typedef base::response_type response_type;
+    typedef base::message_type message_type;
+    typedef base::con_msg_manager_type con_msg_manager_type;
+    typedef base::endpoint_msg_manager_type endpoint_msg_manager_type;
+    typedef base::alog_type alog_type;
+    typedef base::elog_type elog_type;
+    typedef base::rng_type rng_type;
+
+    struct transport_config : public base::transport_config {
+        typedef type::concurrency_type concurrency_type;
+        typedef type::alog_type alog_type;
+        typedef type::elog_type elog_type;
+        typedef type::request_type request_type;
+        typedef type::response_type response_type;
+        typedef websocketpp::transport::asio::basic_socket::endpoint socket_type;
+    };
+    typedef websocketpp::transport::asio::endpoint<transport_config> transport_type;
+
+    struct permessage_deflate_config {};
+    typedef websocketpp::extensions::permessage_deflate::enabled<permessage_deflate_config> permessage_deflate_type;
+};
 
 extern "C"{
 
 class rp_websocket_server {
 public:
     typedef websocketpp::connection_hdl connection_hdl;
-    typedef websocketpp::server<websocketpp::config::asio> server;
+    typedef websocketpp::server<deflate_config> server;
     typedef websocketpp::lib::lock_guard<websocketpp::lib::mutex> scoped_lock;
 
     rp_websocket_server();
@@ -31,25 +73,161 @@ public:
     void join();
     void stop();
 
-    void set_signal_timer();
-    void set_param_timer();
-
-    void on_signal_timer(websocketpp::lib::error_code const & ec);
-    void on_param_timer(websocketpp::lib::error_code const & ec);
     void on_http(connection_hdl hdl);
     void on_open(connection_hdl hdl);
     void on_close(connection_hdl hdl);
     void on_message(connection_hdl hdl, server::message_ptr msg);
 
 private:
-    typedef std::set<connection_hdl,std::owner_less<connection_hdl>> con_list;
+    // Per connection state of the server thread: the frame waiting for the
+    // socket and the statistics
+    struct connection_state {
+        connection_state() : signals_sent(0), signals_dropped(0), params_sent(0), bytes_sent(0), max_buffered(0) {}
+        server::message_ptr pending_signals; // newest frame held back while the client is behind
+
+        // statistics, {"protocol":{"stats":true}} returns them
+        unsigned long signals_sent;
+        unsigned long signals_dropped;   // replaced by a newer frame before they were sent
+        unsigned long params_sent;
+        unsigned long long bytes_sent;
+        size_t max_buffered;
+    };
+    typedef std::map<connection_hdl,connection_state,std::owner_less<connection_hdl>> con_list;
+
+    // Per connection settings, negotiated with the "protocol" message. Owned
+    // by the worker thread, which produces the frames of every connection.
+    struct client_state {
+        client_state() : binary_signals(false), delta_params(false), ids_version(-1),
+            deflate(false), plain_json(false), subscription(-1), points(0), max_rate(0) {}
+        bool binary_signals;   // signals as binary frames instead of gzipped JSON
+        bool delta_params;     // parameters as deltas keyed by ID instead of gzipped JSON
+        int ids_version;       // version of the parameter ID dictionary the client has
+        bool deflate;          // permessage-deflate negotiated in the handshake
+        bool plain_json;       // JSON as text frames left to permessage-deflate, not gzipped
+
+        // signal subscription, {"protocol":{"subscribe":{...}}}
+        int subscription;      // ID in the application, -1 without one
+        std::string signals;   // comma separated names, empty - all
+        int points;            // decimation target, 0 - full resolution
+        int max_rate;          // frames per second, 0 - every signal tick
+    };
+    typedef std::map<connection_hdl,client_state,std::owner_less<connection_hdl>> client_list;
+
+    // Server thread to worker: connection events and client messages
+    struct command {
+        enum type_t { OPEN, CLOSE, PARAMS, SIGNALS, PROTOCOL };
+        command() : type(OPEN), deflate(false) {}
+        command(type_t type, connection_hdl hdl) : type(type), hdl(hdl), deflate(false) {}
+
+        type_t type;
+        connection_hdl hdl;
+        bool deflate;          // OPEN
+        std::string data;      // PARAMS, SIGNALS, PROTOCOL: the JSON of the message
+    };
+
+    // Worker to server thread: the frames of one pass for their connections
+    struct dispatch {
+        connection_hdl hdl;
+        server::message_ptr msg;
+        bool signals;          // queued latest-wins, parameters are always sent
+    };
+    struct rate_stats {
+        rate_stats() : fps(0), interval(0), skipped(0), load(0) {}
+        double fps;
+        int interval;
+        unsigned long skipped;
+        double load;
+    };
+    struct frame_batch {
+        frame_batch() : signal_tick(false) {}
+        std::vector<dispatch> frames;
+        bool signal_tick;      // held back signal frames are flushed
+        rate_stats rate;
+    };
+
+    // Payload of one tick, built into an immutable message at most once per
+    // form and shared (reference counted) by all connections which get it
+    struct shared_frame {
+        shared_frame(const void* data, size_t size, websocketpp::frame::opcode::value op, bool compressible);
+        server::message_ptr get(bool deflate); // NULL if there is no payload
+
+        const void* data;
+        size_t size;
+        websocketpp::frame::opcode::value op;
+        bool compressible;
+        server::message_ptr plain;      // framed once, written as it is to every socket
+        server::message_ptr compressed; // framed by each connection's permessage-deflate stream
+    };
+
+    // JSON payload of one tick: text for plain_json clients, gzipped at most once
+    struct json_frame {
+        json_frame(const char* json, size_t size);
+
+        const char* json;
+        size_t size;
+        shared_frame text;
+        shared_frame gzipped;
+        bool gzip_done;
+    };
+
+    // worker thread
+    void work();
+    void wait(double ms);
+    bool pop_command(command& cmd);
+    void run_commands(double& next_signal, double& next_param);
+    int signal_interval() const;
+    int param_interval() const;
+    void on_protocol(client_state& client, JSONNode& protocol);
+    bool subscriptions() const;
+    void subscribe(client_state& client);
+    void on_subscribe(client_state& client, JSONNode& subscription);
+    void produce_signals();
+    void produce_subscribed_signals();
+    void produce_params();
+    server::message_ptr json_message(json_frame& frame, bool plain_json);
+    void send_json(const char* json, bool (client_state::*skip), bool signals);
+    void emit(connection_hdl hdl, server::message_ptr msg, bool signals);
+    void publish();
+    static server::message_ptr make_message(const void* data, size_t size,
+                                            websocketpp::frame::opcode::value op, bool compress);
+
+    // server thread
+    void post_command(command& cmd);
+    void on_frames();
+    bool send(con_list::iterator it, server::message_ptr msg);
+    void send_param(con_list::iterator it, server::message_ptr msg);
+    void queue_signals(con_list::iterator it, server::message_ptr msg);
+    void flush_signals(con_list::iterator it);
+    std::string get_stats(const connection_state& state, size_t buffered);
 
     struct server_parameters* m_params;
     server m_endpoint;
     con_list m_connections;
-    server::timer_ptr m_signal_timer;
-    server::timer_ptr m_param_timer;
     websocketpp::lib::thread m_thread;
+    rate_stats m_rate;                    // as of the last batch
+
+    // The application is called from the worker only, the server thread
+    // just writes the frames, so a slow application callback never delays
+    // incoming messages. The queues are lock-free (m_overflow only takes a
+    // lock once m_commands is full), the worker sleeps on m_wake until its
+    // next tick or a command.
+    websocketpp::lib::thread m_worker;
+    std::atomic<bool> m_running;
+    sem_t m_wake;
+    ws_spsc_queue<command, WS_COMMAND_QUEUE> m_commands;
+    std::deque<command> m_overflow;       // commands behind a full m_commands, locked
+    websocketpp::lib::mutex m_overflow_lock;
+    std::atomic<bool> m_overflowed;       // m_overflow is not empty
+    ws_spsc_queue<frame_batch, WS_FRAME_QUEUE> m_frames;
+    std::atomic<bool> m_drain_posted;     // on_frames() is posted to the server thread
+    std::atomic<bool> m_batch_held;       // m_frames was full, the worker publishes again when woken
+    client_list m_clients;
+    frame_batch m_batch;                  // being produced
+    ws_compressor m_gzip;                 // JSON for clients without plain_json
+    ws_compress_policy m_binary_policy;   // binary signal frames
+    ws_interval_controller m_signal_rate; // stretches the signal interval under load
+    bool m_throttled;                     // signal interval is longer than requested
+
     std::string m_docroot;
 	std::ofstream m_out;
 	volatile bool m_OnClosed;
@@ -0,0 +1,71 @@
+#include "ws_compressor.h"
+
+#include <string.h>
+
+ws_compressor::ws_compressor(int level)
+    : m_init(false)
+    , m_size(0)
+{
+    memset(&m_stream, 0, sizeof(m_stream));
+    // 16 + 15 window bits: gzip wrapper, as Crypto++ Gzip in rp_sdk produced
+    m_init = deflateInit2(&m_stream, level, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+ws_compressor::~ws_compressor()
+{
+    if (m_init)
+        deflateEnd(&m_stream);
+}
+
+bool ws_compressor::gzip(const void* data, size_t size)
+{
+    m_size = 0;
+    if (!m_init || deflateReset(&m_stream) != Z_OK)
+        return false;
+
+    // deflateBound() is the worst case, so one deflate() call always finishes
+    size_t bound = deflateBound(&m_stream, size);
+    if (m_out.size() < bound)
+        m_out.resize(bound);
+
+    m_stream.next_in = (Bytef*)data;
+    m_stream.avail_in = size;
+    m_stream.next_out = (Bytef*)m_out.data();
+    m_stream.avail_out = m_out.size();
+
+    if (deflate(&m_stream, Z_FINISH) != Z_STREAM_END)
+        return false;
+
+    m_size = m_out.size() - m_stream.avail_out;
+    return true;
+}
+
+ws_compress_policy::ws_compress_policy(size_t min_size, unsigned probe_interval, double max_ratio)
+    : m_probe(1)
+    , m_min_size(min_size)
+    , m_probe_interval(probe_interval)
+    , m_frames(0)
+    , m_max_ratio(max_ratio)
+    , m_ratio(0)
+    , m_compressed(0)
+    , m_skipped(0)
+{
+}
+
+bool ws_compress_policy::should_compress(const void* data, size_t size)
+{
+    if (size < m_min_size) {
+        m_skipped++;
+        return false;
+    }
+
+    if (m_frames++ % m_probe_interval == 0 && m_probe.gzip(data, size))
+        m_ratio = (double)m_probe.size() / size;
+
+    if (m_ratio > m_max_ratio) {
+        m_skipped++;
+        return false;
+    }
+    m_compressed++;
+    return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include <zlib.h>
+
+#define WS_DEFLATE_MIN_SIZE 256 // smaller frames are not worth compressing
+
+// gzip compressor which keeps its zlib state and output buffer between
+// messages: the stream is reset instead of set up again, and nothing is
+// allocated once the buffer has grown to fit the largest message.
+class ws_compressor {
+public:
+    ws_compressor(int level = 1);
+    ~ws_compressor();
+
+    // Compresses size bytes into one gzip member, false on error.
+    // The result is valid until the next call.
+    bool gzip(const void* data, size_t size);
+
+    const char* data() const { return m_out.data(); }
+    size_t size() const { return m_size; }
+
+private:
+    ws_compressor(const ws_compressor&);
+    ws_compressor& operator=(const ws_compressor&);
+
+    z_stream m_stream;
+    bool m_init;
+    std::vector<char> m_out;
+    size_t m_size;
+};
+
+// Decides whether a frame is worth compressing with permessage-deflate.
+// Small frames are never compressed. For larger frames the ratio is probed
+// every probe_interval frames, and the frames are compressed only while
+// they shrink below max_ratio (sampled signals often do not).
+class ws_compress_policy {
+public:
+    ws_compress_policy(size_t min_size = WS_DEFLATE_MIN_SIZE, unsigned probe_interval = 32, double max_ratio = 0.9);
+
+    bool should_compress(const void* data, size_t size);
+
+    unsigned long compressed() const { return m_compressed; }
+    unsigned long skipped() const { return m_skipped; }
+
+private:
+    ws_compressor m_probe;
+    size_t m_min_size;
+    unsigned m_probe_interval;
+    unsigned m_frames;
+    double m_max_ratio;
+    double m_ratio;
+    unsigned long m_compressed;
+    unsigned long m_skipped;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <utility>
+
+// Bounded lock-free queue for one producer and one consumer thread. Items
+// are moved in and out of preallocated slots, push() and pop() never block
+// and never allocate. Size must be a power of 2.
+template <typename T, size_t Size>
+class ws_spsc_queue {
+public:
+    ws_spsc_queue() : m_head(0), m_tail(0) {}
+
+    // Producer only, false if the queue is full (item is left as it was)
+    bool push(T& item)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) >= Size)
+            return false;
+        m_slots[head & (Size - 1)] = std::move(item);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only, false if the queue is empty
+    bool pop(T& item)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+            return false;
+        item = std::move(m_slots[tail & (Size - 1)]);
+        m_slots[tail & (Size - 1)] = T();
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    ws_spsc_queue(const ws_spsc_queue&);
+    ws_spsc_queue& operator=(const ws_spsc_queue&);
+
+    static_assert((Size & (Size - 1)) == 0, "queue size must be a power of 2");
+
+    T m_slots[Size];
+    std::atomic<size_t> m_head;   // written by the producer only
+    std::atomic<size_t> m_tail;   // written by the consumer only
+};
@@ -0,0 +1,82 @@
+#include "ws_scheduler.h"
+
+#include <math.h>
+#include <time.h>
+
+ws_interval_controller::ws_interval_controller(int budget)
+    : m_budget(WS_LOAD_BUDGET)
+    , m_interval(0)
+    , m_cost(0)
+    , m_busy(0)
+    , m_last_start(0)
+    , m_window_start(0)
+    , m_window_busy(0)
+    , m_window_frames(0)
+    , m_fps(0)
+    , m_load(0)
+    , m_ticks(0)
+    , m_skipped(0)
+{
+    set_budget(budget);
+}
+
+void ws_interval_controller::set_budget(int budget)
+{
+    m_budget = budget < 1 ? 1 : budget > 100 ? 100 : budget;
+}
+
+void ws_interval_controller::add_busy(double ms)
+{
+    m_busy += ms;
+}
+
+int ws_interval_controller::tick(int requested, double start, double end)
+{
+    double work = end - start;
+    double busy = work + m_busy;
+    m_busy = 0;
+
+    // Follows a slower application quickly, a faster one gradually, so a
+    // single short tick does not bring the rate back to where it overloads
+    if (m_ticks == 0)
+        m_cost = busy;
+    else
+        m_cost += (busy - m_cost) * (busy > m_cost ? 0.5 : 0.125);
+
+    if (m_ticks > 0 && requested > 0) {
+        long periods = (long)((start - m_last_start) / requested);
+        if (periods > 1)
+            m_skipped += periods - 1;
+    }
+    m_last_start = start;
+    m_ticks++;
+
+    if (m_window_start == 0)
+        m_window_start = start;
+    m_window_frames++;
+    m_window_busy += busy;
+    if (end - m_window_start >= WS_RATE_WINDOW_MS) {
+        m_fps = m_window_frames * 1000.0 / (end - m_window_start);
+        m_load = m_window_busy / (end - m_window_start);
+        m_window_start = end;
+        m_window_frames = 0;
+        m_window_busy = 0;
+    }
+
+    m_interval = delay(requested);
+    int left = m_interval - (int)work;
+    return left > 0 ? left : 0;
+}
+
+int ws_interval_controller::delay(int requested) const
+{
+    int needed = (int)ceil(m_cost * 100 / m_budget);
+    return needed > requested ? needed : requested;
+}
+
+double ws_interval_controller::now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
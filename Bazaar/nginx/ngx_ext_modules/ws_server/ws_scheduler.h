@@ -0,0 +1,51 @@
+#pragma once
+
+#define WS_LOAD_BUDGET      50      // percent of the worker thread signal ticks may use
+#define WS_RATE_WINDOW_MS   1000    // frame rate and load are averaged over this window
+
+// Chooses the delay to the next signal tick. The cost of a tick (producing,
+// compressing and sending the signals) is measured and smoothed, and the
+// interval is stretched beyond the requested one whenever the ticks would
+// otherwise keep the worker thread busy more than budget percent of the
+// time. The timer is armed for the rest of the interval, so a tick which
+// takes longer than the interval does not make the next one late as well.
+class ws_interval_controller {
+public:
+    ws_interval_controller(int budget = WS_LOAD_BUDGET);
+
+    void set_budget(int budget);
+
+    // Work done on the server thread outside of signal ticks (parameters,
+    // messages), counted against the budget of the next tick
+    void add_busy(double ms);
+
+    // Accounts a tick which ran from start to end (now_ms()) and returns the
+    // delay to the next one in ms
+    int tick(int requested, double start, double end);
+
+    // Delay to the next tick if the timer has to be armed outside of a tick
+    int delay(int requested) const;
+
+    int interval() const { return m_interval; }    // effective interval in ms
+    double cost() const { return m_cost; }         // smoothed tick cost in ms
+    double fps() const { return m_fps; }
+    double load() const { return m_load; }         // busy fraction of the last window
+    unsigned long ticks() const { return m_ticks; }
+    unsigned long skipped() const { return m_skipped; } // requested ticks which did not happen
+
+    static double now_ms();
+
+private:
+    int m_budget;
+    int m_interval;
+    double m_cost;
+    double m_busy;          // outside of ticks, since the last tick
+    double m_last_start;
+    double m_window_start;
+    double m_window_busy;
+    unsigned m_window_frames;
+    double m_fps;
+    double m_load;
+    unsigned long m_ticks;
+    unsigned long m_skipped;
+};
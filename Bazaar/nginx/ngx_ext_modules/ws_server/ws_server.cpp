@@ -28,6 +28,13 @@ void start_ws_server(const struct server_parameters * _params)
 		loaded_params->get_signals_func = _params->get_signals_func;
 		loaded_params->set_signals_func = _params->set_signals_func;
 		loaded_params->gzip_func = _params->gzip_func;
+		loaded_params->get_signals_frames_func = _params->get_signals_frames_func;
+		loaded_params->get_params_frames_func = _params->get_params_frames_func;
+		loaded_params->get_params_ids_func = _params->get_params_ids_func;
+		loaded_params->subscribe_signals_func = _params->subscribe_signals_func;
+		loaded_params->unsubscribe_signals_func = _params->unsubscribe_signals_func;
+		loaded_params->update_signal_subscriptions_func = _params->update_signal_subscriptions_func;
+		loaded_params->get_subscription_frame_func = _params->get_subscription_frame_func;
 	}
 	if(_params != 0 && _params->port != 0)
 		loaded_params->port = _params->port;
@@ -35,6 +42,8 @@ void start_ws_server(const struct server_parameters * _params)
 		loaded_params->signal_interval = _params->signal_interval;
 	if(_params != 0 && _params->param_interval != 0)
 		loaded_params->param_interval = _params->param_interval;
+	if(_params != 0 && _params->signal_budget != 0)
+		loaded_params->signal_budget = _params->signal_budget;
 
 	int port=loaded_params->port;
 	s = rp_websocket_server::create(loaded_params);
@@ -64,6 +73,7 @@ struct server_parameters * load_params()
 		params->signal_interval = 20;
 		params->param_interval = 20;
 		params->port = 9002;
+		params->signal_budget = WS_LOAD_BUDGET;
         	return params;
 	}
 
@@ -76,5 +86,7 @@ struct server_parameters * load_params()
 	params->signal_interval = n.at("s_send_interval").as_int();
 	params->param_interval = n.at("p_send_interval").as_int();
 	params->port = n.at("port").as_int();
+	JSONNode::iterator budget = n.find("s_load_budget");
+	params->signal_budget = budget != n.end() ? budget->as_int() : WS_LOAD_BUDGET;
 	return params;
 }
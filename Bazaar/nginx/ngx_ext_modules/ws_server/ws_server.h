@@ -12,6 +12,13 @@ typedef const char     *(*ws_get_signals_func)(void);
 typedef int		(*ws_set_params_func)(const char *_params);
 typedef int		(*ws_set_signals_func)(const char *_signals);
 typedef void	(*ws_gzip_func)(const char *_in, void* _out, size_t* _size);
+typedef int		(*ws_get_signals_frames_func)(const char **_json, const char **_binary, size_t *_binary_size);
+typedef int		(*ws_get_params_frames_func)(const char **_json, const char **_delta, int *_ids_version);
+typedef const char     *(*ws_get_params_ids_func)(void);
+typedef int		(*ws_subscribe_signals_func)(const char *_names, int _points, int _max_rate, int _binary);
+typedef void	(*ws_unsubscribe_signals_func)(int _id);
+typedef int		(*ws_update_signal_subscriptions_func)(void);
+typedef int		(*ws_get_subscription_frame_func)(int _id, const char **_data, size_t *_size);
 
 // The following struct can be used to define specific parameters
 struct server_parameters {
@@ -27,6 +34,14 @@ struct server_parameters {
 	int signal_interval; // in ms
 	int param_interval; // in ms
 	int port;
+	ws_get_signals_frames_func get_signals_frames_func; // optional, enables binary signal frames
+	ws_get_params_frames_func get_params_frames_func; // optional, enables parameter deltas
+	ws_get_params_ids_func get_params_ids_func; // optional, enables parameter deltas
+	ws_subscribe_signals_func subscribe_signals_func; // optional, the four enable signal subscriptions
+	ws_unsubscribe_signals_func unsubscribe_signals_func;
+	ws_update_signal_subscriptions_func update_signal_subscriptions_func;
+	ws_get_subscription_frame_func get_subscription_frame_func;
+	int signal_budget; // percent of the server thread signal ticks may use, 0 - default
 };
 
 void start_ws_server(const struct server_parameters* _params);
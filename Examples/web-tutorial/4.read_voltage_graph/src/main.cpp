@@ -2,6 +2,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/sysinfo.h>
@@ -18,8 +19,7 @@
 
 
 //Signal
-CFloatSignal VOLTAGE("VOLTAGE", SIGNAL_SIZE_DEFAULT, 0.0f);
-std::vector<float> g_data(SIGNAL_SIZE_DEFAULT);
+CFloatBufferedSignal VOLTAGE("VOLTAGE", SIGNAL_SIZE_DEFAULT, 0.0f);
 
 
 
@@ -94,15 +94,14 @@ void UpdateSignals(void)
     //Read data from pin
     rp_AIpinGetValue(0, &val);
 
-    //Push it to vector
-    g_data.erase(g_data.begin());
-    g_data.push_back(val);
+    //Shift the graph by one sample into the back buffer of the signal
+    SignalSpan<const float> graph = VOLTAGE.Data();
+    SignalSpan<float> data = VOLTAGE.Back();
+    memcpy(data.Data(), graph.Data() + 1, (SIGNAL_SIZE_DEFAULT - 1) * sizeof(float));
+    data[SIGNAL_SIZE_DEFAULT - 1] = val;
 
-    //Write data to signal
-    for(int i = 0; i < SIGNAL_SIZE_DEFAULT; i++) 
-    {
-        VOLTAGE[i] = g_data[i];
-    }
+    //Send it
+    VOLTAGE.Swap();
 }
 
 
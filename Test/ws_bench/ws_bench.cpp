@@ -0,0 +1,183 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya web socket SDK benchmark.
+ *
+ * Measures the per tick cost of producing the signals of a typical
+ * oscilloscope application (2 x 16k float samples) in the formats the
+ * web socket server can send:
+ *   json   - JSON tree, written to a string and gzipped (original protocol)
+ *   binary - binary signal frame (rp_sdk/SignalFrame.h)
+ * and the CPU time per frame of compressing them:
+ *   cryptopp - rp_sdk ws_gzip(), a new Crypto++ Gzip filter per message
+ *   zlib     - ws_server ws_compressor, zlib state and buffer reused
+ *   adaptive - ws_compress_policy on binary frames (probe, then skip or deflate)
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+
+#include "DataManager.h"
+#include "CustomParameters.h"
+#include "ws_compressor.h"
+
+#define SIGNAL_SIZE     (16 * 1024)
+#define GZIP_BUF_SIZE   (4 * 1024 * 1024)
+
+CFloatSignal CH1("ch1", SIGNAL_SIZE, 0.0f);
+CFloatSignal CH2("ch2", SIGNAL_SIZE, 0.0f);
+
+static std::vector<float> g_ch1(SIGNAL_SIZE);
+static std::vector<float> g_ch2(SIGNAL_SIZE);
+static unsigned int g_tick = 0;
+
+// rp_sdk application callbacks
+void UpdateSignals(void)
+{
+	for(int i = 0; i < SIGNAL_SIZE; i++) {
+		g_ch1[i] = sinf(2 * M_PI * (i + g_tick) / 1000.0f) + (rand() % 100) * 1e-4f;
+		g_ch2[i] = cosf(2 * M_PI * (i + g_tick) / 1000.0f) + (rand() % 100) * 1e-4f;
+	}
+	CH1.Set(g_ch1);
+	CH2.Set(g_ch2);
+	g_tick++;
+}
+
+void UpdateParams(void) {}
+void PostUpdateSignals(void) {}
+void OnNewParams(void) {}
+void OnNewSignals(void) {}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+static double cpu_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+static void report(const char *name, double ms, size_t bytes, int ticks)
+{
+	printf("%-8s %9.3f ms/tick %9.1f ticks/s %10zu bytes/tick %8.2f MB/s\n",
+	       name, ms / ticks, ticks * 1e3 / ms, bytes / ticks,
+	       bytes / (ms * 1e3));
+}
+
+static void report_cpu(const char *name, double ms, size_t in, size_t out, int frames)
+{
+	printf("%-8s %9.3f ms CPU/frame %10zu -> %10zu bytes/frame (%5.1f %%)\n",
+	       name, ms / frames, in / frames, out / frames,
+	       in ? 100.0 * out / in : 0.0);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-n ticks]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	CDataManager *man = CDataManager::GetInstance();
+	static char gz[GZIP_BUF_SIZE];
+	std::string json, binary;
+	int ticks = 100;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:")) != -1) {
+		switch(opt) {
+		case 'n':
+			ticks = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(ticks <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	printf("%d ticks, 2 signals x %d float samples\n", ticks, SIGNAL_SIZE);
+
+	// JSON tree + write + gzip
+	double t = now_ms(), update_ms = 0;
+	size_t bytes = 0;
+	for(int i = 0; i < ticks; i++) {
+		size_t size = 0;
+		man->GetSignals(&json, NULL);
+		ws_gzip(json.c_str(), gz, &size);
+		bytes += size;
+	}
+	report("json", now_ms() - t, bytes, ticks);
+
+	// Binary frames
+	t = now_ms();
+	bytes = 0;
+	for(int i = 0; i < ticks; i++) {
+		man->GetSignals(NULL, &binary);
+		bytes += binary.size();
+	}
+	report("binary", now_ms() - t, bytes, ticks);
+
+	// Compression only, the frames are produced outside of the measurement
+	double cryptopp_ms = 0, zlib_ms = 0, adaptive_ms = 0;
+	size_t json_in = 0, cryptopp_out = 0, zlib_out = 0, binary_in = 0, adaptive_out = 0;
+	ws_compressor gzip;
+	ws_compressor deflate;
+	ws_compress_policy policy;
+	for(int i = 0; i < ticks; i++) {
+		size_t size = 0;
+		man->GetSignals(&json, &binary);
+		json_in += json.size();
+		binary_in += binary.size();
+
+		t = cpu_ms();
+		ws_gzip(json.c_str(), gz, &size);
+		cryptopp_ms += cpu_ms() - t;
+		cryptopp_out += size;
+
+		t = cpu_ms();
+		gzip.gzip(json.data(), json.size());
+		zlib_ms += cpu_ms() - t;
+		zlib_out += gzip.size();
+
+		// permessage-deflate runs in websocketpp, a gzip of the frame
+		// costs about the same
+		t = cpu_ms();
+		if(policy.should_compress(binary.data(), binary.size())) {
+			deflate.gzip(binary.data(), binary.size());
+			adaptive_out += deflate.size();
+		} else {
+			adaptive_out += binary.size();
+		}
+		adaptive_ms += cpu_ms() - t;
+	}
+	report_cpu("cryptopp", cryptopp_ms, json_in, cryptopp_out, ticks);
+	report_cpu("zlib", zlib_ms, json_in, zlib_out, ticks);
+	report_cpu("adaptive", adaptive_ms, binary_in, adaptive_out, ticks);
+	printf("(adaptive: %lu frames compressed, %lu sent as they are)\n",
+	       policy.compressed(), policy.skipped());
+
+	// Both include UpdateSignals(), measure it alone to subtract
+	t = now_ms();
+	for(int i = 0; i < ticks; i++)
+		UpdateSignals();
+	update_ms = now_ms() - t;
+	printf("(UpdateSignals() alone: %.3f ms/tick, included above)\n", update_ms / ticks);
+
+	return 0;
+}
@@ -0,0 +1,161 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya web socket SDK JSON test.
+ *
+ * Checks the streaming JSON writer and reader of rp_sdk:
+ *   float  - JSONFormatFloat() parses back to the value of printf %.7g
+ *            (floats) and %.15g (doubles), over the whole exponent range
+ *   reader - string escapes, \u escapes and surrogate pairs, values of an
+ *            unexpected type (skipped) and malformed messages (error)
+ * Prints the failed checks and exits with 1 if there were any.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+#include "JSONWriter.h"
+#include "JSONReader.h"
+
+#define FLOAT_SAMPLES   1000000
+
+static int g_checks = 0;
+static int g_failed = 0;
+
+static void check(bool _ok, const char *_what, const std::string &_detail = "")
+{
+	g_checks++;
+	if(!_ok) {
+		g_failed++;
+		printf("FAIL %s %s\n", _what, _detail.c_str());
+	}
+}
+
+/* Random value with a random exponent, both signs, 1e-30 .. 1e30 */
+static double random_value()
+{
+	double mantissa = (double)rand() / RAND_MAX + (double)rand() / RAND_MAX / RAND_MAX;
+	double value = mantissa * pow(10, rand() % 61 - 30);
+	return rand() & 1 ? -value : value;
+}
+
+static bool format_float(double _value, int _digits, bool _single)
+{
+	char buf[64], ref[64];
+	size_t len = JSONFormatFloat(buf, _value, _digits);
+	buf[len] = 0;
+	snprintf(ref, sizeof(ref), "%.*g", _digits, _value);
+
+	bool ok = _single ? strtof(buf, NULL) == strtof(ref, NULL) : strtod(buf, NULL) == strtod(ref, NULL);
+	check(ok, _single ? "float" : "double", std::string(buf) + " != " + ref);
+	return ok;
+}
+
+static void test_float()
+{
+	static const double edges[] = {
+		1, -1, 0.5, 0.1, 1e-4, 9.9999999e-5, 1e15, 999999999999999.0, 9.9999996,
+		9999999.5, 0.00012345678, 123456.789, 3.4028235e38, 1.17549435e-38, 5e-324
+	};
+	int failed = g_failed;
+
+	for(size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+		format_float((float)edges[i], JSON_FLOAT_DIGITS, true);
+		format_float(edges[i], JSON_DOUBLE_DIGITS, false);
+	}
+
+	srand(1);
+	for(int i = 0; i < FLOAT_SAMPLES && g_failed - failed < 20; i++) {
+		double value = random_value();
+		format_float((float)value, JSON_FLOAT_DIGITS, true);
+		format_float(value, JSON_DOUBLE_DIGITS, false);
+	}
+
+	char buf[64];
+	check(JSONFormatFloat(buf, NAN, 7) == 4 && !strncmp(buf, "null", 4), "float NaN");
+	check(JSONFormatFloat(buf, 0.0, 7) == 1 && buf[0] == '0', "float zero");
+}
+
+/* Reads {"s":"..."} and compares the string */
+static void read_string(const char *_json, const char *_expected)
+{
+	JSONReader r(_json, strlen(_json));
+	std::string key, value;
+	bool ok = r.BeginObject() && r.NextKey(key) && r.ReadString(value);
+	check(ok && value == _expected, "string", _json);
+}
+
+/* Reads {"a":...,"b":2}: "a" as a number must be skipped and "b" still read */
+static void read_mistyped(const char *_json)
+{
+	JSONReader r(_json, strlen(_json));
+	std::string key;
+	double a = -1, b = 0;
+	bool ok = r.BeginObject() && r.NextKey(key) && !r.ReadNumber(a) && !r.Error() &&
+		r.NextKey(key) && key == "b" && r.ReadNumber(b) && !r.NextKey(key) && !r.Error();
+	check(ok && a == -1 && b == 2, "mistyped", _json);
+}
+
+/* Walks the whole document, must end in an error. Strings are read (and
+ * their escapes checked), other values skipped as mistyped. */
+static void read_malformed(const char *_json)
+{
+	JSONReader r(_json, strlen(_json));
+	std::string key, value;
+	if(r.BeginObject())
+		while(r.NextKey(key))
+			r.ReadString(value);
+	check(r.Error(), "malformed", _json);
+}
+
+static void test_reader()
+{
+	read_string("{\"s\":\"plain\"}", "plain");
+	read_string("{\"s\":\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"}", "\"\\/\b\f\n\r\t");
+	read_string("{\"s\":\"a\\u0041\\u00e9\\u20ac\"}", "aA\xc3\xa9\xe2\x82\xac");
+	read_string("{\"s\":\"\\ud83d\\ude00\"}", "\xf0\x9f\x98\x80");
+	read_string("{\"s\":\"\\ud800x\"}", "\xef\xbf\xbdx");
+	read_string("{\"s\":\"\\ud800\\u0041\"}", "\xef\xbf\xbd" "A");
+	read_string("{\"s\":\"\\udc00\"}", "\xef\xbf\xbd");
+
+	read_mistyped("{\"a\":null,\"b\":2}");
+	read_mistyped("{\"a\":true,\"b\":2}");
+	read_mistyped("{\"a\":{\"x\":[1,2]},\"b\":2}");
+	read_mistyped("{\"a\":[1,\"}\"],\"b\":2}");
+
+	read_malformed("{\"a\":1,}");
+	read_malformed("{\"a\" 1}");
+	read_malformed("{\"a\":1");
+	read_malformed("{\"a\":\"open}");
+	read_malformed("{\"a\":\"\\u12g4\"}");
+	read_malformed("{\"a\":]}");
+	read_malformed("{a:1}");
+
+	// numbers, booleans and numbers in strings
+	const char *json = "{\"n\":-1.5e3,\"t\":true,\"f\":0,\"q\":\"42\",\"v\":[1,null,3]}";
+	JSONReader r(json, strlen(json));
+	std::string key;
+	double n = 0, q = 0, v, sum = 0;
+	bool t = false, f = true;
+	bool ok = r.BeginObject() && r.NextKey(key) && r.ReadNumber(n) && r.NextKey(key) && r.ReadBool(t) &&
+		r.NextKey(key) && r.ReadBool(f) && r.NextKey(key) && r.ReadNumber(q) && r.NextKey(key) && r.BeginArray();
+	while(ok && r.NextElement())
+		if(r.ReadNumber(v))
+			sum += v;
+	ok = ok && !r.NextKey(key) && !r.Error();
+	check(ok && n == -1500 && t && !f && q == 42 && sum == 4, "values", json);
+}
+
+int main(int argc, char *argv[])
+{
+	test_float();
+	test_reader();
+
+	printf("%d checks, %d failed\n", g_checks, g_failed);
+	return g_failed ? 1 : 0;
+}
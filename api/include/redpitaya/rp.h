@@ -79,6 +79,8 @@ extern "C" {
 #define RP_EFWB   22
 /** Extension module not connected */
 #define RP_EMNC   23
+/** Timeout waiting for event */
+#define RP_ETMO   24
 
 #define SPECTR_OUT_SIG_LEN (2*1024)
 
@@ -229,6 +231,23 @@ typedef enum {
 } rp_acq_trig_state_t;
 
 
+/**
+ * Trigger wait statistics, collected by rp_AcqWaitTrigger().
+ */
+typedef struct {
+    uint32_t waits;      //!< Number of waits which ended with a trigger
+    uint32_t timeouts;   //!< Number of waits which timed out
+    uint32_t spin_hits;  //!< Triggers detected while busy polling
+    uint32_t sleep_hits; //!< Triggers detected after a backoff sleep
+    uint32_t irq_hits;   //!< Triggers detected after an UIO interrupt wait
+    uint32_t polls;      //!< Trigger state reads
+    uint32_t sleeps;     //!< Backoff sleeps and interrupt waits
+    uint32_t avg_us;     //!< Running average of trigger wait time, used to size the busy poll
+    uint32_t max_us;     //!< Longest wait which ended with a trigger
+    uint64_t total_us;   //!< Time spent in all waits
+} rp_acq_wait_stats_t;
+
+
 /**
  * Calibration parameters, stored in the EEPROM device
  */
@@ -739,6 +758,32 @@ int rp_AcqGetTriggerSrc(rp_acq_trig_src_t* source);
  */
 int rp_AcqGetTriggerState(rp_acq_trig_state_t* state);
 
+/**
+ * Waits until the acquisition is triggered or the timeout expires.
+ * Short expected waits (based on the running average of previous waits) are busy polled,
+ * longer ones use the UIO interrupt when the device provides it or sleeps with exponential backoff.
+ * @param timeout_ms Maximum time to wait in milliseconds.
+ * @return If the function is successful, the return value is RP_OK.
+ * RP_ETMO is returned if the acquisition was not triggered in time.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_AcqWaitTrigger(uint32_t timeout_ms);
+
+/**
+ * Returns trigger wait statistics collected by rp_AcqWaitTrigger().
+ * @param stats Wait statistics.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_AcqGetWaitStats(rp_acq_wait_stats_t* stats);
+
+/**
+ * Clears trigger wait statistics, including the running average wait time.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_AcqResetWaitStats();
+
 /**
  * Sets the number of decimated data after trigger written into memory.
  * @param decimated_data_num Number of decimated data. It must not be higher than the ADC buffer size.
@@ -1147,6 +1192,17 @@ int rp_GenGetWaveform(rp_channel_t channel, rp_waveform_t *type);
 */
 int rp_GenArbWaveform(rp_channel_t channel, float *waveform, uint32_t length);
 
+/**
+* Sets user defined waveform from DAC codes. Faster variant of rp_GenArbWaveform(),
+* the codes are written to the generator buffer without conversion.
+* @param channel Channel A or B for witch we want to set waveform.
+* @param waveform Signed 14 bit DAC codes, where -8192 is -1V and 8191 is 1V.
+* @param length Length of waveform.
+* @return If the function is successful, the return value is RP_OK.
+* If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+*/
+int rp_GenArbWaveformRaw(rp_channel_t channel, const int16_t *waveform, uint32_t length);
+
 /**
 * Gets user defined waveform.
 * @param channel Channel A or B for witch we want to get waveform.
@@ -1274,6 +1330,16 @@ int rp_GenGetTriggerSource(rp_channel_t channel, rp_trig_src_t *src);
 */
 int rp_GenTrigger(uint32_t channel);
 
+/**
+* Defers waveform synthesis. While deferred, setting frequency, phase, waveform, duty cycle
+* or arbitrary data only updates the settings, the generator buffer of every modified
+* channel is written once when deferring is turned off.
+* @param defer True to defer synthesis, false to synthesize the modified channels.
+* @return If the function is successful, the return value is RP_OK.
+* If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+*/
+int rp_GenDeferSynthesis(bool defer);
+
 float rp_CmnCnvCntToV(uint32_t field_len, uint32_t cnts, float adc_max_v, uint32_t calibScale, int calib_dc_off, float user_dc_off);
 
 #ifdef __cplusplus
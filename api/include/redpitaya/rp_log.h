@@ -0,0 +1,374 @@
+/**
+ * $Id: $
+ *
+ * @file rp_log.h
+ * @brief Red Pitaya asynchronous logging
+ *
+ * Every logging thread formats messages into its own lock-free ring, a
+ * background thread drains the rings to syslog (default) or to a file opened
+ * with rp_log_open() every RP_LOG_FLUSH_MS, or as soon as a ring is half full.
+ * While all rings are empty it sleeps until the next message.
+ * The logging path never does I/O and never blocks: messages above the level
+ * threshold are rejected before formatting, and messages over the per thread
+ * rate limit or a full ring are dropped and reported as a count.
+ *
+ * Header only, shared by scpi-server and rp_sdk. The state is a weak symbol,
+ * so all translation units of a program use the same rings and flusher.
+ * rp_log_stop() must be called before a shared object using it is unloaded.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RP_LOG_H
+#define __RP_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#define RP_LOG_MSG_MAX      160     // longer messages are truncated
+#define RP_LOG_RING_SIZE    128     // messages per thread, power of 2
+#define RP_LOG_RATE         1000    // messages per second and thread
+#define RP_LOG_FLUSH_MS     20
+
+typedef struct rp_log_ring_s {
+    struct rp_log_ring_s *next;
+    uint32_t  used;         // owned by a live thread
+    uint32_t  head;         // written by the owner only
+    uint32_t  tail;         // written by the flusher only
+    uint32_t  dropped;
+    uint32_t  tokens;
+    time_t    refill;
+    struct {
+        int   level;
+        char  text[RP_LOG_MSG_MAX];
+    } slot[RP_LOG_RING_SIZE];
+} rp_log_ring_t;
+
+typedef struct {
+    int              level;
+    int              started;       // flusher thread is running
+    int              initialized;   // key and wake are created
+    int              registered;    // atfork and atexit handlers are set, never undone
+    int              stopping;      // flusher exits after its next drain
+    uint32_t         epoch;         // incremented when rp_log_stop() frees the rings
+    FILE            *file;
+    rp_log_ring_t   *rings;
+    pthread_t        thread;
+    pthread_key_t    key;
+    sem_t            wake;          // posted when a ring gets half full
+    pthread_mutex_t  lock;          // start, sink and drain - never taken on the logging path
+} rp_log_state_t;
+
+__attribute__((weak)) rp_log_state_t rp_log_state = {
+    LOG_INFO, 0, 0, 0, 0, 0, NULL, NULL, 0, 0, {}, PTHREAD_MUTEX_INITIALIZER
+};
+__attribute__((weak)) __thread rp_log_ring_t *rp_log_tls = NULL;
+__attribute__((weak)) __thread uint32_t rp_log_tls_epoch = 0;   // rp_log_tls is valid in this epoch
+
+/* Logs only if level passes the threshold, arguments are not evaluated otherwise */
+#define RP_LOG_PRINT(level, ...) \
+do { if (rp_log_enabled(level)) rp_log_write(level, __VA_ARGS__); } while (0)
+
+static inline int rp_log_enabled(int level)
+{
+    return level <= __atomic_load_n(&rp_log_state.level, __ATOMIC_RELAXED);
+}
+
+/* Sets syslog priority threshold (LOG_ERR ... LOG_DEBUG), -1 disables logging */
+static inline void rp_log_set_level(int level)
+{
+    __atomic_store_n(&rp_log_state.level, level, __ATOMIC_RELAXED);
+}
+
+static inline int rp_log_get_level(void)
+{
+    return __atomic_load_n(&rp_log_state.level, __ATOMIC_RELAXED);
+}
+
+static inline void rp_log_emit(int level, const char *text)
+{
+    if(rp_log_state.file) {
+        size_t len = strlen(text);
+        fputs(text, rp_log_state.file);
+        if(len == 0 || text[len - 1] != '\n')
+            fputc('\n', rp_log_state.file);
+    } else {
+        syslog(level, "%s", text);
+    }
+}
+
+/* Writes pending messages of all rings, called with lock held */
+static inline void rp_log_drain(void)
+{
+    rp_log_ring_t *r;
+    char buff[64];
+
+    for(r = __atomic_load_n(&rp_log_state.rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        uint32_t tail = r->tail;
+        uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint32_t dropped;
+
+        for(; tail != head; tail++) {
+            rp_log_emit(r->slot[tail & (RP_LOG_RING_SIZE - 1)].level,
+                        r->slot[tail & (RP_LOG_RING_SIZE - 1)].text);
+        }
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+        dropped = __atomic_exchange_n(&r->dropped, 0, __ATOMIC_RELAXED);
+        if(dropped) {
+            snprintf(buff, sizeof(buff), "%u log messages dropped", dropped);
+            rp_log_emit(LOG_WARNING, buff);
+        }
+    }
+    if(rp_log_state.file)
+        fflush(rp_log_state.file);
+}
+
+/* Writes all pending messages synchronously, e.g. before exit or closelog() */
+static inline void rp_log_flush(void)
+{
+    pthread_mutex_lock(&rp_log_state.lock);
+    rp_log_drain();
+    pthread_mutex_unlock(&rp_log_state.lock);
+}
+
+/* True if some ring holds messages or drop counts not written yet */
+static inline int rp_log_pending(void)
+{
+    rp_log_ring_t *r;
+
+    for(r = __atomic_load_n(&rp_log_state.rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        if(__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) != r->tail ||
+           __atomic_load_n(&r->dropped, __ATOMIC_RELAXED))
+            return 1;
+    }
+    return 0;
+}
+
+/* Sleeps until a ring gets its first message, then collects messages for
+ * RP_LOG_FLUSH_MS (or until a ring is half full) before writing them */
+static inline void *rp_log_flusher(void *arg)
+{
+    struct timespec ts;
+
+    while(!__atomic_load_n(&rp_log_state.stopping, __ATOMIC_ACQUIRE)) {
+        if(rp_log_pending()) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += RP_LOG_FLUSH_MS * 1000000L;
+            if(ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            sem_timedwait(&rp_log_state.wake, &ts);
+        } else {
+            sem_wait(&rp_log_state.wake);
+        }
+        rp_log_flush();
+    }
+    return NULL;
+}
+
+/* Ring of an exited thread can be reused, pending messages are kept */
+static inline void rp_log_release(void *ring)
+{
+    __atomic_store_n(&((rp_log_ring_t *)ring)->used, 0, __ATOMIC_RELEASE);
+}
+
+static inline void rp_log_atfork_prepare(void)
+{
+    pthread_mutex_lock(&rp_log_state.lock);
+}
+
+static inline void rp_log_atfork_parent(void)
+{
+    pthread_mutex_unlock(&rp_log_state.lock);
+}
+
+/* Only the forking thread survives: the flusher is restarted on the next
+ * message and messages pending in the parent are written by the parent */
+static inline void rp_log_atfork_child(void)
+{
+    rp_log_ring_t *r;
+
+    for(r = rp_log_state.rings; r; r = r->next) {
+        r->tail = r->head;
+        r->dropped = 0;
+        if(r != rp_log_tls)
+            r->used = 0;
+    }
+    rp_log_state.started = 0;
+    pthread_mutex_unlock(&rp_log_state.lock);
+}
+
+static inline void rp_log_stop(void);
+
+static inline void rp_log_start(void)
+{
+    pthread_mutex_lock(&rp_log_state.lock);
+    if(!rp_log_state.registered) {
+        pthread_atfork(rp_log_atfork_prepare, rp_log_atfork_parent, rp_log_atfork_child);
+        atexit(rp_log_stop);
+        rp_log_state.registered = 1;
+    }
+    if(!rp_log_state.initialized) {
+        pthread_key_create(&rp_log_state.key, rp_log_release);
+        sem_init(&rp_log_state.wake, 0, 0);
+        rp_log_state.initialized = 1;
+    }
+    if(!rp_log_state.started &&
+       pthread_create(&rp_log_state.thread, NULL, rp_log_flusher, NULL) == 0) {
+        rp_log_state.started = 1;
+    }
+    pthread_mutex_unlock(&rp_log_state.lock);
+}
+
+/* Writes all pending messages, stops and joins the flusher, deletes the key,
+ * frees the rings and closes the file of rp_log_open(). Must be called when
+ * no other thread logs any more, before exit or before the shared object
+ * using rp_log is unloaded - the flusher would run unmapped code otherwise.
+ * A later message starts logging (to syslog) again. */
+static inline void rp_log_stop(void)
+{
+    rp_log_ring_t *r, *next;
+
+    pthread_mutex_lock(&rp_log_state.lock);
+    if(rp_log_state.started) {
+        __atomic_store_n(&rp_log_state.stopping, 1, __ATOMIC_RELEASE);
+        sem_post(&rp_log_state.wake);
+        pthread_mutex_unlock(&rp_log_state.lock);
+        pthread_join(rp_log_state.thread, NULL);
+        pthread_mutex_lock(&rp_log_state.lock);
+        rp_log_state.stopping = 0;
+        rp_log_state.started = 0;
+    }
+    rp_log_drain();
+    if(rp_log_state.initialized) {
+        pthread_key_delete(rp_log_state.key);
+        sem_destroy(&rp_log_state.wake);
+        rp_log_state.initialized = 0;
+    }
+    for(r = rp_log_state.rings; r; r = next) {
+        next = r->next;
+        free(r);
+    }
+    rp_log_state.rings = NULL;
+    rp_log_state.epoch++;
+    rp_log_tls = NULL;
+    if(rp_log_state.file) {
+        fclose(rp_log_state.file);
+        rp_log_state.file = NULL;
+    }
+    pthread_mutex_unlock(&rp_log_state.lock);
+}
+
+/* Returns the ring of the calling thread, takes a free one or allocates it */
+static inline rp_log_ring_t *rp_log_ring(void)
+{
+    rp_log_ring_t *r = rp_log_tls;
+    uint32_t unused;
+
+    if(r && rp_log_tls_epoch != __atomic_load_n(&rp_log_state.epoch, __ATOMIC_RELAXED))
+        r = NULL;   // freed by rp_log_stop()
+    if(r && __atomic_load_n(&rp_log_state.started, __ATOMIC_RELAXED))
+        return r;
+
+    if(r == NULL) {
+        for(r = __atomic_load_n(&rp_log_state.rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+            unused = 0;
+            if(__atomic_compare_exchange_n(&r->used, &unused, 1, 0,
+                                           __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                break;
+        }
+        if(r == NULL) {
+            r = (rp_log_ring_t *)calloc(1, sizeof(rp_log_ring_t));
+            if(r == NULL)
+                return NULL;
+            r->used = 1;
+            r->next = __atomic_load_n(&rp_log_state.rings, __ATOMIC_RELAXED);
+            while(!__atomic_compare_exchange_n(&rp_log_state.rings, &r->next, r, 0,
+                                               __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+                ;
+        }
+        rp_log_tls = r;
+        rp_log_tls_epoch = __atomic_load_n(&rp_log_state.epoch, __ATOMIC_RELAXED);
+    }
+
+    rp_log_start();
+    pthread_setspecific(rp_log_state.key, r);
+    return r;
+}
+
+static inline void rp_log_vwrite(int level, const char *format, va_list va)
+{
+    rp_log_ring_t *r = rp_log_ring();
+    struct timespec now;
+    uint32_t head, tail;
+
+    if(r == NULL)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    if(now.tv_sec != r->refill) {
+        r->refill = now.tv_sec;
+        r->tokens = RP_LOG_RATE;
+    }
+
+    head = r->head;
+    tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    if(r->tokens == 0 || head - tail >= RP_LOG_RING_SIZE) {
+        __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    r->tokens--;
+
+    r->slot[head & (RP_LOG_RING_SIZE - 1)].level = level;
+    vsnprintf(r->slot[head & (RP_LOG_RING_SIZE - 1)].text, RP_LOG_MSG_MAX, format, va);
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+
+    if(head == tail || head + 1 - tail == RP_LOG_RING_SIZE / 2)
+        sem_post(&rp_log_state.wake);   // first message wakes the flusher, half full flushes now
+}
+
+static inline void rp_log_write(int level, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static inline void rp_log_write(int level, const char *format, ...)
+{
+    va_list va;
+
+    va_start(va, format);
+    rp_log_vwrite(level, format, va);
+    va_end(va);
+}
+
+/* Redirects messages to a file instead of syslog, returns 0 on success */
+static inline int rp_log_open(const char *path)
+{
+    FILE *file = fopen(path, "wt");
+
+    if(file == NULL)
+        return -1;
+
+    pthread_mutex_lock(&rp_log_state.lock);
+    rp_log_drain();
+    if(rp_log_state.file)
+        fclose(rp_log_state.file);
+    rp_log_state.file = file;
+    pthread_mutex_unlock(&rp_log_state.lock);
+    return 0;
+}
+
+#endif // __RP_LOG_H
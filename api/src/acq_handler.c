@@ -15,6 +15,9 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <math.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "common.h"
 #include "calib.h"
@@ -49,6 +52,14 @@ static rp_pinState_t gain_ch_b = RP_LOW;
 /* @brief Determines whether TriggerDelay was set in time or sample units */
 static bool triggerDelayInNs = false;
 
+/* @brief Trigger wait tuning - busy poll bounds and backoff sleep range [us]. */
+static const uint32_t WAIT_SPIN_MIN_US  = 20;
+static const uint32_t WAIT_SPIN_MAX_US  = 2000;
+static const uint32_t WAIT_SLEEP_MIN_US = 10;
+static const uint32_t WAIT_SLEEP_MAX_US = 5000;
+
+static rp_acq_wait_stats_t wait_stats;
+
 rp_acq_trig_src_t last_trig_src = RP_TRIG_SRC_DISABLED;
 
 /* @brief Default filter equalization coefficients */
@@ -362,6 +373,84 @@ int acq_GetTriggerState(rp_acq_trig_state_t* state)
     return RP_OK;
 }
 
+static uint64_t waitTimeUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool waitTriggered()
+{
+    bool triggered;
+    wait_stats.polls++;
+    osc_GetTriggerState(&triggered);
+    return triggered;
+}
+
+static void waitDone(uint64_t elapsed_us, uint32_t* hits)
+{
+    (*hits)++;
+    wait_stats.waits++;
+    wait_stats.total_us += elapsed_us;
+    wait_stats.max_us = MAX(wait_stats.max_us, (uint32_t)elapsed_us);
+    /* running average with weight 1/8 */
+    wait_stats.avg_us = wait_stats.avg_us - wait_stats.avg_us / 8 + (uint32_t)elapsed_us / 8;
+}
+
+int acq_WaitTrigger(uint32_t timeout_ms)
+{
+    uint64_t start = waitTimeUs();
+    uint64_t timeout_us = (uint64_t)timeout_ms * 1000;
+    uint64_t elapsed = 0;
+    uint32_t spin_us = MIN(MAX(2 * wait_stats.avg_us, WAIT_SPIN_MIN_US), WAIT_SPIN_MAX_US);
+    uint32_t sleep_us = WAIT_SLEEP_MIN_US;
+    int ret;
+
+    /* Short expected waits - busy poll */
+    while (elapsed < spin_us && elapsed <= timeout_us) {
+        if (waitTriggered()) {
+            waitDone(waitTimeUs() - start, &wait_stats.spin_hits);
+            return RP_OK;
+        }
+        elapsed = waitTimeUs() - start;
+    }
+
+    /* Longer waits - interrupt if available, otherwise exponential backoff */
+    while (elapsed < timeout_us) {
+        uint32_t chunk = (uint32_t)MIN((uint64_t)WAIT_SLEEP_MAX_US, timeout_us - elapsed);
+
+        wait_stats.sleeps++;
+        ret = cmn_WaitIrq(chunk);
+        if (ret == RP_EUF) {
+            usleep(MIN(sleep_us, chunk));
+            sleep_us = MIN(2 * sleep_us, WAIT_SLEEP_MAX_US);
+        }
+
+        if (waitTriggered()) {
+            waitDone(waitTimeUs() - start, ret == RP_EUF ? &wait_stats.sleep_hits : &wait_stats.irq_hits);
+            return RP_OK;
+        }
+        elapsed = waitTimeUs() - start;
+    }
+
+    wait_stats.timeouts++;
+    wait_stats.total_us += elapsed;
+    return RP_ETMO;
+}
+
+int acq_GetWaitStats(rp_acq_wait_stats_t* stats)
+{
+    *stats = wait_stats;
+    return RP_OK;
+}
+
+int acq_ResetWaitStats()
+{
+    memset(&wait_stats, 0, sizeof(wait_stats));
+    return RP_OK;
+}
+
 int acq_SetTriggerDelay(int32_t decimated_data_num, bool updateMaxValue)
 {
     int32_t trig_dly;
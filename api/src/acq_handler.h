@@ -34,6 +34,9 @@ int acq_GetAveraging(bool* enable);
 int acq_SetTriggerSrc(rp_acq_trig_src_t source);
 int acq_GetTriggerSrc(rp_acq_trig_src_t* source);
 int acq_GetTriggerState(rp_acq_trig_state_t* state);
+int acq_WaitTrigger(uint32_t timeout_ms);
+int acq_GetWaitStats(rp_acq_wait_stats_t* stats);
+int acq_ResetWaitStats();
 int acq_SetTriggerDelay(int32_t decimated_data_num, bool updateMaxValue);
 int acq_GetTriggerDelay(int32_t* decimated_data_num);
 int acq_SetTriggerDelayNs(int64_t time_ns, bool updateMaxValue);
@@ -13,7 +13,9 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include "redpitaya/rp.h"
 #include "common.h"
 #include "generate.h"
@@ -426,78 +428,172 @@ int calib_Reset() {
     return calib_Init();
 }
 
-int32_t calib_GetDataMedian(rp_channel_t channel, rp_pinState_t gain) {
-    /* Acquire data */
-    rp_AcqReset();
-    rp_AcqSetGain(channel, gain);
-    rp_AcqSetDecimation(RP_DEC_64);
-    rp_AcqStart();
-    rp_AcqSetTriggerSrc(RP_TRIG_SRC_NOW);
-    usleep(1000000);
-    rp_AcqStop();
+/* Measurement engine - acquires one full buffer at CALIB_ACQ_DEC and
+ * returns as soon as the hardware is done instead of sleeping a fixed time */
+#define CALIB_ACQ_DEC           RP_DEC_64
+#define CALIB_ACQ_SAMPLE_NS     8
+#define CALIB_ACQ_MARGIN_US     50
+#define CALIB_ACQ_TRIG_TMO_MS   100
 
-    int16_t data[BUFFER_LENGTH];
-    uint32_t bufferSize = (uint32_t) BUFFER_LENGTH;
-    rp_AcqGetDataRaw(channel, 0, &bufferSize, data);
-
-    long long avg = 0;
-    for(int i = 0; i < BUFFER_LENGTH; ++i)
-        avg += data[i];
-
-    avg /= BUFFER_LENGTH;
-    fprintf(stderr, "\ncalib_GetDataMedian: avg = %d\n", (int32_t)avg);
-    return avg;
+static uint64_t calib_TimeUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
-float calib_GetDataMedianFloat(rp_channel_t channel, rp_pinState_t gain) {
+static int calib_Acquire(rp_channel_t channel, rp_pinState_t gain)
+{
+    uint32_t dec, cnt, wp, wp_prev;
+    int32_t delay;
+    uint64_t smpl_ns, fill_us, post_us, deadline;
+    int ret = RP_OK;
+
     rp_AcqReset();
     rp_AcqSetGain(channel, gain);
-    rp_AcqSetDecimation(RP_DEC_64);
+    rp_AcqSetDecimation(CALIB_ACQ_DEC);
+    rp_AcqGetDecimationFactor(&dec);
+    smpl_ns = (uint64_t)CALIB_ACQ_SAMPLE_NS * dec;
+    fill_us = (ADC_BUFFER_SIZE * smpl_ns) / 1000;
     rp_AcqStart();
-    rp_AcqSetTriggerSrc(RP_TRIG_SRC_NOW);
-    usleep(1000000);
-    int BUF_SIZE = BUFFER_LENGTH;
 
-    rp_AcqStop();
+    /* Pre-trigger part - wait until the whole buffer holds fresh samples.
+     * The counter is bounded by twice the fill time in case it does not
+     * advance (old FPGA images), by then the buffer is full anyway. */
+    deadline = calib_TimeUs() + 2 * fill_us + CALIB_ACQ_MARGIN_US;
+    for(;;) {
+        if(rp_AcqGetPreTriggerCounter(&cnt) != RP_OK)
+            cnt = 0;
+        if(cnt >= ADC_BUFFER_SIZE || calib_TimeUs() >= deadline)
+            break;
+        usleep(((ADC_BUFFER_SIZE - cnt) * smpl_ns) / 1000 + CALIB_ACQ_MARGIN_US);
+    }
 
-    float data[BUF_SIZE];
-    uint32_t bufferSize = (uint32_t) BUF_SIZE;
-    rp_AcqGetDataV(channel, 0, &bufferSize, data);
+    rp_AcqSetTriggerSrc(RP_TRIG_SRC_NOW);
+    if(rp_AcqWaitTrigger(CALIB_ACQ_TRIG_TMO_MS) != RP_OK) {
+        fprintf(stderr, "calib_Acquire: trigger timeout\n");
+        ret = RP_ETMO;
+    }
 
-    double avg = 0;
-    for(int i = 0; i < BUFFER_LENGTH; ++i)
-        avg += data[i];
+    /* Post-trigger part - trigger delay plus half of the buffer are written
+     * after the trigger, then the write pointer stops */
+    rp_AcqGetTriggerDelay(&delay);
+    delay += ADC_BUFFER_SIZE / 2;
+    if(delay < 0)
+        delay = 0;
+    if(delay > ADC_BUFFER_SIZE)
+        delay = ADC_BUFFER_SIZE;
+    post_us = ((uint64_t)delay * smpl_ns) / 1000;
+    usleep(post_us + CALIB_ACQ_MARGIN_US);
+
+    deadline = calib_TimeUs() + post_us + fill_us;
+    rp_AcqGetWritePointer(&wp);
+    do {
+        wp_prev = wp;
+        usleep(CALIB_ACQ_MARGIN_US);
+        rp_AcqGetWritePointer(&wp);
+    } while(wp != wp_prev && calib_TimeUs() < deadline);
 
-    avg /= BUFFER_LENGTH;
-    fprintf(stderr, "\ncalib_GetDataMedianFloat: avg = %f\n", (float)avg);
-    return avg;
+    rp_AcqStop();
+    return ret;
 }
 
-int calib_GetDataMinMaxFloat(rp_channel_t channel, rp_pinState_t gain, float* min, float* max) {
-    rp_AcqReset();
-    rp_AcqSetGain(channel, gain);
-    rp_AcqSetDecimation(RP_DEC_64);
-    rp_AcqStart();
-    rp_AcqSetTriggerSrc(RP_TRIG_SRC_NOW);
-    usleep(1000000);
-    int BUF_SIZE = BUFFER_LENGTH;
-
-    rp_AcqStop();
+/* Returns the k-th smallest element, reorders data (quickselect with
+ * median-of-three pivot) */
+static float calib_Select(float* data, uint32_t size, uint32_t k)
+{
+    uint32_t lo = 0, hi = size - 1;
+
+    while(hi > lo) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        float t;
+        if(data[mid] < data[lo]) { t = data[mid]; data[mid] = data[lo]; data[lo] = t; }
+        if(data[hi]  < data[lo]) { t = data[hi];  data[hi]  = data[lo]; data[lo] = t; }
+        if(data[hi]  < data[mid]) { t = data[hi]; data[hi]  = data[mid]; data[mid] = t; }
+
+        float pivot = data[mid];
+        uint32_t i = lo, j = hi;
+        while(i <= j) {
+            while(data[i] < pivot) i++;
+            while(data[j] > pivot) j--;
+            if(i <= j) {
+                t = data[i]; data[i] = data[j]; data[j] = t;
+                i++;
+                if(j == 0)
+                    break;
+                j--;
+            }
+        }
+        if(k <= j)
+            hi = j;
+        else if(k >= i)
+            lo = i;
+        else
+            break;
+    }
+    return data[k];
+}
 
-    float data[BUF_SIZE];
-    uint32_t bufferSize = (uint32_t) BUF_SIZE;
-    rp_AcqGetDataV(channel, 0, &bufferSize, data);
+int calib_GetDataStats(rp_channel_t channel, rp_pinState_t gain, bool raw, calib_stats_t* stats)
+{
+    float data[BUFFER_LENGTH];
+    uint32_t size = BUFFER_LENGTH;
+    int ret = calib_Acquire(channel, gain);
+
+    if(raw) {
+        int16_t data_raw[BUFFER_LENGTH];
+        rp_AcqGetDataRaw(channel, 0, &size, data_raw);
+        for(uint32_t i = 0; i < size; ++i)
+            data[i] = data_raw[i];
+    } else {
+        rp_AcqGetDataV(channel, 0, &size, data);
+    }
+    if(size == 0) {
+        /* callers read the stats regardless */
+        memset(stats, 0, sizeof(*stats));
+        return RP_EOOR;
+    }
 
+    double sum = 0;
     float _min = data[0];
     float _max = data[0];
-    for(int i = 1; i < BUFFER_LENGTH; ++i) {
+    for(uint32_t i = 0; i < size; ++i) {
+        sum += data[i];
         _min = (_min > data[i]) ? data[i] : _min;
         _max = (_max < data[i]) ? data[i] : _max;
     }
 
-    fprintf(stderr, "\ncalib_GetDataMinMaxFloat: min = %f, max = %f\n", _min, _max);
-    *min = _min;
-    *max = _max;
+    stats->mean   = sum / size;
+    stats->min    = _min;
+    stats->max    = _max;
+    stats->median = calib_Select(data, size, size / 2);
+    return ret;
+}
+
+int32_t calib_GetDataMedian(rp_channel_t channel, rp_pinState_t gain) {
+    calib_stats_t stats;
+    calib_GetDataStats(channel, gain, true, &stats);
+
+    int32_t avg = (int32_t)stats.mean;
+    fprintf(stderr, "\ncalib_GetDataMedian: avg = %d\n", avg);
+    return avg;
+}
+
+float calib_GetDataMedianFloat(rp_channel_t channel, rp_pinState_t gain) {
+    calib_stats_t stats;
+    calib_GetDataStats(channel, gain, false, &stats);
+
+    fprintf(stderr, "\ncalib_GetDataMedianFloat: avg = %f\n", (float)stats.mean);
+    return stats.mean;
+}
+
+int calib_GetDataMinMaxFloat(rp_channel_t channel, rp_pinState_t gain, float* min, float* max) {
+    calib_stats_t stats;
+    calib_GetDataStats(channel, gain, false, &stats);
+
+    fprintf(stderr, "\ncalib_GetDataMinMaxFloat: min = %f, max = %f\n", stats.min, stats.max);
+    *min = stats.min;
+    *max = stats.max;
     return RP_OK;
 }
 
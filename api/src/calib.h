@@ -21,6 +21,14 @@
 
 #define CONSTANT_SIGNAL_AMPLITUDE 0.8
 
+/* Statistics of one calibration measurement (full buffer) */
+typedef struct {
+    double mean;
+    float  median;
+    float  min;
+    float  max;
+} calib_stats_t;
+
 int calib_Init();
 int calib_Release();
 
@@ -39,6 +47,7 @@ int calib_CalibrateBackEnd(rp_channel_t channel, rp_calib_params_t* out_params);
 
 int calib_Reset();
 
+int calib_GetDataStats(rp_channel_t channel, rp_pinState_t gain, bool raw, calib_stats_t* stats);
 int32_t calib_GetDataMedian(rp_channel_t channel, rp_pinState_t gain);
 float calib_GetDataMedianFloat(rp_channel_t channel, rp_pinState_t gain);
 int calib_GetDataMinMaxFloat(rp_channel_t channel, rp_pinState_t gain, float* min, float* max);
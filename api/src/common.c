@@ -14,6 +14,8 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <poll.h>
+#include <errno.h>
 #include <sys/mman.h>
 #include <stdio.h>
 #include <math.h>
@@ -21,6 +23,7 @@
 #include "common.h"
 
 static int fd = 0;
+static bool irq_unsupported = false;
 
 int cmn_Init()
 {
@@ -43,6 +46,48 @@ int cmn_Release()
     return RP_OK;
 }
 
+/**
+ * Waits for the UIO interrupt of the API device. Returns RP_EUF if the device
+ * has no interrupt (remembered, so later calls fail immediately) and RP_ETMO
+ * if the interrupt did not arrive in time.
+ */
+int cmn_WaitIrq(uint32_t timeout_us)
+{
+    uint32_t info = 1;
+    struct pollfd pfd;
+    int ret;
+
+    if (irq_unsupported || fd <= 0) {
+        return RP_EUF;
+    }
+
+    /* re-enable interrupt, generic UIO without IRQ rejects this */
+    if (write(fd, &info, sizeof(info)) != sizeof(info)) {
+        irq_unsupported = true;
+        return RP_EUF;
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    ret = poll(&pfd, 1, (timeout_us + 999) / 1000);
+    if (ret < 0) {
+        if (errno == EINTR) {
+            return RP_ETMO;
+        }
+        irq_unsupported = true;
+        return RP_EUF;
+    }
+    if (ret == 0) {
+        return RP_ETMO;
+    }
+
+    if (read(fd, &info, sizeof(info)) != sizeof(info)) {
+        irq_unsupported = true;
+        return RP_EUF;
+    }
+    return RP_OK;
+}
+
 int cmn_Map(size_t size, size_t offset, void** mapped)
 {
     if(fd == -1) {
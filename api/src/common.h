@@ -63,6 +63,8 @@ else { \
 int cmn_Init();
 int cmn_Release();
 
+int cmn_WaitIrq(uint32_t timeout_us);
+
 int cmn_Map(size_t size, size_t offset, void** mapped);
 int cmn_Unmap(size_t size, void** mapped);
 
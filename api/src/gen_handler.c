@@ -35,6 +35,10 @@ uint32_t      chA_arb_size = BUFFER_LENGTH, chB_arb_size = BUFFER_LENGTH;
 float chA_arbitraryData[BUFFER_LENGTH];
 float chB_arbitraryData[BUFFER_LENGTH];
 
+// Deferred synthesis (rp_GenDeferSynthesis), pending channels are synthesized on release
+static bool synth_deferred = false;
+static bool chA_synth_pending = false, chB_synth_pending = false;
+
 int gen_SetDefaultValues() {
     gen_Disable(RP_CH_1);
     gen_Disable(RP_CH_2);
@@ -191,6 +195,10 @@ int gen_getWaveform(rp_channel_t channel, rp_waveform_t *type) {
 }
 
 int gen_setArbWaveform(rp_channel_t channel, float *data, uint32_t length) {
+    if (length > BUFFER_LENGTH) {
+        return RP_EOOR;
+    }
+
     // Check if data is normalized
     float min = FLT_MAX, max = -FLT_MAX; // initial values
     int i;
@@ -235,6 +243,46 @@ int gen_setArbWaveform(rp_channel_t channel, float *data, uint32_t length) {
     return RP_OK;
 }
 
+int gen_setArbWaveformRaw(rp_channel_t channel, const int16_t *data, uint32_t length) {
+    const int16_t code_max = (1 << (DATA_BIT_LENGTH - 1)) - 1;
+    const float scale = AMPLITUDE_MAX / (float) (1 << (DATA_BIT_LENGTH - 1));
+    float *pointer, phase;
+    rp_waveform_t waveform;
+    int i;
+
+    if (length > BUFFER_LENGTH) {
+        return RP_EOOR;
+    }
+    for(i = 0; i < length; i++) {
+        if (data[i] > code_max || data[i] < -code_max - 1)
+            return RP_ENN;
+    }
+
+    // Keep normalized copy, it is used when the waveform is synthesized again
+    CHANNEL_ACTION(channel,
+            pointer = chA_arbitraryData,
+            pointer = chB_arbitraryData)
+    for(i = 0; i < length; i++) {
+        pointer[i] = data[i] * scale;
+    }
+    for(i = length; i < BUFFER_LENGTH; i++) { // clear the rest of the buffer
+        pointer[i] = 0;
+    }
+
+    CHANNEL_ACTION(channel,
+            chA_arb_size = length; waveform = chA_waveform; phase = chA_phase,
+            chB_arb_size = length; waveform = chB_waveform; phase = chB_phase)
+
+    // Codes are written to the DAC buffer directly, without synthesis
+    if (waveform == RP_WAVEFORM_ARBITRARY && synth_deferred) {
+        return synthesize_signal(channel);
+    }
+    if (waveform == RP_WAVEFORM_ARBITRARY) {
+        return generate_writeDataRaw(channel, data, (uint32_t) (phase * BUFFER_LENGTH / 360.0), length);
+    }
+    return RP_OK;
+}
+
 int gen_getArbWaveform(rp_channel_t channel, float *data, uint32_t *length) {
     // If this data was not set, then this method will return incorrect data
     float *pointer;
@@ -446,12 +494,38 @@ int gen_Synchronise() {
     return generate_Synchronise();
 }
 
+int gen_DeferSynthesis(bool defer) {
+    int result = RP_OK;
+
+    synth_deferred = defer;
+    if (!defer) {
+        if (chA_synth_pending) {
+            chA_synth_pending = false;
+            result = synthesize_signal(RP_CH_1);
+        }
+        if (chB_synth_pending) {
+            chB_synth_pending = false;
+            int resultB = synthesize_signal(RP_CH_2);
+            if (result == RP_OK)
+                result = resultB;
+        }
+    }
+    return result;
+}
+
 int synthesize_signal(rp_channel_t channel) {
     float data[BUFFER_LENGTH];
     rp_waveform_t waveform;
     float dutyCycle, frequency;
     uint32_t size, phase;
 
+    if (synth_deferred) {
+        CHANNEL_ACTION(channel,
+                chA_synth_pending = true,
+                chB_synth_pending = true)
+        return RP_OK;
+    }
+
     if (channel == RP_CH_1) {
         waveform = chA_waveform;
         dutyCycle = chA_dutyCycle;
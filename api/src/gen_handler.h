@@ -33,6 +33,7 @@ int gen_getPhase(rp_channel_t channel, float *phase);
 int gen_setWaveform(rp_channel_t channel, rp_waveform_t type);
 int gen_getWaveform(rp_channel_t channel, rp_waveform_t *type);
 int gen_setArbWaveform(rp_channel_t channel, float *data, uint32_t length);
+int gen_setArbWaveformRaw(rp_channel_t channel, const int16_t *data, uint32_t length);
 int gen_getArbWaveform(rp_channel_t channel, float *data, uint32_t *length);
 int gen_setDutyCycle(rp_channel_t channel, float ratio);
 int gen_getDutyCycle(rp_channel_t channel, float *ratio);
@@ -48,6 +49,7 @@ int gen_setTriggerSource(rp_channel_t chanel, rp_trig_src_t src);
 int gen_getTriggerSource(rp_channel_t chanel, rp_trig_src_t *src);
 int gen_Trigger(uint32_t channel);
 int gen_Synchronise();
+int gen_DeferSynthesis(bool defer);
 int triggerIfInternal(rp_channel_t channel);
 
 int synthesize_signal(rp_channel_t channel);
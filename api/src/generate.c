@@ -239,3 +239,19 @@ int generate_writeData(rp_channel_t channel, float *data, uint32_t start, uint32
     }
     return RP_OK;
 }
+
+int generate_writeDataRaw(rp_channel_t channel, const int16_t *data, uint32_t start, uint32_t length) {
+    volatile int32_t *dataOut;
+    CHANNEL_ACTION(channel,
+            dataOut = data_chA,
+            dataOut = data_chB)
+
+    generate_setWrapCounter(channel, length);
+
+    // Signed DAC codes only need the sign bits above DATA_BIT_LENGTH removed
+    const int32_t mask = (1 << DATA_BIT_LENGTH) - 1;
+    for(int i = 0; i < BUFFER_LENGTH; i++) {
+        dataOut[(start + i) % BUFFER_LENGTH] = (i < length) ? (data[i] & mask) : 0;
+    }
+    return RP_OK;
+}
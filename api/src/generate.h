@@ -109,5 +109,6 @@ int generate_simultaneousTrigger();
 int generate_Synchronise();
 
 int generate_writeData(rp_channel_t channel, float *data, uint32_t start, uint32_t length);
+int generate_writeDataRaw(rp_channel_t channel, const int16_t *data, uint32_t start, uint32_t length);
 
 #endif //__GENERATE_H
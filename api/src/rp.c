@@ -108,6 +108,7 @@ const char* rp_GetError(int errorCode) {
         case RP_EABA:  return "Failed to acquire bus access";
         case RP_EFRB:  return "Failed to read from the bus";
         case RP_EFWB:  return "Failed to write to the bus";
+        case RP_ETMO:  return "Timeout waiting for event";
         default:       return "Unknown error";
     }
 }
@@ -538,6 +539,21 @@ int rp_AcqGetTriggerState(rp_acq_trig_state_t* state)
     return acq_GetTriggerState(state);
 }
 
+int rp_AcqWaitTrigger(uint32_t timeout_ms)
+{
+    return acq_WaitTrigger(timeout_ms);
+}
+
+int rp_AcqGetWaitStats(rp_acq_wait_stats_t* stats)
+{
+    return acq_GetWaitStats(stats);
+}
+
+int rp_AcqResetWaitStats()
+{
+    return acq_ResetWaitStats();
+}
+
 int rp_AcqSetTriggerDelay(int32_t decimated_data_num)
 {
     return acq_SetTriggerDelay(decimated_data_num, false);
@@ -744,6 +760,10 @@ int rp_GenArbWaveform(rp_channel_t channel, float *waveform, uint32_t length) {
     return gen_setArbWaveform(channel, waveform, length);
 }
 
+int rp_GenArbWaveformRaw(rp_channel_t channel, const int16_t *waveform, uint32_t length) {
+    return gen_setArbWaveformRaw(channel, waveform, length);
+}
+
 int rp_GenGetArbWaveform(rp_channel_t channel, float *waveform, uint32_t *length) {
     return gen_getArbWaveform(channel, waveform, length);
 }
@@ -800,6 +820,10 @@ int rp_GenTrigger(uint32_t channel) {
     return gen_Trigger(channel);
 }
 
+int rp_GenDeferSynthesis(bool defer) {
+    return gen_DeferSynthesis(defer);
+}
+
 float rp_CmnCnvCntToV(uint32_t field_len, uint32_t cnts, float adc_max_v, uint32_t calibScale, int calib_dc_off, float user_dc_off)
 {
 	return cmn_CnvCntToV(field_len, cnts, adc_max_v, calibScale, calib_dc_off, user_dc_off);
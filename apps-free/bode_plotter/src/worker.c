@@ -22,17 +22,17 @@
 #include <limits.h>
 
 #include "worker.h"
+#include "params_snap.h"
 #include "fpga.h"
 
 pthread_t *rp_osc_thread_handler = NULL;
 void *rp_osc_worker_thread(void *args);
 
 
-pthread_mutex_t       rp_osc_ctrl_mutex = PTHREAD_MUTEX_INITIALIZER;
 rp_osc_worker_state_t rp_osc_ctrl;
 rp_app_params_t       *rp_osc_params = NULL;
-int                   rp_osc_params_dirty;
-int                   rp_osc_params_fpga_update; //LukaG?
+rp_params_snap_t      rp_osc_params_snap;
+uint32_t              rp_osc_params_seq = 0; /* last snapshot read by worker */
 
 pthread_mutex_t       rp_osc_sig_mutex = PTHREAD_MUTEX_INITIALIZER;//Worker mutex
 float               **rp_osc_signals;
@@ -56,11 +56,11 @@ int rp_osc_worker_init(rp_app_params_t *params, int params_len,
     int ret_val;
 
     rp_osc_ctrl               = rp_osc_idle_state;
-    rp_osc_params_dirty       = 0;
-    rp_osc_params_fpga_update = 0;
-
     /* First copy of main params from main.c */
     rp_copy_params(params, (rp_app_params_t **)&rp_osc_params);
+    if(rp_params_snap_init(&rp_osc_params_snap, PARAMS_NUM) < 0)
+        return -1;
+    rp_osc_params_seq = 0;
 
     /* First cleans up the params, case mem is already allocated */
     rp_cleanup_signals(&rp_osc_signals);
@@ -141,6 +141,7 @@ int rp_osc_worker_exit(void)
     rp_cleanup_signals(&rp_tmp_signals);
 
     rp_clean_params(rp_osc_params);
+    rp_params_snap_clean(&rp_osc_params_snap);
 
     return 0;
 }
@@ -153,9 +154,7 @@ int rp_osc_worker_change_state(rp_osc_worker_state_t new_state)
 {
     if(new_state >= rp_osc_nonexisting_state)
         return -1;
-    pthread_mutex_lock(&rp_osc_ctrl_mutex);
-    rp_osc_ctrl = new_state;
-    pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+    rp_worker_state_set(rp_osc_ctrl, new_state);
     return 0;
 }
 
@@ -165,9 +164,7 @@ int rp_osc_worker_change_state(rp_osc_worker_state_t new_state)
 /* This functions gets the current worker state */
 int rp_osc_worker_get_state(rp_osc_worker_state_t *state)
 {
-    pthread_mutex_lock(&rp_osc_ctrl_mutex);
-    *state = rp_osc_ctrl;
-    pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+    *state = rp_worker_state_get(rp_osc_ctrl);
     return 0;
 }
 
@@ -175,18 +172,7 @@ int rp_osc_worker_get_state(rp_osc_worker_state_t *state)
 /*----------------------------------------------------------------------------------*/
 int rp_osc_worker_update_params(rp_app_params_t *params, int fpga_update)
 {
-    pthread_mutex_lock(&rp_osc_ctrl_mutex);
-    rp_copy_params(params, (rp_app_params_t **)&rp_osc_params);
-    rp_osc_params_dirty       = 1;
-
-    /* LG - FPGA TODO */
-    rp_osc_params_fpga_update = fpga_update;
-
-    /* Name of idx at PARAMS_NUM is already NULL, why redefine it ? Error check -> Is it possible, to change the last param in worker? */
-    rp_osc_params[PARAMS_NUM].name = NULL;
-    rp_osc_params[PARAMS_NUM].value = -1;
-
-    pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+    rp_params_snap_publish(&rp_osc_params_snap, params, fpga_update);
     return 0;
 }
 
@@ -284,9 +270,11 @@ void *rp_osc_worker_thread(void *args)
     float ch1_max_adc_v = 1, ch2_max_adc_v = 1;
     float max_adc_norm = osc_fpga_calc_adc_max_v(rp_calib_params->fe_ch1_fs_g_hi, 0);
 
-    pthread_mutex_lock(&rp_osc_ctrl_mutex);
-    old_state = state = rp_osc_ctrl;
-    pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+    /* Allocate worker copy of parameters, values come from the snapshot */
+    if(rp_copy_params(rp_osc_params, (rp_app_params_t **)&curr_params) < 0)
+        return 0;
+
+    old_state = state = rp_worker_state_get(rp_osc_ctrl);
 
 
     while(1) {
@@ -348,15 +336,11 @@ void *rp_osc_worker_thread(void *args)
         }
 
         old_state = state;
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        state = rp_osc_ctrl;
+        state = rp_worker_state_get(rp_osc_ctrl);
 
         /* If there are no new params */
-        if(rp_osc_params_dirty) {
-            rp_copy_params(rp_osc_params, (rp_app_params_t **)&curr_params);
-            fpga_update = rp_osc_params_fpga_update;
-
-            rp_osc_params_dirty = 0;
+        if(rp_params_snap_read(&rp_osc_params_snap, curr_params,
+                               &rp_osc_params_seq, &fpga_update)) {
 
             dec_factor = 
                 osc_fpga_cnv_time_range_to_dec(curr_params[TIME_RANGE_PARAM].value);
@@ -376,7 +360,6 @@ void *rp_osc_worker_thread(void *args)
                     osc_fpga_calc_adc_max_v(fe_fsg2, (int)curr_params[PRB_ATT_CH2].value);
         }
 
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
 
         /* request to stop worker thread, we will shut down */
         if(state == rp_osc_quit_state) {
@@ -502,9 +485,7 @@ void *rp_osc_worker_thread(void *args)
         }
 
         /* start working */
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        old_state = state = rp_osc_ctrl;
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+        old_state = state = rp_worker_state_get(rp_osc_ctrl);
         if((state == rp_osc_idle_state) || (state == rp_osc_abort_state)) {
             continue;
         } else if(state == rp_osc_quit_state) {
@@ -514,10 +495,8 @@ void *rp_osc_worker_thread(void *args)
         if(long_acq_idx == 0) {
             /* polling until data is ready */
             while(1) {
-                pthread_mutex_lock(&rp_osc_ctrl_mutex);
-                state = rp_osc_ctrl;
-                params_dirty = rp_osc_params_dirty;
-                pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+                state = rp_worker_state_get(rp_osc_ctrl);
+                params_dirty = rp_params_snap_pending(&rp_osc_params_snap, rp_osc_params_seq);
                 /* change in state, abort polling */
                 if((state != old_state) || params_dirty) {
                     break;
@@ -590,10 +569,8 @@ void *rp_osc_worker_thread(void *args)
             usleep(long_acq_part_delay); /* Sleep for 200 [ms] */
         }
 
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        state = rp_osc_ctrl;
-        params_dirty = rp_osc_params_dirty;
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+        state = rp_worker_state_get(rp_osc_ctrl);
+        params_dirty = rp_params_snap_pending(&rp_osc_params_snap, rp_osc_params_seq);
 
         if((state != old_state) || params_dirty)
             continue;
@@ -636,9 +613,7 @@ void *rp_osc_worker_thread(void *args)
         }
 
         /* check again for change of state */
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        state = rp_osc_ctrl;
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+        state = rp_worker_state_get(rp_osc_ctrl);
 
         /* We have acquisition - if we are in single put state machine
          * to idle */
@@ -920,9 +895,7 @@ int rp_osc_auto_set(rp_app_params_t *orig_params,
 
     for (iter=0; iter < 10; iter++) {
         /* 10 auto-trigger acquisitions */
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        old_state = state = rp_osc_ctrl;
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+        old_state = state = rp_worker_state_get(rp_osc_ctrl);
 
         osc_fpga_reset();
         osc_fpga_update_params(1, 0, 0, 0, 0, time_range, ch1_max_adc_v, ch2_max_adc_v,
@@ -938,10 +911,8 @@ int rp_osc_auto_set(rp_app_params_t *orig_params,
 
         /* Wait for trigger to finish */
         while(1) {
-            pthread_mutex_lock(&rp_osc_ctrl_mutex);
-            state = rp_osc_ctrl;
-            params_dirty = rp_osc_params_dirty;
-            pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+            state = rp_worker_state_get(rp_osc_ctrl);
+            params_dirty = rp_params_snap_pending(&rp_osc_params_snap, rp_osc_params_seq);
             /* change in state, abort polling */
             if((state != old_state) || params_dirty) {
                 return -1;
@@ -1106,10 +1077,8 @@ int rp_osc_auto_set(rp_app_params_t *orig_params,
             /* Wait for trigger */
             /* Wait for trigger to finish */
             while(1) {
-                pthread_mutex_lock(&rp_osc_ctrl_mutex);
-                state = rp_osc_ctrl;
-                params_dirty = rp_osc_params_dirty;
-                pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+                state = rp_worker_state_get(rp_osc_ctrl);
+                params_dirty = rp_params_snap_pending(&rp_osc_params_snap, rp_osc_params_seq);
 
                 /* change in state, abort polling */
                 if((state != old_state) || params_dirty) {
@@ -0,0 +1,128 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya lock-free application parameter snapshot.
+ *
+ * Sequence lock protected copy of application parameter values, shared by
+ * the apps-free controllers. rp_set_params() publishes new values with
+ * rp_params_snap_publish(), worker threads fetch a consistent set with
+ * rp_params_snap_read() without taking a mutex or allocating memory.
+ *
+ * The rp_app_params_t structure must be declared (main.h) before this
+ * header is included - it is the same for all RP controllers.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __PARAMS_SNAP_H
+#define __PARAMS_SNAP_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Parameter snapshot - seq is odd while a writer is updating the values */
+typedef struct rp_params_snap_s {
+    uint32_t  seq;
+    int       num;
+    int       flags;
+    float    *values;
+} rp_params_snap_t;
+
+/* Allocates snapshot for num parameter values, seq starts at 0 so readers
+ * starting with last_seq = 0 see nothing pending until the first publish */
+static inline int rp_params_snap_init(rp_params_snap_t *snap, int num)
+{
+    snap->seq    = 0;
+    snap->num    = num;
+    snap->flags  = 0;
+    snap->values = (float *)calloc(num, sizeof(float));
+    if(snap->values == NULL) {
+        fprintf(stderr, "rp_params_snap_init() can not allocate mem\n");
+        snap->num = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static inline void rp_params_snap_clean(rp_params_snap_t *snap)
+{
+    if(snap->values) {
+        free(snap->values);
+        snap->values = NULL;
+    }
+    snap->num = 0;
+}
+
+/* Publishes values of src (terminated by NULL name or snap->num entries)
+ * together with a user flags word. Concurrent writers are serialized by
+ * moving seq from even to odd, so no external mutex is needed. */
+static inline void rp_params_snap_publish(rp_params_snap_t *snap,
+                                          const rp_app_params_t *src, int flags)
+{
+    uint32_t seq;
+    int i;
+
+    do {
+        seq = __atomic_load_n(&snap->seq, __ATOMIC_RELAXED);
+    } while((seq & 1) ||
+            !__atomic_compare_exchange_n(&snap->seq, &seq, seq + 1, 0,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    for(i = 0; (i < snap->num) && (src[i].name != NULL); i++)
+        ((volatile float *)snap->values)[i] = src[i].value;
+    ((volatile int *)&snap->flags)[0] = flags;
+
+    __atomic_store_n(&snap->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Returns non-zero if values were published since last_seq was read */
+static inline int rp_params_snap_pending(rp_params_snap_t *snap,
+                                         uint32_t last_seq)
+{
+    return __atomic_load_n(&snap->seq, __ATOMIC_ACQUIRE) != last_seq;
+}
+
+/* Copies the latest published values to dst, which must hold snap->num
+ * entries (names of dst are left intact), and returns 1, or returns 0 if
+ * nothing changed since *last_seq. The copy is retried if a writer
+ * interfered, flags are optional (may be NULL). */
+static inline int rp_params_snap_read(rp_params_snap_t *snap,
+                                      rp_app_params_t *dst,
+                                      uint32_t *last_seq, int *flags)
+{
+    uint32_t s1, s2;
+    int i, f;
+
+    if(!rp_params_snap_pending(snap, *last_seq))
+        return 0;
+
+    do {
+        while((s1 = __atomic_load_n(&snap->seq, __ATOMIC_ACQUIRE)) & 1)
+            ;
+        for(i = 0; i < snap->num; i++)
+            dst[i].value = ((volatile float *)snap->values)[i];
+        f = ((volatile int *)&snap->flags)[0];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&snap->seq, __ATOMIC_RELAXED);
+    } while(s1 != s2);
+
+    if(flags)
+        *flags = f;
+    *last_seq = s1;
+    return 1;
+}
+
+/* Worker control state word, written by the controller and polled by the
+ * worker loop on every iteration - plain atomics, no mutex */
+#define rp_worker_state_get(ctrl) \
+    __atomic_load_n(&(ctrl), __ATOMIC_ACQUIRE)
+#define rp_worker_state_set(ctrl, state) \
+    __atomic_store_n(&(ctrl), (state), __ATOMIC_RELEASE)
+
+#endif // __PARAMS_SNAP_H
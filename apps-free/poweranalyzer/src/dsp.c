@@ -41,6 +41,13 @@ double            *rp_dft_out_re_U = NULL;
 double            *rp_dft_out_im_U = NULL;
 double            *rp_dft_out_re_I = NULL;
 double            *rp_dft_out_im_I = NULL; 
+double            *rp_sync_buf_U   = NULL;
+double            *rp_sync_buf_I   = NULL;
+kiss_fft_cpx      *rp_sync_out_U   = NULL;
+kiss_fft_cpx      *rp_sync_out_I   = NULL;
+kiss_fftr_cfg      rp_sync_fft_cfg = NULL;
+int                rp_sync_fft_len = 0;
+int                rp_sync_max_len = 0;
 
 const double PI2 = 2 * M_PI;
 
@@ -276,6 +283,155 @@ int rp_pwr_dft(double *cha_in, double *chb_in, int length, float rel_freq,
      return 0;
 }     
 
+int rp_pwr_sync_init(int max_length)
+{
+    rp_pwr_sync_clean();
+
+    rp_sync_buf_U = (double *)malloc(sizeof(double) * max_length);
+    rp_sync_buf_I = (double *)malloc(sizeof(double) * max_length);
+    rp_sync_out_U = (kiss_fft_cpx *)malloc(sizeof(kiss_fft_cpx) * (max_length / 2 + 1));
+    rp_sync_out_I = (kiss_fft_cpx *)malloc(sizeof(kiss_fft_cpx) * (max_length / 2 + 1));
+
+    if(!rp_sync_buf_U || !rp_sync_buf_I || !rp_sync_out_U || !rp_sync_out_I) {
+        fprintf(stderr, "rp_pwr_sync_init() can not allocate mem");
+        rp_pwr_sync_clean();
+        return -1;
+    }
+    rp_sync_max_len = max_length;
+
+    return 0;
+}
+
+int rp_pwr_sync_clean()
+{
+    if(rp_sync_buf_U) {
+        free(rp_sync_buf_U);
+        rp_sync_buf_U = NULL;
+    }
+    if(rp_sync_buf_I) {
+        free(rp_sync_buf_I);
+        rp_sync_buf_I = NULL;
+    }
+    if(rp_sync_out_U) {
+        free(rp_sync_out_U);
+        rp_sync_out_U = NULL;
+    }
+    if(rp_sync_out_I) {
+        free(rp_sync_out_I);
+        rp_sync_out_I = NULL;
+    }
+    if(rp_sync_fft_cfg) {
+        free(rp_sync_fft_cfg);
+        rp_sync_fft_cfg = NULL;
+    }
+    rp_sync_fft_len = 0;
+    rp_sync_max_len = 0;
+
+    return 0;
+}
+
+/* 4-point cubic (Catmull-Rom) resampling of length_out samples starting at
+ * position start with a constant step. Positions are computed directly from
+ * the index (no accumulated error) and the loop body is branch free, so the
+ * compiler can vectorize it. Caller guarantees 1 <= pos < length_in - 2. */
+static void rp_pwr_sync_resample(const double * restrict in_a,
+                                 const double * restrict in_b,
+                                 double * restrict out_a,
+                                 double * restrict out_b,
+                                 int length_out, double start, double step)
+{
+    int i;
+
+    for(i = 0; i < length_out; i++) {
+        double pos = start + i * step;
+        int    n   = (int)pos;
+        double t   = pos - n;
+        double t2  = t * t;
+        double t3  = t2 * t;
+        double c0  = -0.5 * t3 + t2 - 0.5 * t;
+        double c1  =  1.5 * t3 - 2.5 * t2 + 1.0;
+        double c2  = -1.5 * t3 + 2.0 * t2 + 0.5 * t;
+        double c3  =  0.5 * t3 - 0.5 * t2;
+
+        out_a[i] = c0 * in_a[n - 1] + c1 * in_a[n] +
+                   c2 * in_a[n + 1] + c3 * in_a[n + 2];
+        out_b[i] = c0 * in_b[n - 1] + c1 * in_b[n] +
+                   c2 * in_b[n + 1] + c3 * in_b[n + 2];
+    }
+}
+
+/* Evaluates pwr_dft_harmonic_num harmonics of both channels. The last whole
+ * number of periods in the buffer (period given in samples) is resampled to
+ * the next power-of-two length, so every harmonic falls exactly on an FFT bin
+ * and no window is needed. Harmonics past harm_count or above the resampled
+ * Nyquist frequency are reported as zero. */
+int rp_pwr_sync_dft(double *cha_in, double *chb_in, int length, double period,
+                    int harm_count, double *amp_U, double *amp_I,
+                    double *fi_U, double *fi_I)
+{
+    int    periods;
+    int    n_sync;
+    int    bin;
+    int    k;
+    double span;
+    double start;
+
+    if(!cha_in || !chb_in || !amp_U || !amp_I || !fi_U || !fi_I)
+        return -1;
+
+    if(!rp_sync_buf_U || !rp_sync_buf_I || !rp_sync_out_U || !rp_sync_out_I) {
+        fprintf(stderr, "rp_pwr_sync_dft not initialized");
+        return -1;
+    }
+
+    /* Keep one sample before and two after the span for the cubic kernel */
+    periods = (int)floor((length - 3) / period);
+    if(periods < 1)
+        return -1;
+    span = periods * period;
+
+    for(n_sync = 2; n_sync < span && n_sync < rp_sync_max_len; n_sync <<= 1)
+        ;
+
+    if(n_sync != rp_sync_fft_len) {
+        if(rp_sync_fft_cfg)
+            free(rp_sync_fft_cfg);
+        rp_sync_fft_cfg = kiss_fftr_alloc(n_sync, 0, NULL, NULL);
+        if(!rp_sync_fft_cfg) {
+            rp_sync_fft_len = 0;
+            return -1;
+        }
+        rp_sync_fft_len = n_sync;
+    }
+
+    start = length - 2 - span;
+    rp_pwr_sync_resample(cha_in, chb_in, rp_sync_buf_U, rp_sync_buf_I,
+                         n_sync, start, span / n_sync);
+
+    kiss_fftr(rp_sync_fft_cfg, (kiss_fft_scalar *)rp_sync_buf_U, rp_sync_out_U);
+    kiss_fftr(rp_sync_fft_cfg, (kiss_fft_scalar *)rp_sync_buf_I, rp_sync_out_I);
+
+    for(k = 0; k < pwr_dft_harmonic_num; k++) {
+        bin = (k + 1) * periods;
+        if((k >= harm_count) || (bin >= n_sync / 2)) {
+            amp_U[k] = 0;
+            amp_I[k] = 0;
+            fi_U[k] = 0;
+            fi_I[k] = 0;
+            continue;
+        }
+
+        amp_U[k] = sqrt(pow(rp_sync_out_U[bin].r, 2) +
+                        pow(rp_sync_out_U[bin].i, 2)) * 2 / n_sync;
+        amp_I[k] = sqrt(pow(rp_sync_out_I[bin].r, 2) +
+                        pow(rp_sync_out_I[bin].i, 2)) * 2 / n_sync;
+        fi_U[k] = atan2(rp_sync_out_U[bin].i, rp_sync_out_U[bin].r);
+        fi_I[k] = atan2(rp_sync_out_I[bin].i, rp_sync_out_I[bin].r);
+    }
+
+    return 0;
+}
+
 double rp_pwr_calc_d(double max_amp_bin_1, double max_amp_bin_2, 
                      double max_amp_bin_3)
 {
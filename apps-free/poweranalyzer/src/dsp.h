@@ -40,6 +40,15 @@ int rp_pwr_dft_clean(void);
 int rp_pwr_dft(double *cha_in, double *chb_in, int length, float rel_freq, 
                double *amp_U, double *amp_I, double *fi_U, double *fi_I);
                
+/* Synchronous harmonic analysis - resamples an integer number of fundamental
+ * periods to a power-of-two length and evaluates the harmonics with one FFT */
+int rp_pwr_sync_init(int max_length);
+int rp_pwr_sync_clean(void);
+
+int rp_pwr_sync_dft(double *cha_in, double *chb_in, int length, double period,
+                    int harm_count, double *amp_U, double *amp_I,
+                    double *fi_U, double *fi_I);
+
 double rp_pwr_calc_d(double max_amp_bin_1, double max_amp_bin_2, 
                      double max_amp_bin_3);
                      
@@ -22,6 +22,7 @@
 #include <limits.h>
 
 #include "worker.h"
+#include "params_snap.h"
 #include "fpga.h"
 #include "house_kp.h"
  #include "dsp.h"
@@ -34,12 +35,11 @@ void *rp_pwr_dsp_thread(void *args);
 extern const int pwr_dft_harmonic_num;
 extern const int c_dsp_sig_len;
 
-pthread_mutex_t       rp_pwr_ctrl_mutex = PTHREAD_MUTEX_INITIALIZER;
 rp_pwr_worker_state_t rp_pwr_ctrl;
 rp_app_params_t       *rp_pwr_params = NULL;
-int                   rp_pwr_params_dirty;
-int                   rp_pwr_dsp_params_dirty;
-int                   rp_pwr_params_fpga_update;
+rp_params_snap_t      rp_pwr_params_snap;
+uint32_t              rp_pwr_params_seq = 0;     /* last snapshot read by worker */
+uint32_t              rp_pwr_dsp_params_seq = 0; /* last snapshot read by DSP */
 
 pthread_mutex_t       rp_pwr_sig_mutex = PTHREAD_MUTEX_INITIALIZER;
 float               **rp_pwr_signals;
@@ -88,11 +88,11 @@ int rp_pwr_worker_init(rp_app_params_t *params, int params_len,
     int ret_val_2;
 
     rp_pwr_ctrl               = rp_pwr_idle_state;
-    rp_pwr_params_dirty       = 0;
-    rp_pwr_dsp_params_dirty   = 0;
-    rp_pwr_params_fpga_update = 0;
-
     rp_copy_params(params, (rp_app_params_t **)&rp_pwr_params);
+    if(rp_params_snap_init(&rp_pwr_params_snap, PARAMS_NUM) < 0)
+        return -1;
+    rp_pwr_params_seq     = 0;
+    rp_pwr_dsp_params_seq = 0;
 
     rp_cleanup_signals(&rp_pwr_signals);
     if(rp_create_signals(&rp_pwr_signals) < 0)
@@ -148,6 +148,11 @@ int rp_pwr_worker_init(rp_app_params_t *params, int params_len,
         return -1;
     }
 
+    if(rp_pwr_sync_init(PWR_FPGA_SIG_LEN) < 0) {
+        rp_pwr_worker_clean();
+        return -1;
+    }
+
     rp_calib_params = calib_params;
 
     pwr_fpga_get_sig_ptr(&rp_fpga_cha_signal, &rp_fpga_chb_signal);
@@ -189,6 +194,7 @@ int rp_pwr_worker_clean(void)
     rp_pwr_hann_clean();
     rp_pwr_fft_clean();
     rp_pwr_dft_clean();
+    rp_pwr_sync_clean();
     
     if(rp_cha_buffer) {
         free(rp_cha_buffer);
@@ -278,6 +284,7 @@ int rp_pwr_worker_exit(void)
     rp_pwr_worker_clean();
 
     rp_clean_params(rp_pwr_params);
+    rp_params_snap_clean(&rp_pwr_params_snap);
 
     return 0;
 }
@@ -288,9 +295,7 @@ int rp_pwr_worker_change_state(rp_pwr_worker_state_t new_state)
 {
     if(new_state >= rp_pwr_nonexisting_state)
         return -1;
-    pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-    rp_pwr_ctrl = new_state;
-    pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+    rp_worker_state_set(rp_pwr_ctrl, new_state);
     return 0;
 }
 
@@ -298,9 +303,7 @@ int rp_pwr_worker_change_state(rp_pwr_worker_state_t new_state)
 /*----------------------------------------------------------------------------------*/
 int rp_pwr_worker_get_state(rp_pwr_worker_state_t *state)
 {
-    pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-    *state = rp_pwr_ctrl;
-    pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+    *state = rp_worker_state_get(rp_pwr_ctrl);
     return 0;
 }
 
@@ -308,15 +311,7 @@ int rp_pwr_worker_get_state(rp_pwr_worker_state_t *state)
 /*----------------------------------------------------------------------------------*/
 int rp_pwr_worker_update_params(rp_app_params_t *params, int fpga_update)
 {
-    pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-    rp_copy_params(params, (rp_app_params_t **)&rp_pwr_params);
-    rp_pwr_params_dirty       = 1;
-    rp_pwr_dsp_params_dirty   = 1;
-    rp_pwr_params_fpga_update = fpga_update;
-    rp_pwr_params[PARAMS_NUM].name = NULL;
-    rp_pwr_params[PARAMS_NUM].value = -1;
-
-    pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+    rp_params_snap_publish(&rp_pwr_params_snap, params, fpga_update);
     return 0;
 }
 
@@ -474,9 +469,11 @@ void *rp_pwr_worker_thread(void *args)
     float ch1_max_adc_v = 1, ch2_max_adc_v = 1;
     float max_adc_norm = pwr_fpga_calc_adc_max_v(rp_calib_params->fe_ch1_fs_g_lo);
 
-    pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-    old_state = state = rp_pwr_ctrl;
-    pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+    /* Allocate worker copy of parameters, values come from the snapshot */
+    if(rp_copy_params(rp_pwr_params, (rp_app_params_t **)&curr_params) < 0)
+        return 0;
+
+    old_state = state = rp_worker_state_get(rp_pwr_ctrl);
 
 
     while(1) {
@@ -484,16 +481,13 @@ void *rp_pwr_worker_thread(void *args)
          * FPGA 
          */
         old_state = state;
-        pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-        state = rp_pwr_ctrl;
-        if(rp_pwr_params_dirty) {
+        state = rp_worker_state_get(rp_pwr_ctrl);
+
+        if(rp_params_snap_read(&rp_pwr_params_snap, curr_params,
+                               &rp_pwr_params_seq, &fpga_update)) {
 			pthread_mutex_lock(&rp_pwr_dsp_sig_mutex);
 	        rp_pwr_dsp_sig_ready = 0;
             pthread_mutex_unlock(&rp_pwr_dsp_sig_mutex);
-            rp_copy_params(rp_pwr_params, (rp_app_params_t **)&curr_params);
-            fpga_update = rp_pwr_params_fpga_update;
-
-            rp_pwr_params_dirty = 0;
             time_range = curr_params[TIME_RANGE_PARAM].value;
             dec_factor = pwr_fpga_cnv_time_range_to_dec(time_range);
             if (time_range == 6) {
@@ -518,7 +512,6 @@ void *rp_pwr_worker_thread(void *args)
             ch2_max_adc_v =
                     pwr_fpga_calc_adc_max_v(fe_fsg2);
         }
-        pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
 
         /* request to stop worker thread, we will shut down */
         if(state == rp_pwr_quit_state) {
@@ -644,9 +637,7 @@ void *rp_pwr_worker_thread(void *args)
         }
 
         /* start working */
-        pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-        old_state = state = rp_pwr_ctrl;
-        pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+        old_state = state = rp_worker_state_get(rp_pwr_ctrl);
         if((state == rp_pwr_idle_state) || (state == rp_pwr_abort_state)) {
             continue;
         } else if(state == rp_pwr_quit_state) {
@@ -656,10 +647,8 @@ void *rp_pwr_worker_thread(void *args)
         if(long_acq_idx == 0) {
             /* polling until data is ready */
             while(1) {
-                pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-                state = rp_pwr_ctrl;
-                params_dirty = rp_pwr_params_dirty;
-                pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+                state = rp_worker_state_get(rp_pwr_ctrl);
+                params_dirty = rp_params_snap_pending(&rp_pwr_params_snap, rp_pwr_params_seq);
                 /* change in state, abort polling */
                 if((state != old_state) || params_dirty) {
                     break;
@@ -732,10 +721,8 @@ void *rp_pwr_worker_thread(void *args)
             usleep(long_acq_part_delay); /* Sleep for 200 [ms] */
         }
 
-        pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-        state = rp_pwr_ctrl;
-        params_dirty = rp_pwr_params_dirty;
-        pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+        state = rp_worker_state_get(rp_pwr_ctrl);
+        params_dirty = rp_params_snap_pending(&rp_pwr_params_snap, rp_pwr_params_seq);
 
         if((state != old_state) || params_dirty)
             continue;
@@ -790,9 +777,7 @@ void *rp_pwr_worker_thread(void *args)
         }
 
         /* check again for change of state */
-        pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-        state = rp_pwr_ctrl;
-        pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+        state = rp_worker_state_get(rp_pwr_ctrl);
 
         /* We have acquisition - if we are in single put state machine
          * to idle */
@@ -1097,9 +1082,7 @@ int rp_pwr_auto_set(rp_app_params_t *orig_params,
 
     for (iter=0; iter < 10; iter++) {
         /* 10 auto-trigger acquisitions */
-        pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-        old_state = state = rp_pwr_ctrl;
-        pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+        old_state = state = rp_worker_state_get(rp_pwr_ctrl);
 
         pwr_fpga_reset();
         pwr_fpga_update_params(1, 0, 0, 0, 0, time_range, ch1_max_adc_v, ch2_max_adc_v,
@@ -1115,10 +1098,8 @@ int rp_pwr_auto_set(rp_app_params_t *orig_params,
 
         /* Wait for trigger to finish */
         while(1) {
-            pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-            state = rp_pwr_ctrl;
-            params_dirty = rp_pwr_params_dirty;
-            pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+            state = rp_worker_state_get(rp_pwr_ctrl);
+            params_dirty = rp_params_snap_pending(&rp_pwr_params_snap, rp_pwr_params_seq);
             /* change in state, abort polling */
             if((state != old_state) || params_dirty) {
                 return -1;
@@ -1287,10 +1268,8 @@ int rp_pwr_auto_set(rp_app_params_t *orig_params,
             /* Wait for trigger */
             /* Wait for trigger to finish */
             while(1) {
-                pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-                state = rp_pwr_ctrl;
-                params_dirty = rp_pwr_params_dirty;
-                pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+                state = rp_worker_state_get(rp_pwr_ctrl);
+                params_dirty = rp_params_snap_pending(&rp_pwr_params_snap, rp_pwr_params_seq);
 
                 /* change in state, abort polling */
                 if((state != old_state) || params_dirty) {
@@ -1434,6 +1413,7 @@ void *rp_pwr_dsp_thread(void *args)
 	int b1 = 0, b2 = 0;
 	double f1 = 0, f2 = 0;
 	double freq_2 = 0;
+	double period = 0;
 	double n_y = 0;
 	int n_x = 0;
 	int n_y2 = 0;
@@ -1447,18 +1427,18 @@ void *rp_pwr_dsp_thread(void *args)
 	
 	int i, j, ii;
 	
-	pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-    state = rp_pwr_ctrl;
-    pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+	/* Allocate DSP copy of parameters, values come from the snapshot */
+	if(rp_copy_params(rp_pwr_params, (rp_app_params_t **)&dsp_params) < 0)
+	    return 0;
+
+    state = rp_worker_state_get(rp_pwr_ctrl);
 
     while(1) {
 		
-        pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-        state = rp_pwr_ctrl;
-        if(rp_pwr_dsp_params_dirty) {
-            rp_copy_params(rp_pwr_params, (rp_app_params_t **)&dsp_params);
+        state = rp_worker_state_get(rp_pwr_ctrl);
 
-            rp_pwr_dsp_params_dirty = 0;
+        if(rp_params_snap_read(&rp_pwr_params_snap, dsp_params,
+                               &rp_pwr_dsp_params_seq, NULL)) {
             time_range = dsp_params[TIME_RANGE_PARAM].value;
             dec_factor = pwr_fpga_cnv_time_range_to_dec(time_range);
             if (time_range == 6) {
@@ -1489,7 +1469,6 @@ void *rp_pwr_dsp_thread(void *args)
                     
             ch2_user_dc_off = dsp_params[GEN_DC_OFFS_2].value;
         }
-        pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
         
         /* request to stop worker thread, we will shut down */
         if(state == rp_pwr_quit_state) {
@@ -1520,22 +1499,18 @@ void *rp_pwr_dsp_thread(void *args)
                 break;
 		    }
 		    
-		    pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-            state = rp_pwr_ctrl;
-            pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+            state = rp_worker_state_get(rp_pwr_ctrl);
             if((state == rp_pwr_quit_state) || (state == rp_pwr_abort_state) ||
-               (state == rp_pwr_auto_set_state) || rp_pwr_dsp_params_dirty) {
+               (state == rp_pwr_auto_set_state) || rp_params_snap_pending(&rp_pwr_params_snap, rp_pwr_dsp_params_seq)) {
                 break;
             }
 		    usleep(70);
 		    
 	    }
 	    
-	    pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-        state = rp_pwr_ctrl;
-        pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+        state = rp_worker_state_get(rp_pwr_ctrl);
         if((state == rp_pwr_abort_state) ||
-           (state == rp_pwr_auto_set_state) || rp_pwr_dsp_params_dirty) {
+           (state == rp_pwr_auto_set_state) || rp_params_snap_pending(&rp_pwr_params_snap, rp_pwr_dsp_params_seq)) {
             continue;
         } else if(state == rp_pwr_quit_state) {
             break;
@@ -1547,11 +1522,9 @@ void *rp_pwr_dsp_thread(void *args)
         rp_pwr_fft(&rp_ch_hann[0], &bin_max_amp1, &bin_max_amp2, &bin_max_amp3,
                    &bin_max_arg, &bin_max_num, length_half);
  
-        pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-        state = rp_pwr_ctrl;
-        pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+        state = rp_worker_state_get(rp_pwr_ctrl);
         if((state == rp_pwr_abort_state) ||
-           (state == rp_pwr_auto_set_state) || rp_pwr_dsp_params_dirty) {
+           (state == rp_pwr_auto_set_state) || rp_params_snap_pending(&rp_pwr_params_snap, rp_pwr_dsp_params_seq)) {
             continue;
         } else if(state == rp_pwr_quit_state) {
             break;
@@ -1589,11 +1562,9 @@ void *rp_pwr_dsp_thread(void *args)
 	            rp_chb_in_trunc[i] = rp_chb_in[n_x_start + i];
 	        }
 	        
-	        pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-            state = rp_pwr_ctrl;
-            pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+            state = rp_worker_state_get(rp_pwr_ctrl);
             if((state == rp_pwr_abort_state) ||
-               (state == rp_pwr_auto_set_state) || rp_pwr_dsp_params_dirty) {
+               (state == rp_pwr_auto_set_state) || rp_params_snap_pending(&rp_pwr_params_snap, rp_pwr_dsp_params_seq)) {
             continue;
             } else if(state == rp_pwr_quit_state) {
             break;
@@ -1604,11 +1575,9 @@ void *rp_pwr_dsp_thread(void *args)
             rp_pwr_hann_filter(&rp_cha_in_trunc[0], &rp_cha_hann_trunc[0], n_x);
             rp_pwr_hann_filter(&rp_chb_in_trunc[0], &rp_chb_hann_trunc[0], n_x);
 
-            pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-            state = rp_pwr_ctrl;
-            pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+            state = rp_worker_state_get(rp_pwr_ctrl);
             if((state == rp_pwr_abort_state) ||
-               (state == rp_pwr_auto_set_state) || rp_pwr_dsp_params_dirty) {
+               (state == rp_pwr_auto_set_state) || rp_params_snap_pending(&rp_pwr_params_snap, rp_pwr_dsp_params_seq)) {
             continue;
             } else if(state == rp_pwr_quit_state) {
             break;
@@ -1620,11 +1589,9 @@ void *rp_pwr_dsp_thread(void *args)
             rp_pwr_fft(&rp_chb_hann_trunc[0], &bin_max_ampI1, &bin_max_ampI2, 
                        &bin_max_ampI3, &bin_max_argI, &bin_max_numI, n_x_half);
                        
-            pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-            state = rp_pwr_ctrl;
-            pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+            state = rp_worker_state_get(rp_pwr_ctrl);
             if((state == rp_pwr_abort_state) ||
-               (state == rp_pwr_auto_set_state) || rp_pwr_dsp_params_dirty) {
+               (state == rp_pwr_auto_set_state) || rp_params_snap_pending(&rp_pwr_params_snap, rp_pwr_dsp_params_seq)) {
             continue;
             } else if(state == rp_pwr_quit_state) {
             break;
@@ -1633,6 +1600,7 @@ void *rp_pwr_dsp_thread(void *args)
             b2 = bin_max_numU;
             d2U = rp_pwr_calc_d(bin_max_ampU1, bin_max_ampU2, bin_max_ampU3);
             f2 = b2 + d2U;
+            period = n_x / f2; // fundamental period in samples
             
             n_y2 = (int)round(floor(f2) * n_x / f2); //skrajsamo buffer (se za eno periodo), za vecjo natancnost
             n_y2_start = n_x - n_y2;
@@ -1649,27 +1617,29 @@ void *rp_pwr_dsp_thread(void *args)
                                                           
             fft_fi_1 = bin_max_argI-bin_max_argU ;
             
-            pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-            state = rp_pwr_ctrl;
-            pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+            state = rp_worker_state_get(rp_pwr_ctrl);
             if((state == rp_pwr_abort_state) ||
-               (state == rp_pwr_auto_set_state) || rp_pwr_dsp_params_dirty) {
+               (state == rp_pwr_auto_set_state) || rp_params_snap_pending(&rp_pwr_params_snap, rp_pwr_dsp_params_seq)) {
             continue;
             } else if(state == rp_pwr_quit_state) {
             break;
             }          
-            rp_pwr_dft(&rp_cha_in_trunc[n_y2_start], &rp_chb_in_trunc[n_y2_start], 
-					   n_y2, f2,
-                       &rp_dft_o_amp_U[0], &rp_dft_o_amp_I[0], 
-                       &rp_dft_o_fi_U[0], &rp_dft_o_fi_I[0]);
+            /* All harmonics are evaluated since Uef/Ief include them */
+            if(rp_pwr_sync_dft(&rp_cha_in[0], &rp_chb_in[0], PWR_FPGA_SIG_LEN,
+                               period, pwr_dft_harmonic_num,
+                               &rp_dft_o_amp_U[0], &rp_dft_o_amp_I[0],
+                               &rp_dft_o_fi_U[0], &rp_dft_o_fi_I[0]) < 0) {
+                rp_pwr_dft(&rp_cha_in_trunc[n_y2_start], &rp_chb_in_trunc[n_y2_start], 
+                           n_y2, f2,
+                           &rp_dft_o_amp_U[0], &rp_dft_o_amp_I[0], 
+                           &rp_dft_o_fi_U[0], &rp_dft_o_fi_I[0]);
+            }
 
             rp_pwr_meas_clear(&meas);
             
-            pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-            state = rp_pwr_ctrl;
-            pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+            state = rp_worker_state_get(rp_pwr_ctrl);
             if((state == rp_pwr_abort_state) ||
-               (state == rp_pwr_auto_set_state) || rp_pwr_dsp_params_dirty) {
+               (state == rp_pwr_auto_set_state) || rp_params_snap_pending(&rp_pwr_params_snap, rp_pwr_dsp_params_seq)) {
             continue;
             } else if(state == rp_pwr_quit_state) {
             break;
@@ -1786,9 +1756,7 @@ void *rp_pwr_dsp_thread(void *args)
             rp_pwr_set_meas_data(meas);
         
         } else {
-		  pthread_mutex_lock(&rp_pwr_ctrl_mutex);
-          state = rp_pwr_ctrl;
-          pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+          state = rp_worker_state_get(rp_pwr_ctrl);
           if(state == rp_pwr_idle_state) {
 			  usleep(2e5);
               continue;
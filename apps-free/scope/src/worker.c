@@ -20,28 +20,41 @@
 #include <math.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 #include "worker.h"
 #include "fpga.h"
+#include "params_snap.h"
 
 pthread_t *rp_osc_thread_handler = NULL;
 void *rp_osc_worker_thread(void *args);
 
-pthread_mutex_t       rp_osc_ctrl_mutex = PTHREAD_MUTEX_INITIALIZER;
 rp_osc_worker_state_t rp_osc_ctrl;
 rp_app_params_t       *rp_osc_params = NULL;
-int                   rp_osc_params_dirty;
-int                   rp_osc_params_fpga_update;
-
-pthread_mutex_t       rp_osc_sig_mutex = PTHREAD_MUTEX_INITIALIZER;
-float               **rp_osc_signals;
-int                   rp_osc_signals_dirty = 0;
-int                   rp_osc_sig_last_idx = 0;
+rp_params_snap_t      rp_osc_params_snap;
+uint32_t              rp_osc_params_seq = 0; /* last snapshot read by worker */
+
+/* Triple buffered output signals - the worker fills its back buffer and
+ * swaps it with the middle one, the reader swaps the middle one with its
+ * front buffer. rp_osc_sig_gen is bumped on every publish and doubles as
+ * futex word readers sleep on. */
+float               **rp_osc_sig_buf[RP_OSC_SIG_BUFS];
+int                   rp_osc_sig_buf_idx[RP_OSC_SIG_BUFS];
+uint32_t              rp_osc_sig_middle = 1; /* buffer index | RP_OSC_SIG_FRESH */
+int                   rp_osc_sig_back = 0;   /* owned by worker */
+int                   rp_osc_sig_front = 2;  /* owned by reader */
+uint32_t              rp_osc_sig_gen = 0;
+int                   rp_osc_sig_waiters = 0;
 float               **rp_tmp_signals; /* used for calculation, only from worker */
 
 /* Signals directly pointing at the FPGA mem space */
 int                  *rp_fpga_cha_signal, *rp_fpga_chb_signal;
 
+static int  rp_osc_create_sig_bufs(void);
+static void rp_osc_cleanup_sig_bufs(void);
+
 /* Calibration parameters read from EEPROM */
 rp_calib_params_t *rp_calib_params = NULL;
 
@@ -53,23 +66,22 @@ int rp_osc_worker_init(rp_app_params_t *params, int params_len,
     int ret_val;
 
     rp_osc_ctrl               = rp_osc_idle_state;
-    rp_osc_params_dirty       = 0;
-    rp_osc_params_fpga_update = 0;
-
     rp_copy_params(params, (rp_app_params_t **)&rp_osc_params);
+    if(rp_params_snap_init(&rp_osc_params_snap, PARAMS_NUM) < 0)
+        return -1;
+    rp_osc_params_seq = 0;
 
-    rp_cleanup_signals(&rp_osc_signals);
-    if(rp_create_signals(&rp_osc_signals) < 0)
+    if(rp_osc_create_sig_bufs() < 0)
         return -1;
 
     rp_cleanup_signals(&rp_tmp_signals);
     if(rp_create_signals(&rp_tmp_signals) < 0) {
-        rp_cleanup_signals(&rp_osc_signals);
+        rp_osc_cleanup_sig_bufs();
         return -1;
     }
 
     if(osc_fpga_init() < 0) {
-        rp_cleanup_signals(&rp_osc_signals);
+        rp_osc_cleanup_sig_bufs();
         rp_cleanup_signals(&rp_tmp_signals);
         return -1;
     }
@@ -80,7 +92,7 @@ int rp_osc_worker_init(rp_app_params_t *params, int params_len,
 
     rp_osc_thread_handler = (pthread_t *)malloc(sizeof(pthread_t));
     if(rp_osc_thread_handler == NULL) {
-        rp_cleanup_signals(&rp_osc_signals);
+        rp_osc_cleanup_sig_bufs();
         rp_cleanup_signals(&rp_tmp_signals);
         return -1;
     }
@@ -89,7 +101,7 @@ int rp_osc_worker_init(rp_app_params_t *params, int params_len,
     if(ret_val != 0) {
         osc_fpga_exit();
 
-        rp_cleanup_signals(&rp_osc_signals);
+        rp_osc_cleanup_sig_bufs();
         rp_cleanup_signals(&rp_tmp_signals);
         fprintf(stderr, "pthread_create() failed: %s\n", 
                 strerror(errno));
@@ -117,10 +129,11 @@ int rp_osc_worker_exit(void)
     }
     osc_fpga_exit();
 
-    rp_cleanup_signals(&rp_osc_signals);
+    rp_osc_cleanup_sig_bufs();
     rp_cleanup_signals(&rp_tmp_signals);
 
     rp_clean_params(rp_osc_params);
+    rp_params_snap_clean(&rp_osc_params_snap);
 
     return 0;
 }
@@ -131,9 +144,7 @@ int rp_osc_worker_change_state(rp_osc_worker_state_t new_state)
 {
     if(new_state >= rp_osc_nonexisting_state)
         return -1;
-    pthread_mutex_lock(&rp_osc_ctrl_mutex);
-    rp_osc_ctrl = new_state;
-    pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+    rp_worker_state_set(rp_osc_ctrl, new_state);
     return 0;
 }
 
@@ -141,9 +152,7 @@ int rp_osc_worker_change_state(rp_osc_worker_state_t new_state)
 /*----------------------------------------------------------------------------------*/
 int rp_osc_worker_get_state(rp_osc_worker_state_t *state)
 {
-    pthread_mutex_lock(&rp_osc_ctrl_mutex);
-    *state = rp_osc_ctrl;
-    pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+    *state = rp_worker_state_get(rp_osc_ctrl);
     return 0;
 }
 
@@ -151,24 +160,46 @@ int rp_osc_worker_get_state(rp_osc_worker_state_t *state)
 /*----------------------------------------------------------------------------------*/
 int rp_osc_worker_update_params(rp_app_params_t *params, int fpga_update)
 {
-    pthread_mutex_lock(&rp_osc_ctrl_mutex);
-    rp_copy_params(params, (rp_app_params_t **)&rp_osc_params);
-    rp_osc_params_dirty       = 1;
-    rp_osc_params_fpga_update = fpga_update;
-    rp_osc_params[PARAMS_NUM].name = NULL;
-    rp_osc_params[PARAMS_NUM].value = -1;
+    rp_params_snap_publish(&rp_osc_params_snap, params, fpga_update);
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+static int rp_osc_create_sig_bufs(void)
+{
+    int i;
+
+    for(i = 0; i < RP_OSC_SIG_BUFS; i++) {
+        rp_cleanup_signals(&rp_osc_sig_buf[i]);
+        if(rp_create_signals(&rp_osc_sig_buf[i]) < 0) {
+            rp_osc_cleanup_sig_bufs();
+            return -1;
+        }
+        rp_osc_sig_buf_idx[i] = 0;
+    }
+    rp_osc_sig_back   = 0;
+    rp_osc_sig_middle = 1;
+    rp_osc_sig_front  = 2;
 
-    pthread_mutex_unlock(&rp_osc_ctrl_mutex);
     return 0;
 }
 
 
+/*----------------------------------------------------------------------------------*/
+static void rp_osc_cleanup_sig_bufs(void)
+{
+    int i;
+
+    for(i = 0; i < RP_OSC_SIG_BUFS; i++)
+        rp_cleanup_signals(&rp_osc_sig_buf[i]);
+}
+
+
 /*----------------------------------------------------------------------------------*/
 int rp_osc_clean_signals(void)
 {
-    pthread_mutex_lock(&rp_osc_sig_mutex);
-    rp_osc_signals_dirty = 0;
-    pthread_mutex_unlock(&rp_osc_sig_mutex);
+    __atomic_and_fetch(&rp_osc_sig_middle, ~RP_OSC_SIG_FRESH, __ATOMIC_SEQ_CST);
     return 0;
 }
 
@@ -177,21 +208,39 @@ int rp_osc_clean_signals(void)
 int rp_osc_get_signals(float ***signals, int *sig_idx)
 {
     float **s = *signals;
-    pthread_mutex_lock(&rp_osc_sig_mutex);
-    if(rp_osc_signals_dirty == 0) {
-        *sig_idx = rp_osc_sig_last_idx;
-        pthread_mutex_unlock(&rp_osc_sig_mutex);
-        return -1;
+    float **f;
+    uint32_t gen, middle;
+    struct timespec timeout;
+
+    /* Nothing new yet - sleep until the worker publishes or timeout expires */
+    if(!(__atomic_load_n(&rp_osc_sig_middle, __ATOMIC_SEQ_CST) & RP_OSC_SIG_FRESH)) {
+        __atomic_add_fetch(&rp_osc_sig_waiters, 1, __ATOMIC_SEQ_CST);
+        gen = __atomic_load_n(&rp_osc_sig_gen, __ATOMIC_SEQ_CST);
+        if(!(__atomic_load_n(&rp_osc_sig_middle, __ATOMIC_SEQ_CST) & RP_OSC_SIG_FRESH)) {
+            timeout.tv_sec  = 0;
+            timeout.tv_nsec = RP_OSC_SIG_WAIT_US * 1000;
+            syscall(SYS_futex, &rp_osc_sig_gen, FUTEX_WAIT_PRIVATE, gen,
+                    &timeout, NULL, 0);
+        }
+        __atomic_sub_fetch(&rp_osc_sig_waiters, 1, __ATOMIC_SEQ_CST);
+
+        if(!(__atomic_load_n(&rp_osc_sig_middle, __ATOMIC_SEQ_CST) & RP_OSC_SIG_FRESH)) {
+            *sig_idx = rp_osc_sig_buf_idx[rp_osc_sig_front];
+            return -1;
+        }
     }
 
-    memcpy(&s[0][0], &rp_osc_signals[0][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&s[1][0], &rp_osc_signals[1][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&s[2][0], &rp_osc_signals[2][0], sizeof(float)*SIGNAL_LENGTH);
+    middle = __atomic_exchange_n(&rp_osc_sig_middle, rp_osc_sig_front,
+                                 __ATOMIC_SEQ_CST);
+    rp_osc_sig_front = middle & ~RP_OSC_SIG_FRESH;
+    f = rp_osc_sig_buf[rp_osc_sig_front];
+
+    memcpy(&s[0][0], &f[0][0], sizeof(float)*SIGNAL_LENGTH);
+    memcpy(&s[1][0], &f[1][0], sizeof(float)*SIGNAL_LENGTH);
+    memcpy(&s[2][0], &f[2][0], sizeof(float)*SIGNAL_LENGTH);
 
-    *sig_idx = rp_osc_sig_last_idx;
+    *sig_idx = rp_osc_sig_buf_idx[rp_osc_sig_front];
 
-    rp_osc_signals_dirty = 0;
-    pthread_mutex_unlock(&rp_osc_sig_mutex);
     return 0;
 }
 
@@ -199,15 +248,23 @@ int rp_osc_get_signals(float ***signals, int *sig_idx)
 /*----------------------------------------------------------------------------------*/
 int rp_osc_set_signals(float **source, int index)
 {
-    pthread_mutex_lock(&rp_osc_sig_mutex);
+    float **b = rp_osc_sig_buf[rp_osc_sig_back];
+    uint32_t middle;
 
-    memcpy(&rp_osc_signals[0][0], &source[0][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&rp_osc_signals[1][0], &source[1][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&rp_osc_signals[2][0], &source[2][0], sizeof(float)*SIGNAL_LENGTH);
-    rp_osc_sig_last_idx = index;
+    memcpy(&b[0][0], &source[0][0], sizeof(float)*SIGNAL_LENGTH);
+    memcpy(&b[1][0], &source[1][0], sizeof(float)*SIGNAL_LENGTH);
+    memcpy(&b[2][0], &source[2][0], sizeof(float)*SIGNAL_LENGTH);
+    rp_osc_sig_buf_idx[rp_osc_sig_back] = index;
 
-    rp_osc_signals_dirty = 1;
-    pthread_mutex_unlock(&rp_osc_sig_mutex);
+    middle = __atomic_exchange_n(&rp_osc_sig_middle,
+                                 rp_osc_sig_back | RP_OSC_SIG_FRESH,
+                                 __ATOMIC_SEQ_CST);
+    rp_osc_sig_back = middle & ~RP_OSC_SIG_FRESH;
+
+    __atomic_add_fetch(&rp_osc_sig_gen, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&rp_osc_sig_waiters, __ATOMIC_SEQ_CST))
+        syscall(SYS_futex, &rp_osc_sig_gen, FUTEX_WAKE_PRIVATE, INT_MAX,
+                NULL, NULL, 0);
 
     return 0;
 }
@@ -244,9 +301,11 @@ void *rp_osc_worker_thread(void *args)
     float ch1_max_adc_v = 1, ch2_max_adc_v = 1;
     float max_adc_norm = osc_fpga_calc_adc_max_v(rp_calib_params->fe_ch1_fs_g_hi, 0);
 
-    pthread_mutex_lock(&rp_osc_ctrl_mutex);
-    old_state = state = rp_osc_ctrl;
-    pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+    /* Allocate worker copy of parameters, values come from the snapshot */
+    if(rp_copy_params(rp_osc_params, (rp_app_params_t **)&curr_params) < 0)
+        return 0;
+
+    old_state = state = rp_worker_state_get(rp_osc_ctrl);
 
 
     while(1) {
@@ -254,13 +313,10 @@ void *rp_osc_worker_thread(void *args)
          * FPGA 
          */
         old_state = state;
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        state = rp_osc_ctrl;
-        if(rp_osc_params_dirty) {
-            rp_copy_params(rp_osc_params, (rp_app_params_t **)&curr_params);
-            fpga_update = rp_osc_params_fpga_update;
+        state = rp_worker_state_get(rp_osc_ctrl);
 
-            rp_osc_params_dirty = 0;
+        if(rp_params_snap_read(&rp_osc_params_snap, curr_params,
+                               &rp_osc_params_seq, &fpga_update)) {
             dec_factor = 
                 osc_fpga_cnv_time_range_to_dec(curr_params[TIME_RANGE_PARAM].value);
             time_vect_update = 1;
@@ -277,7 +333,6 @@ void *rp_osc_worker_thread(void *args)
             ch2_max_adc_v =
                     osc_fpga_calc_adc_max_v(fe_fsg2, (int)curr_params[PRB_ATT_CH2].value);
         }
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
 
         /* request to stop worker thread, we will shut down */
         if(state == rp_osc_quit_state) {
@@ -399,9 +454,7 @@ void *rp_osc_worker_thread(void *args)
         }
 
         /* start working */
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        old_state = state = rp_osc_ctrl;
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+        old_state = state = rp_worker_state_get(rp_osc_ctrl);
         if((state == rp_osc_idle_state) || (state == rp_osc_abort_state)) {
             continue;
         } else if(state == rp_osc_quit_state) {
@@ -411,10 +464,8 @@ void *rp_osc_worker_thread(void *args)
         if(long_acq_idx == 0) {
             /* polling until data is ready */
             while(1) {
-                pthread_mutex_lock(&rp_osc_ctrl_mutex);
-                state = rp_osc_ctrl;
-                params_dirty = rp_osc_params_dirty;
-                pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+                state = rp_worker_state_get(rp_osc_ctrl);
+                params_dirty = rp_params_snap_pending(&rp_osc_params_snap, rp_osc_params_seq);
                 /* change in state, abort polling */
                 if((state != old_state) || params_dirty) {
                     break;
@@ -487,10 +538,8 @@ void *rp_osc_worker_thread(void *args)
             usleep(long_acq_part_delay); /* Sleep for 200 [ms] */
         }
 
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        state = rp_osc_ctrl;
-        params_dirty = rp_osc_params_dirty;
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+        state = rp_worker_state_get(rp_osc_ctrl);
+        params_dirty = rp_params_snap_pending(&rp_osc_params_snap, rp_osc_params_seq);
 
         if((state != old_state) || params_dirty)
             continue;
@@ -539,9 +588,7 @@ void *rp_osc_worker_thread(void *args)
         }
 
         /* check again for change of state */
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        state = rp_osc_ctrl;
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+        state = rp_worker_state_get(rp_osc_ctrl);
 
         /* We have acquisition - if we are in single put state machine
          * to idle */
@@ -824,9 +871,7 @@ int rp_osc_auto_set(rp_app_params_t *orig_params,
 
     for (iter=0; iter < 10; iter++) {
         /* 10 auto-trigger acquisitions */
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        old_state = state = rp_osc_ctrl;
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+        old_state = state = rp_worker_state_get(rp_osc_ctrl);
 
         osc_fpga_reset();
         osc_fpga_update_params(1, 0, 0, 0, 0, time_range, ch1_max_adc_v, ch2_max_adc_v,
@@ -842,10 +887,8 @@ int rp_osc_auto_set(rp_app_params_t *orig_params,
 
         /* Wait for trigger to finish */
         while(1) {
-            pthread_mutex_lock(&rp_osc_ctrl_mutex);
-            state = rp_osc_ctrl;
-            params_dirty = rp_osc_params_dirty;
-            pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+            state = rp_worker_state_get(rp_osc_ctrl);
+            params_dirty = rp_params_snap_pending(&rp_osc_params_snap, rp_osc_params_seq);
             /* change in state, abort polling */
             if((state != old_state) || params_dirty) {
                 return -1;
@@ -1010,10 +1053,8 @@ int rp_osc_auto_set(rp_app_params_t *orig_params,
             /* Wait for trigger */
             /* Wait for trigger to finish */
             while(1) {
-                pthread_mutex_lock(&rp_osc_ctrl_mutex);
-                state = rp_osc_ctrl;
-                params_dirty = rp_osc_params_dirty;
-                pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+                state = rp_worker_state_get(rp_osc_ctrl);
+                params_dirty = rp_params_snap_pending(&rp_osc_params_snap, rp_osc_params_seq);
 
                 /* change in state, abort polling */
                 if((state != old_state) || params_dirty) {
@@ -36,15 +36,21 @@ int rp_osc_worker_change_state(rp_osc_worker_state_t new_state);
 int rp_osc_worker_get_state(rp_osc_worker_state_t *state);
 int rp_osc_worker_update_params(rp_app_params_t *params, int fpga_update);
 
+/* Output signals are triple buffered, reader waits at most this long */
+#define RP_OSC_SIG_BUFS    3
+#define RP_OSC_SIG_FRESH   0x4
+#define RP_OSC_SIG_WAIT_US 20000
+
 /* removes 'dirty' flags */
 int rp_osc_clean_signals(void);
-/* Returns:
+/* Single reader only. Waits up to RP_OSC_SIG_WAIT_US for new signals.
+ * Returns:
  *  0 - new signals (dirty signal) are copied to the output 
- *  1 - no new signals available (dirty signal was not set - we need to wait)
+ * -1 - no new signals available (dirty signal was not set - we need to wait)
  */
 int rp_osc_get_signals(float ***signals, int *sig_idx);
-/* Fills the output signal structure from temp one after calculation is done 
- * and marks it dirty 
+/* Fills the worker's back buffer from temp one after calculation is done 
+ * and publishes it by swapping with the middle buffer, waking the reader
  */
 int rp_osc_set_signals(float **source, int index);
 /* Fills the output measuremenet data with last measurements
@@ -27,6 +27,7 @@
 #include "fpga.h"
 #include "dsp.h"
 #include "waterfall.h"
+#include "params_snap.h"
 
 /* JPG outputs: c_jpg_file_path+[1|2]+_+jpg_cnt(3 digits)+c_jpg_file_suf */
 const char c_jpg_dir_path[]="/tmp/ram";
@@ -58,11 +59,9 @@ double *rp_chb_fft = NULL;
 float               **rp_tmp_signals = NULL;
 
 /* Parameters & signals communicating with 'external world' */
-pthread_mutex_t       rp_spectr_ctrl_mutex = PTHREAD_MUTEX_INITIALIZER;
 rp_spectr_worker_state_t rp_spectr_ctrl;
-rp_app_params_t       rp_spectr_params[PARAMS_NUM];
-int                   rp_spectr_params_dirty;
-int                   rp_spectr_params_fpga_update;
+rp_params_snap_t      rp_spectr_params_snap;
+uint32_t              rp_spectr_params_seq = 0; /* last snapshot read by worker */
 
 pthread_mutex_t        rp_spectr_sig_mutex = PTHREAD_MUTEX_INITIALIZER;
 float                **rp_spectr_signals = NULL;
@@ -74,8 +73,9 @@ int rp_spectr_worker_init(void)
     int ret_val;
 
     rp_spectr_ctrl               = rp_spectr_idle_state;
-    rp_spectr_params_dirty       = 1;
-    rp_spectr_params_fpga_update = 1;
+    if(rp_params_snap_init(&rp_spectr_params_snap, PARAMS_NUM) < 0)
+        return -1;
+    rp_spectr_params_seq = 0;
 
     rp_spectr_clean_tmpdir(c_jpg_dir_path);
 
@@ -206,6 +206,7 @@ int rp_spectr_worker_exit(void)
     }
     rp_spectr_worker_clean();
     rp_spectr_clean_tmpdir(c_jpg_dir_path);
+    rp_params_snap_clean(&rp_spectr_params_snap);
     return 0;
 }
 
@@ -213,19 +214,13 @@ int rp_spectr_worker_change_state(rp_spectr_worker_state_t new_state)
 {
     if(new_state >= rp_spectr_nonexisting_state)
         return -1;
-    pthread_mutex_lock(&rp_spectr_ctrl_mutex);
-    rp_spectr_ctrl = new_state;
-    pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
+    rp_worker_state_set(rp_spectr_ctrl, new_state);
     return 0;
 }
 
 int rp_spectr_worker_update_params(rp_app_params_t *params, int fpga_update)
 {
-    pthread_mutex_lock(&rp_spectr_ctrl_mutex);
-    memcpy(&rp_spectr_params, params, sizeof(rp_app_params_t)*PARAMS_NUM);
-    rp_spectr_params_dirty       = 1;
-    rp_spectr_params_fpga_update = fpga_update;
-    pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
+    rp_params_snap_publish(&rp_spectr_params_snap, params, fpga_update);
     return 0;
 }
 
@@ -343,24 +338,21 @@ void *rp_spectr_worker_thread(void *args)
     int                      jpg_write_div = 10;
     rp_spectr_worker_res_t   tmp_result;
 
-    pthread_mutex_lock(&rp_spectr_ctrl_mutex);
-    old_state = state = rp_spectr_ctrl;
-    pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
+    /* nothing is published before the first rp_set_params(), start from
+     * zeros as the shared parameter array did */
+    memset(curr_params, 0, sizeof(curr_params));
+
+    old_state = state = rp_worker_state_get(rp_spectr_ctrl);
 
     while(1) {
         /* update states - we save also old state to see if we need to reset
          * FPGA 
          */
         old_state = state;
-        pthread_mutex_lock(&rp_spectr_ctrl_mutex);
-        state = rp_spectr_ctrl;
-        if(rp_spectr_params_dirty) {
-            memcpy(&curr_params, &rp_spectr_params, 
-                   sizeof(rp_app_params_t)*PARAMS_NUM);
-            fpga_update = rp_spectr_params_fpga_update;
-            rp_spectr_params_dirty = 0;
-        }
-        pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
+        state = rp_worker_state_get(rp_spectr_ctrl);
+
+        rp_params_snap_read(&rp_spectr_params_snap, curr_params,
+                            &rp_spectr_params_seq, &fpga_update);
 
         /* request to stop worker thread, we will shut down */
         if(state == rp_spectr_quit_state) {
@@ -406,9 +398,7 @@ void *rp_spectr_worker_thread(void *args)
         spectr_fpga_set_trigger(1);
 
         /* start working */
-        pthread_mutex_lock(&rp_spectr_ctrl_mutex);
-        old_state = state = rp_spectr_ctrl;
-        pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
+        old_state = state = rp_worker_state_get(rp_spectr_ctrl);
         if((state == rp_spectr_idle_state) || (state == rp_spectr_abort_state)) {
             continue;
         } else if(state == rp_spectr_quit_state) {
@@ -417,10 +407,8 @@ void *rp_spectr_worker_thread(void *args)
 
         /* polling until data is ready */
         while(1) {
-            pthread_mutex_lock(&rp_spectr_ctrl_mutex);
-            state = rp_spectr_ctrl;
-            params_dirty = rp_spectr_params_dirty;
-            pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
+            state = rp_worker_state_get(rp_spectr_ctrl);
+            params_dirty = rp_params_snap_pending(&rp_spectr_params_snap, rp_spectr_params_seq);
             /* change in state, abort polling */
             if((state != old_state) || params_dirty) {
                 break;
@@ -15,16 +15,76 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "acquire.h"
 #include "common.h"
+#include "scpi-commands.h"
 
 #include "scpi/parser.h"
 #include "scpi/units.h"
 
 #include "redpitaya/rp.h"
 
-rp_scpi_acq_unit_t unit     = RP_SCPI_VOLTS;        // default value
+/* Streaming subscription state (ACQ:STREAM:START/STOP) */
+#define STREAM_CHANNELS     2
+#define STREAM_WAIT_MS      10      // max. time spent in RP_AcqStreamPoll()
+#define CAPTURE_TIMEOUT_MS  100     // trigger timeout of RP_AcqCaptureV()
+#define STREAM_OBSERVERS    4       // max. observer connections
+#define OBSERVER_STALL_MS   2000    // observer stuck on one record is closed
+#define STREAM_SLOTS        (STREAM_OBSERVERS + 2)
+
+typedef enum {
+    STREAM_IDLE,
+    STREAM_ARMING,                  // waiting for pre-trigger samples
+    STREAM_WAITING,                 // waiting for trigger
+    STREAM_FILLING,                 // waiting for post-trigger samples
+} stream_state_t;
+
+static stream_state_t      stream_state = STREAM_IDLE;
+static struct timespec     stream_trig_ts;      // realtime of the trigger
+static uint64_t            stream_fill_us;      // next write pointer check, monotonic
+static uint64_t            stream_fill_end_us;  // record is sent by then at the latest
+static uint32_t            stream_fill_wp;      // write pointer at the last check
+static rp_acq_trig_src_t   stream_trig_src;
+static uint32_t            stream_seq;
+static scpi_t             *stream_context;      // connection receiving records
+
+/* Captured records are kept in a ring shared by the streaming connection and
+ * the observers (ACQ:STREAM:OBSERVE). A slot being sent to an observer is
+ * pinned, with two spare slots there is always a free one for a new record. */
+typedef struct {
+    uint64_t id;                    // capture order, 0 marks an empty slot
+    uint32_t pins;                  // observers in the middle of sending it
+    size_t   len;                   // size of rec (header and samples)
+    char     prefix[16];            // binary block header "#<n><len>"
+    size_t   prefix_len;
+    struct {
+        rp_scpi_stream_hdr_t hdr;
+        union {
+            float   volts[STREAM_CHANNELS][ADC_BUFFER_SIZE];
+            int16_t raw[STREAM_CHANNELS][ADC_BUFFER_SIZE];
+        } data;
+    } rec;
+} stream_slot_t;
+
+typedef struct {
+    scpi_t        *context;         // NULL marks a free entry
+    uint64_t       next_id;         // first record not sent yet
+    stream_slot_t *slot;            // record being sent or NULL
+    size_t         offset;          // bytes of slot already sent
+    struct timespec since;          // when sending of slot started
+    bool           stopping;        // remove once slot is sent
+} stream_observer_t;
+
+static stream_slot_t       stream_slots[STREAM_SLOTS];
+static uint64_t            stream_last_id;
+static stream_observer_t   stream_observers[STREAM_OBSERVERS];
 
 /* These structures are a direct API mirror 
 and should not be altered! */
@@ -104,6 +164,21 @@ scpi_result_t RP_AcqSetDataFormat(scpi_t *context) {
     return SCPI_RES_OK;
 }
 
+scpi_result_t RP_AcqDataFormatQ(scpi_t *context) {
+
+    SCPI_ResultMnemonic(context, context->binary_output ? "BIN" : "ASCII");
+
+    RP_LOG(LOG_INFO, "*ACQ:DATA:FORMAT? Successfully returned data format.\n");
+    return SCPI_RES_OK;
+}
+
+
+static void streamStop() {
+    if (stream_state != STREAM_IDLE) {
+        stream_state = STREAM_IDLE;
+        RP_LOG(LOG_INFO, "*ACQ:STREAM stopped after %u records.\n", stream_seq);
+    }
+}
 
 scpi_result_t RP_AcqStart(scpi_t *context) {
     int result = rp_AcqStart();
@@ -118,6 +193,7 @@ scpi_result_t RP_AcqStart(scpi_t *context) {
 }
 
 scpi_result_t RP_AcqStop(scpi_t *context) {
+    streamStop();
     int result = rp_AcqStop();
 
     if (RP_OK != result) {
@@ -130,6 +206,7 @@ scpi_result_t RP_AcqStop(scpi_t *context) {
 }
 
 scpi_result_t RP_AcqReset(scpi_t *context) {
+    streamStop();
     int result = rp_AcqReset();
 
     if (RP_OK != result) {
@@ -137,7 +214,7 @@ scpi_result_t RP_AcqReset(scpi_t *context) {
         return SCPI_RES_ERR;
     }
 
-    unit = RP_SCPI_VOLTS;
+    RP_ScpiConn(context)->unit = RP_SCPI_VOLTS;
     context->binary_output = false;
 
     RP_LOG(LOG_INFO, "*ACQ:RST Successful reset  Red Pitaya acquire.\n");
@@ -593,8 +670,8 @@ scpi_result_t RP_AcqScpiDataUnits(scpi_t *context) {
         return SCPI_RES_ERR;
     }
 
-    /* Set global units for acq scpi */
-    unit = choice;
+    /* Units of this connection */
+    RP_ScpiConn(context)->unit = choice;
 
     RP_LOG(LOG_INFO, "*ACQ:DATA:UNITS Successfully set scpi units.\n");
     return SCPI_RES_OK;
@@ -604,7 +681,7 @@ scpi_result_t RP_AcqScpiDataUnitsQ(scpi_t *context){
 
     const char *units;
 
-    if(!SCPI_ChoiceToName(scpi_RpUnits, unit, &units)){
+    if(!SCPI_ChoiceToName(scpi_RpUnits, RP_ScpiConn(context)->unit, &units)){
         RP_LOG(LOG_ERR, "*ACQ:DATA:UNITS? Failed to get data units.\n");
         return SCPI_RES_ERR;
     }
@@ -638,7 +715,7 @@ scpi_result_t RP_AcqDataPosQ(scpi_t *context) {
     }
 
     uint32_t size = end - start;
-    if(unit == RP_SCPI_VOLTS){
+    if(RP_ScpiConn(context)->unit == RP_SCPI_VOLTS){
         float buffer[size];
         result = rp_AcqGetDataPosV(channel, start, end, buffer, &size);
         
@@ -647,7 +724,7 @@ scpi_result_t RP_AcqDataPosQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
         
-        SCPI_ResultBufferFloat(context, buffer, size);
+        RP_ResultBufferFloat(context, buffer, size);
 
     }else{
         int16_t buffer[size];
@@ -658,7 +735,7 @@ scpi_result_t RP_AcqDataPosQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferInt16(context, buffer, size);
+        RP_ResultBufferInt16(context, buffer, size);
     }
 
     RP_LOG(LOG_INFO, "*ACQ:SOUR#:DATA:STA:END? Successfully returned data to client.\n");
@@ -690,7 +767,7 @@ scpi_result_t RP_AcqDataQ(scpi_t *context) {
 
     uint32_t size_buff;
     rp_AcqGetBufSize(&size_buff);
-    if(unit == RP_SCPI_VOLTS){
+    if(RP_ScpiConn(context)->unit == RP_SCPI_VOLTS){
         float buffer[size_buff - start];
         result = rp_AcqGetDataV(channel, start, &size, buffer);
         if(result != RP_OK){
@@ -699,7 +776,7 @@ scpi_result_t RP_AcqDataQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferFloat(context, buffer, size);
+        RP_ResultBufferFloat(context, buffer, size);
 
     }else{
         int16_t buffer[size_buff - start];
@@ -710,7 +787,7 @@ scpi_result_t RP_AcqDataQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferInt16(context, buffer, size);
+        RP_ResultBufferInt16(context, buffer, size);
     }
 
     RP_LOG(LOG_INFO, "*ACQ:SOUR<n>:DATA:STA:N? Successfully returned data.\n");
@@ -729,7 +806,7 @@ scpi_result_t RP_AcqDataOldestAllQ(scpi_t *context) {
     }
     
     rp_AcqGetBufSize(&size);
-    if(unit == RP_SCPI_VOLTS){
+    if(RP_ScpiConn(context)->unit == RP_SCPI_VOLTS){
         float buffer[size];
         result = rp_AcqGetOldestDataV(channel, &size, buffer);
 
@@ -738,7 +815,7 @@ scpi_result_t RP_AcqDataOldestAllQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferFloat(context, buffer, size);
+        RP_ResultBufferFloat(context, buffer, size);
 
     }else{
         int16_t buffer[size];
@@ -748,7 +825,7 @@ scpi_result_t RP_AcqDataOldestAllQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferInt16(context, buffer, size);
+        RP_ResultBufferInt16(context, buffer, size);
     }
 
     RP_LOG(LOG_INFO, "*ACQ:SOUR#:DATA? Successfully returned data.\n");
@@ -771,7 +848,7 @@ scpi_result_t RP_AcqOldestDataQ(scpi_t *context) {
         return SCPI_RES_ERR;
     }
 
-    if(unit == RP_SCPI_VOLTS){
+    if(RP_ScpiConn(context)->unit == RP_SCPI_VOLTS){
         float buffer[size];
         result = rp_AcqGetOldestDataV(channel, &size, buffer);
 
@@ -782,7 +859,7 @@ scpi_result_t RP_AcqOldestDataQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferFloat(context, buffer, size);
+        RP_ResultBufferFloat(context, buffer, size);
 
     }else{
         int16_t buffer[size];
@@ -792,7 +869,7 @@ scpi_result_t RP_AcqOldestDataQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferInt16(context, buffer, size);
+        RP_ResultBufferInt16(context, buffer, size);
     }
 
     RP_LOG(LOG_INFO, "*ACQ:SOUR#:DATA:OLD:N? Successfully returned data to client.");
@@ -815,7 +892,7 @@ scpi_result_t RP_AcqLatestDataQ(scpi_t *context) {
         return SCPI_RES_ERR;
     }
 
-    if(unit == RP_SCPI_VOLTS){
+    if(RP_ScpiConn(context)->unit == RP_SCPI_VOLTS){
         float buffer[size];
         result = rp_AcqGetLatestDataV(channel, &size, buffer);
 
@@ -825,7 +902,7 @@ scpi_result_t RP_AcqLatestDataQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferFloat(context, buffer, size);
+        RP_ResultBufferFloat(context, buffer, size);
     }else{
         int16_t buffer[size];
         result = rp_AcqGetLatestDataRaw(channel, &size, buffer);
@@ -835,7 +912,7 @@ scpi_result_t RP_AcqLatestDataQ(scpi_t *context) {
                 "get raw data: %s\n", rp_GetError(result));
         }
 
-        SCPI_ResultBufferInt16(context, buffer, size);
+        RP_ResultBufferInt16(context, buffer, size);
     }
 
     RP_LOG(LOG_INFO, "*ACQ:SOUR<n>:DATA:LAT:N? Successfully returned data to client.\n");
@@ -856,3 +933,620 @@ scpi_result_t RP_AcqBufferSizeQ(scpi_t *context) {
     RP_LOG(LOG_INFO, "*ACQ:BUF:SIZE?? Successfully returned buffer size.\n");
     return SCPI_RES_OK;
 }
+
+/* Samples between acquisition start and trigger */
+static uint32_t acqPreTriggerSamples() {
+    int32_t delay;
+    rp_AcqGetTriggerDelay(&delay);
+    delay = ADC_BUFFER_SIZE / 2 - delay;
+    return delay < 0 ? 0 : (delay > ADC_BUFFER_SIZE ? ADC_BUFFER_SIZE : delay);
+}
+
+/* Time in us needed to acquire the given number of samples */
+static uint32_t acqSamplesToUs(uint32_t samples) {
+    uint32_t decimation;
+    rp_AcqGetDecimationFactor(&decimation);
+    return (uint32_t)(((uint64_t)samples * 8 * decimation) / 1000);
+}
+
+/* Waits after trigger until the post-trigger samples are written - the write pointer stops */
+static void acqWaitRecordDone() {
+    uint32_t wp, wp_prev;
+    uint32_t timeout_us = acqSamplesToUs(ADC_BUFFER_SIZE) + 1000;
+
+    usleep(acqSamplesToUs(ADC_BUFFER_SIZE - acqPreTriggerSamples()));
+    rp_AcqGetWritePointer(&wp);
+    do {
+        wp_prev = wp;
+        usleep(50);
+        timeout_us = timeout_us > 50 ? timeout_us - 50 : 0;
+        rp_AcqGetWritePointer(&wp);
+    } while (wp != wp_prev && timeout_us > 0);
+}
+
+/* Acquires one record of both channels in volts with trigger NOW. The
+ * pre-trigger part is waited for, so the whole buffer holds new samples. */
+int RP_AcqCaptureV(float *ch1, float *ch2, uint32_t *size) {
+    uint32_t cnt = 0, pre = acqPreTriggerSamples();
+    uint32_t size2 = *size;
+    int result;
+
+    if ((result = rp_AcqStart()) != RP_OK) {
+        return result;
+    }
+    usleep(acqSamplesToUs(pre));
+    for (int i = 0; i < 100 && rp_AcqGetPreTriggerCounter(&cnt) == RP_OK && cnt < pre; i++) {
+        usleep(acqSamplesToUs(pre - cnt) + 10);
+    }
+
+    if ((result = rp_AcqSetTriggerSrc(RP_TRIG_SRC_NOW)) != RP_OK ||
+        (result = rp_AcqWaitTrigger(CAPTURE_TIMEOUT_MS)) != RP_OK) {
+        return result;
+    }
+    acqWaitRecordDone();
+
+    if ((result = rp_AcqGetOldestDataV(RP_CH_1, size, ch1)) != RP_OK) {
+        return result;
+    }
+    return rp_AcqGetOldestDataV(RP_CH_2, &size2, ch2);
+}
+
+static int streamArm() {
+    int result = rp_AcqStart();
+    if (result == RP_OK) {
+        stream_state = STREAM_ARMING;
+    }
+    return result;
+}
+
+/* Returns the oldest unpinned slot for a new record */
+static stream_slot_t *streamFreeSlot() {
+    stream_slot_t *slot = NULL;
+
+    for (int i = 0; i < STREAM_SLOTS; i++) {
+        if (stream_slots[i].pins == 0 && (slot == NULL || stream_slots[i].id < slot->id)) {
+            slot = &stream_slots[i];
+        }
+    }
+    return slot;
+}
+
+/* Returns the oldest record with id >= next_id, older ones were overwritten */
+static stream_slot_t *streamNextSlot(uint64_t next_id) {
+    stream_slot_t *slot = NULL;
+
+    for (int i = 0; i < STREAM_SLOTS; i++) {
+        if (stream_slots[i].id != 0 && stream_slots[i].id >= next_id &&
+            (slot == NULL || stream_slots[i].id < slot->id)) {
+            slot = &stream_slots[i];
+        }
+    }
+    return slot;
+}
+
+/* Sends as much as the socket accepts without blocking, returns -1 if the
+ * observer connection failed. A record is started only when the replies
+ * queued before it are sent, replies to queries received while it is partly
+ * sent are queued behind it (out_hold), so the block framing stays intact.
+ * The event loop continues on EPOLLOUT with RP_AcqStreamWritable(). */
+static int observerSend(stream_observer_t *obs) {
+    rp_scpi_conn_t *conn = RP_ScpiConn(obs->context);
+    int fd = conn->fd;
+
+    for (;;) {
+        if (obs->slot == NULL) {
+            if (RP_ScpiConnPending(conn) > 0) {
+                return 0;
+            }
+            obs->slot = streamNextSlot(obs->next_id);
+            if (obs->slot == NULL) {
+                return 0;
+            }
+            obs->slot->pins++;
+            obs->offset = 0;
+            clock_gettime(CLOCK_MONOTONIC, &obs->since);
+        }
+
+        stream_slot_t *slot = obs->slot;
+        struct iovec iov[3] = {
+            { .iov_base = slot->prefix,    .iov_len = slot->prefix_len },
+            { .iov_base = &slot->rec,      .iov_len = slot->len },
+            { .iov_base = (void *)"\r\n",  .iov_len = 2 },
+        };
+        size_t total = slot->prefix_len + slot->len + 2;
+        size_t skip = obs->offset;
+        int first = 0;
+
+        while (skip >= iov[first].iov_len) {
+            skip -= iov[first++].iov_len;
+        }
+        iov[first].iov_base = (char *)iov[first].iov_base + skip;
+        iov[first].iov_len -= skip;
+
+        struct msghdr msg = { .msg_iov = &iov[first], .msg_iovlen = 3 - first };
+        ssize_t n = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            return -1;
+        }
+
+        obs->offset += (n > 0) ? n : 0;
+        if (obs->offset < total) {
+            conn->out_hold = true;
+            RP_ScpiConnUpdate(conn);
+            return 0;
+        }
+        slot->pins--;
+        obs->next_id = slot->id + 1;
+        obs->slot = NULL;
+        conn->out_hold = false;
+        if (obs->stopping) {
+            obs->context = NULL;
+            return RP_ScpiConnFlush(conn);
+        }
+        if (RP_ScpiConnFlush(conn) < 0) {
+            return -1;
+        }
+    }
+}
+
+static void observerRemove(stream_observer_t *obs) {
+    if (obs->slot != NULL) {
+        obs->slot->pins--;
+        obs->slot = NULL;
+    }
+    RP_ScpiConn(obs->context)->out_hold = false;
+    obs->context = NULL;
+}
+
+/* Removes the observer and closes its connection, a partly sent record
+ * can not be completed any more */
+static void observerFail(stream_observer_t *obs) {
+    rp_scpi_conn_t *conn = RP_ScpiConn(obs->context);
+
+    observerRemove(obs);
+    RP_ScpiConnFail(conn);
+}
+
+static bool observerStalled(stream_observer_t *obs) {
+    struct timespec now;
+
+    if (obs->slot == NULL) {
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - obs->since.tv_sec) * 1000 +
+           (now.tv_nsec - obs->since.tv_nsec) / 1000000 > OBSERVER_STALL_MS;
+}
+
+/* Offers a new record to every observer. One which did not take its last
+ * record for OBSERVER_STALL_MS is closed, so it does not pin a slot. */
+static void streamFlushObservers() {
+    for (int i = 0; i < STREAM_OBSERVERS; i++) {
+        stream_observer_t *obs = &stream_observers[i];
+        if (obs->context == NULL) {
+            continue;
+        }
+        if (observerStalled(obs)) {
+            RP_LOG(LOG_ERR, "*ACQ:STREAM:OBSERVE Observer does not read, closed.\n");
+            observerFail(obs);
+        } else if (observerSend(obs) < 0) {
+            RP_LOG(LOG_ERR, "*ACQ:STREAM:OBSERVE Observer connection failed, removed.\n");
+            observerFail(obs);
+        }
+    }
+}
+
+static void streamNetworkOrder(rp_scpi_stream_hdr_t *hdr) {
+    RP_NetworkOrder(&hdr->seq, 1, sizeof(hdr->seq));
+    RP_NetworkOrder(&hdr->trig_pos, 1, sizeof(hdr->trig_pos));
+    RP_NetworkOrder(&hdr->timestamp_ns, 1, sizeof(hdr->timestamp_ns));
+    RP_NetworkOrder(&hdr->samples, 1, sizeof(hdr->samples));
+    RP_NetworkOrder(&hdr->channels, 1, sizeof(hdr->channels));
+    RP_NetworkOrder(&hdr->format, 1, sizeof(hdr->format));
+}
+
+static uint64_t streamNowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Starts waiting for the post-trigger samples, RP_AcqStreamPoll() checks
+ * the deadline and the write pointer without blocking the server */
+static void streamFill() {
+    uint64_t now = streamNowUs();
+
+    clock_gettime(CLOCK_REALTIME, &stream_trig_ts);
+    stream_fill_us = now + acqSamplesToUs(ADC_BUFFER_SIZE - acqPreTriggerSamples());
+    stream_fill_end_us = now + acqSamplesToUs(ADC_BUFFER_SIZE) + 1000;
+    stream_fill_wp = UINT32_MAX;
+    stream_state = STREAM_FILLING;
+}
+
+/* Reads both channels of the filled record into the record ring and sends
+ * them as one binary block, observers get the same record from the ring */
+static int streamSend(scpi_t *context) {
+    stream_slot_t *slot = streamFreeSlot();
+    rp_scpi_acq_unit_t unit = RP_ScpiConn(context)->unit;
+    struct timespec ts = stream_trig_ts;
+    uint32_t size = ADC_BUFFER_SIZE;
+    int result = RP_OK;
+
+    slot->id = 0;
+    slot->rec.hdr.seq          = stream_seq++;
+    slot->rec.hdr.timestamp_ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    slot->rec.hdr.samples      = ADC_BUFFER_SIZE;
+    slot->rec.hdr.channels     = STREAM_CHANNELS;
+    slot->rec.hdr.format       = unit;
+    rp_AcqGetWritePointerAtTrig(&slot->rec.hdr.trig_pos);
+
+    for (int ch = 0; ch < STREAM_CHANNELS && result == RP_OK; ch++) {
+        size = ADC_BUFFER_SIZE;
+        if (unit == RP_SCPI_VOLTS) {
+            result = rp_AcqGetOldestDataV(ch, &size, slot->rec.data.volts[ch]);
+        } else {
+            result = rp_AcqGetOldestDataRaw(ch, &size, slot->rec.data.raw[ch]);
+        }
+    }
+    if (result != RP_OK) {
+        return result;
+    }
+
+    /* Re-arm before sending so the next record is acquired meanwhile */
+    result = streamArm();
+
+    /* channels are stored one after another in either unit, the record is
+     * sent in network byte order like the other binary blocks */
+    size_t width = (unit == RP_SCPI_VOLTS) ? sizeof(float) : sizeof(int16_t);
+    slot->len = sizeof(slot->rec.hdr) + STREAM_CHANNELS * ADC_BUFFER_SIZE * width;
+    streamNetworkOrder(&slot->rec.hdr);
+    RP_NetworkOrder(&slot->rec.data, STREAM_CHANNELS * ADC_BUFFER_SIZE, width);
+    char len_str[12];
+    int digits = snprintf(len_str, sizeof(len_str), "%zu", slot->len);
+    slot->prefix_len = snprintf(slot->prefix, sizeof(slot->prefix), "#%d%s", digits, len_str);
+    slot->id = ++stream_last_id;
+
+    context->output_count = 0;
+    RP_ResultArbitraryBlock(context, &slot->rec, slot->len, 1);
+    context->interface->write(context, "\r\n", 2);
+    context->output_count = 0;
+
+    streamFlushObservers();
+    return result;
+}
+
+scpi_result_t RP_AcqStreamStart(scpi_t *context) {
+    int result = rp_AcqGetTriggerSrc(&stream_trig_src);
+
+    if (RP_OK != result) {
+        RP_LOG(LOG_ERR, "*ACQ:STREAM:START Failed to get trigger source: %s\n", rp_GetError(result));
+        return SCPI_RES_ERR;
+    }
+    if (stream_trig_src == RP_TRIG_SRC_DISABLED) {
+        RP_LOG(LOG_ERR, "*ACQ:STREAM:START Trigger source must be set before start.\n");
+        return SCPI_RES_ERR;
+    }
+
+    stream_seq = 0;
+    stream_context = context;
+    result = streamArm();
+    if (RP_OK != result) {
+        RP_LOG(LOG_ERR, "*ACQ:STREAM:START Failed to start acquisition: %s\n", rp_GetError(result));
+        return SCPI_RES_ERR;
+    }
+
+    RP_LOG(LOG_INFO, "*ACQ:STREAM:START Successfully started streaming.\n");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_AcqStreamStop(scpi_t *context) {
+    streamStop();
+    rp_AcqStop();
+
+    RP_LOG(LOG_INFO, "*ACQ:STREAM:STOP Successfully stopped streaming.\n");
+    return SCPI_RES_OK;
+}
+
+bool RP_AcqStreamActive() {
+    return stream_state != STREAM_IDLE;
+}
+
+/* Returns true if RP_AcqStreamPoll() has work to do now. A triggered record
+ * is not read while the streaming client still has output queued, so the
+ * stream runs at the pace the client takes it. */
+bool RP_AcqStreamReady() {
+    return stream_state == STREAM_ARMING || stream_state == STREAM_FILLING ||
+           (stream_state == STREAM_WAITING && RP_ScpiConnPending(RP_ScpiConn(stream_context)) == 0);
+}
+
+/* Observers receive every record captured by the streaming connection,
+ * without a separate acquisition and without slowing it down - records a
+ * slow observer can not take in time are skipped (see hdr.seq). */
+scpi_result_t RP_AcqStreamObserve(scpi_t *context) {
+    stream_observer_t *obs = NULL;
+    scpi_bool_t value;
+
+    if (!SCPI_ParamBool(context, &value, true)) {
+        RP_LOG(LOG_ERR, "*ACQ:STREAM:OBSERVE is missing first parameter.\n");
+        return SCPI_RES_ERR;
+    }
+
+    for (int i = 0; i < STREAM_OBSERVERS; i++) {
+        if (stream_observers[i].context == context) {
+            obs = &stream_observers[i];
+        }
+    }
+
+    if (!value) {
+        // a partly sent record is completed first, replies stay behind it
+        if (obs != NULL && obs->slot != NULL) {
+            obs->stopping = true;
+        } else if (obs != NULL) {
+            observerRemove(obs);
+        }
+        RP_LOG(LOG_INFO, "*ACQ:STREAM:OBSERVE Successfully stopped observing.\n");
+        return SCPI_RES_OK;
+    }
+
+    if (obs != NULL) {
+        obs->stopping = false;
+    }
+    for (int i = 0; i < STREAM_OBSERVERS && obs == NULL; i++) {
+        if (stream_observers[i].context == NULL) {
+            obs = &stream_observers[i];
+            obs->context = context;
+            obs->next_id = stream_last_id + 1;
+            obs->slot = NULL;
+            obs->stopping = false;
+        }
+    }
+    if (obs == NULL) {
+        RP_LOG(LOG_ERR, "*ACQ:STREAM:OBSERVE Too many observers.\n");
+        return SCPI_RES_ERR;
+    }
+
+    RP_LOG(LOG_INFO, "*ACQ:STREAM:OBSERVE Successfully started observing.\n");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_AcqStreamObserveQ(scpi_t *context) {
+    bool observing = false;
+
+    for (int i = 0; i < STREAM_OBSERVERS; i++) {
+        observing |= (stream_observers[i].context == context && !stream_observers[i].stopping);
+    }
+    SCPI_ResultBool(context, observing);
+    return SCPI_RES_OK;
+}
+
+/* Continues sending records to an observer connection which became
+ * writable, called by the event loop on EPOLLOUT */
+void RP_AcqStreamWritable(scpi_t *context) {
+    for (int i = 0; i < STREAM_OBSERVERS; i++) {
+        if (stream_observers[i].context == context && observerSend(&stream_observers[i]) < 0) {
+            RP_LOG(LOG_ERR, "*ACQ:STREAM:OBSERVE Observer connection failed, removed.\n");
+            observerFail(&stream_observers[i]);
+        }
+    }
+}
+
+void RP_AcqStreamRelease(scpi_t *context) {
+    if (stream_state != STREAM_IDLE && stream_context == context) {
+        streamStop();
+        rp_AcqStop();
+    }
+    for (int i = 0; i < STREAM_OBSERVERS; i++) {
+        if (stream_observers[i].context == context) {
+            observerRemove(&stream_observers[i]);
+        }
+    }
+}
+
+int RP_AcqStreamPoll() {
+    int result;
+
+    streamFlushObservers();
+
+    switch (stream_state) {
+    case STREAM_IDLE:
+        return RP_OK;
+
+    case STREAM_ARMING: {
+        uint32_t cnt = 0, pre = acqPreTriggerSamples();
+        if (rp_AcqGetPreTriggerCounter(&cnt) != RP_OK || cnt < pre) {
+            uint32_t us = acqSamplesToUs(pre - (cnt < pre ? cnt : 0));
+            usleep(us < STREAM_WAIT_MS * 1000 ? us : STREAM_WAIT_MS * 1000);
+            if (rp_AcqGetPreTriggerCounter(&cnt) == RP_OK && cnt < pre) {
+                return RP_OK;
+            }
+        }
+        result = rp_AcqSetTriggerSrc(stream_trig_src);
+        if (result != RP_OK) {
+            break;
+        }
+        stream_state = STREAM_WAITING;
+        return RP_OK;
+    }
+
+    case STREAM_WAITING:
+        if (!RP_AcqStreamReady()) {
+            return RP_OK;
+        }
+        result = rp_AcqWaitTrigger(STREAM_WAIT_MS);
+        if (result == RP_ETMO) {
+            return RP_OK;
+        }
+        if (result == RP_OK) {
+            streamFill();
+        }
+        break;
+
+    case STREAM_FILLING: {
+        /* sent once the write pointer stopped, it is checked at least two
+         * samples apart, at the end of the record at the latest */
+        uint32_t wp;
+        uint64_t now = streamNowUs();
+        if (now < stream_fill_us) {
+            uint64_t us = stream_fill_us - now;
+            usleep(us < STREAM_WAIT_MS * 1000 ? us : STREAM_WAIT_MS * 1000);
+            if ((now = streamNowUs()) < stream_fill_us) {
+                return RP_OK;
+            }
+        }
+        result = rp_AcqGetWritePointer(&wp);
+        if (result == RP_OK && wp != stream_fill_wp && now < stream_fill_end_us) {
+            uint32_t us = acqSamplesToUs(2);
+            stream_fill_wp = wp;
+            stream_fill_us = now + (us > 50 ? us : 50);
+            return RP_OK;
+        }
+        if (result == RP_OK) {
+            result = streamSend(stream_context);
+        }
+        break;
+    }
+    }
+
+    if (result != RP_OK) {
+        RP_LOG(LOG_ERR, "*ACQ:STREAM Failed, streaming stopped: %s\n", rp_GetError(result));
+        streamStop();
+    }
+    return result;
+}
+
+/* Server side measurements (ACQ:SOUR#:MEAS:<type>?) */
+typedef enum {
+    MEAS_MIN,
+    MEAS_MAX,
+    MEAS_PP,
+    MEAS_MEAN,
+    MEAS_RMS,
+    MEAS_FREQ,
+} meas_type_t;
+
+static float meas_data[ADC_BUFFER_SIZE];
+
+/* Single pass min, max, sum and sum of squares with 4 independent
+ * accumulators, so the loop does not serialize on one dependency chain.
+ * Sums are kept in double, float loses the low bits over 16k samples with
+ * a large DC offset. */
+static void measReduce(const float *x, uint32_t n, float *min, float *max, double *sum, double *sum_sq) {
+    float mn[4] = {x[0], x[0], x[0], x[0]}, mx[4] = {x[0], x[0], x[0], x[0]};
+    double s[4] = {0}, sq[4] = {0};
+    uint32_t i, k;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        for (k = 0; k < 4; k++) {
+            float v = x[i + k];
+            mn[k] = v < mn[k] ? v : mn[k];
+            mx[k] = v > mx[k] ? v : mx[k];
+            s[k] += v;
+            sq[k] += (double)v * v;
+        }
+    }
+    for (; i < n; i++) {
+        mn[0] = x[i] < mn[0] ? x[i] : mn[0];
+        mx[0] = x[i] > mx[0] ? x[i] : mx[0];
+        s[0] += x[i];
+        sq[0] += (double)x[i] * x[i];
+    }
+
+    *min = fminf(fminf(mn[0], mn[1]), fminf(mn[2], mn[3]));
+    *max = fmaxf(fmaxf(mx[0], mx[1]), fmaxf(mx[2], mx[3]));
+    *sum = s[0] + s[1] + s[2] + s[3];
+    *sum_sq = sq[0] + sq[1] + sq[2] + sq[3];
+}
+
+/* Frequency from the rising crossings of the mid level with 10 % hysteresis,
+ * measured between the first and the last crossing */
+static float measFrequency(const float *x, uint32_t n, float min, float max, float sample_rate) {
+    float mid = (min + max) / 2, hyst = (max - min) / 10;
+    uint32_t first = 0, last = 0, count = 0;
+    bool armed = false;
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (x[i] < mid - hyst) {
+            armed = true;
+        } else if (armed && x[i] >= mid) {
+            armed = false;
+            if (count++ == 0) {
+                first = i;
+            }
+            last = i;
+        }
+    }
+    return (count > 1) ? (count - 1) * sample_rate / (last - first) : 0;
+}
+
+static scpi_result_t measQuery(scpi_t *context, meas_type_t type) {
+    rp_channel_t channel;
+    uint32_t size = ADC_BUFFER_SIZE;
+    float min, max, value;
+    double sum, sum_sq;
+    int result;
+
+    if (RP_ParseChArgv(context, &channel) != RP_OK){
+        return SCPI_RES_ERR;
+    }
+
+    if (RP_ScpiConn(context)->unit == RP_SCPI_VOLTS) {
+        result = rp_AcqGetOldestDataV(channel, &size, meas_data);
+    } else {
+        int16_t raw[ADC_BUFFER_SIZE];
+        result = rp_AcqGetOldestDataRaw(channel, &size, raw);
+        for (uint32_t i = 0; i < size; i++) {
+            meas_data[i] = raw[i];
+        }
+    }
+    if (result != RP_OK || size == 0) {
+        RP_LOG(LOG_ERR, "*ACQ:SOUR#:MEAS? Failed to get data: %s\n", rp_GetError(result));
+        return SCPI_RES_ERR;
+    }
+
+    measReduce(meas_data, size, &min, &max, &sum, &sum_sq);
+
+    switch (type) {
+    case MEAS_MIN:  value = min;                    break;
+    case MEAS_MAX:  value = max;                    break;
+    case MEAS_PP:   value = max - min;              break;
+    case MEAS_MEAN: value = sum / size;             break;
+    case MEAS_RMS:  value = sqrt(sum_sq / size);    break;
+    case MEAS_FREQ: {
+        float sample_rate;
+        rp_AcqGetSamplingRateHz(&sample_rate);
+        value = measFrequency(meas_data, size, min, max, sample_rate);
+        break;
+    }
+    default:
+        return SCPI_RES_ERR;
+    }
+
+    SCPI_ResultFloat(context, value);
+
+    RP_LOG(LOG_INFO, "*ACQ:SOUR#:MEAS? Successfully returned measurement.\n");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_AcqMeasMinQ(scpi_t *context) {
+    return measQuery(context, MEAS_MIN);
+}
+
+scpi_result_t RP_AcqMeasMaxQ(scpi_t *context) {
+    return measQuery(context, MEAS_MAX);
+}
+
+scpi_result_t RP_AcqMeasPeakToPeakQ(scpi_t *context) {
+    return measQuery(context, MEAS_PP);
+}
+
+scpi_result_t RP_AcqMeasMeanQ(scpi_t *context) {
+    return measQuery(context, MEAS_MEAN);
+}
+
+scpi_result_t RP_AcqMeasRmsQ(scpi_t *context) {
+    return measQuery(context, MEAS_RMS);
+}
+
+scpi_result_t RP_AcqMeasFreqQ(scpi_t *context) {
+    return measQuery(context, MEAS_FREQ);
+}
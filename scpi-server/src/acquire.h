@@ -24,8 +24,21 @@ typedef enum {
     RP_SCPI_RAW,
 } rp_scpi_acq_unit_t;
 
+/* Header of a record pushed by ACQ:STREAM:START, followed by the samples of
+ * both channels (float32 volts or int16 raw, depending on ACQ:DATA:UNITS).
+ * Header fields and samples are sent in network byte order (big endian). */
+typedef struct {
+    uint32_t seq;                   // record sequence number, 0 at start
+    uint32_t trig_pos;              // write pointer at trigger
+    uint64_t timestamp_ns;          // CLOCK_REALTIME at trigger detection
+    uint32_t samples;               // samples per channel
+    uint16_t channels;
+    uint16_t format;                // rp_scpi_acq_unit_t
+} rp_scpi_stream_hdr_t;
+
 int RP_AcqSetDefaultValues();
 scpi_result_t RP_AcqSetDataFormat(scpi_t *context);
+scpi_result_t RP_AcqDataFormatQ(scpi_t *context);
 scpi_result_t RP_AcqStart(scpi_t * context);
 scpi_result_t RP_AcqStop(scpi_t *context);
 scpi_result_t RP_AcqReset(scpi_t * context);
@@ -57,7 +70,24 @@ scpi_result_t RP_AcqDataOldestAllQ(scpi_t * context);
 scpi_result_t RP_AcqOldestDataQ(scpi_t *context);
 scpi_result_t RP_AcqLatestDataQ(scpi_t *context);
 scpi_result_t RP_AcqBufferSizeQ(scpi_t * context);
+scpi_result_t RP_AcqMeasMinQ(scpi_t * context);
+scpi_result_t RP_AcqMeasMaxQ(scpi_t * context);
+scpi_result_t RP_AcqMeasPeakToPeakQ(scpi_t * context);
+scpi_result_t RP_AcqMeasMeanQ(scpi_t * context);
+scpi_result_t RP_AcqMeasRmsQ(scpi_t * context);
+scpi_result_t RP_AcqMeasFreqQ(scpi_t * context);
+scpi_result_t RP_AcqStreamStart(scpi_t * context);
+scpi_result_t RP_AcqStreamStop(scpi_t * context);
+scpi_result_t RP_AcqStreamObserve(scpi_t * context);
+scpi_result_t RP_AcqStreamObserveQ(scpi_t * context);
+
+bool RP_AcqStreamActive();
+bool RP_AcqStreamReady();
+void RP_AcqStreamWritable(scpi_t * context);
+int RP_AcqStreamPoll();
+void RP_AcqStreamRelease(scpi_t * context);
 
 scpi_result_t RP_AcqGetLatestData(rp_channel_t channel, scpi_t * context);
+int RP_AcqCaptureV(float *ch1, float *ch2, uint32_t *size);
 
 #endif /* ACQUIRE_H_ */
@@ -13,9 +13,17 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
 
 #include "common.h"
 
+#ifdef SCPI_DEBUG
+bool rp_scpi_log = true;
+#else
+bool rp_scpi_log = false;   // switched on with SYST:LOG ON
+#endif
+
 /* Parse channel */
 int RP_ParseChArgv(scpi_t *context, rp_channel_t *channel){
 
@@ -29,3 +37,92 @@ int RP_ParseChArgv(scpi_t *context, rp_channel_t *channel){
     
     return RP_OK;
 }
+
+/* Returns true if the next parameter is an IEEE 488.2 block (#<n><len><data>) */
+bool RP_ParamIsBlock(scpi_t *context){
+
+    const lex_state_t *state = &context->param_list.lex_state;
+    const char *p = state->pos;
+    const char *end = state->buffer + state->len;
+
+    while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+        p++;
+    }
+    return p < end && *p == '#';
+}
+
+/* Converts count elements of width bytes (aligned to width) between host and
+ * network byte order in place. The conversion is its own inverse, so it is
+ * used for received blocks too. */
+void RP_NetworkOrder(void *data, size_t count, size_t width){
+
+    if (htons(1) == 1) {
+        return;
+    }
+    switch (width) {
+    case 2:
+        for (size_t i = 0; i < count; i++) {
+            ((uint16_t *)data)[i] = __builtin_bswap16(((uint16_t *)data)[i]);
+        }
+        break;
+    case 4:
+        for (size_t i = 0; i < count; i++) {
+            ((uint32_t *)data)[i] = __builtin_bswap32(((uint32_t *)data)[i]);
+        }
+        break;
+    case 8:
+        for (size_t i = 0; i < count; i++) {
+            ((uint64_t *)data)[i] = __builtin_bswap64(((uint64_t *)data)[i]);
+        }
+        break;
+    }
+}
+
+/* Writes count elements of width bytes as IEEE 488.2 definite length
+ * arbitrary block "#<n><len><data>". Elements are sent in network byte order
+ * (big endian) like the binary output of the SCPI parser, through a small
+ * buffer so data are left intact. Width 1 sends data as they are. */
+size_t RP_ResultArbitraryBlock(scpi_t *context, const void *data, size_t count, size_t width){
+
+    char header[2 + 20];
+    uint64_t chunk[512];                // aligned for RP_NetworkOrder()
+    size_t len = count * width;
+    size_t total = 0;
+
+    int digits = snprintf(header + 2, sizeof(header) - 2, "%zu", len);
+    header[0] = '#';
+    header[1] = '0' + digits;
+
+    if (context->output_count > 0) {
+        total += context->interface->write(context, ",", 1);
+    }
+    total += context->interface->write(context, header, 2 + digits);
+    if (width == 1 || htons(1) == 1) {
+        total += context->interface->write(context, (const char *)data, len);
+    } else {
+        size_t step = sizeof(chunk) / width * width;
+        for (size_t offset = 0; offset < len; offset += step) {
+            size_t n = (len - offset < step) ? len - offset : step;
+            memcpy(chunk, (const char *)data + offset, n);
+            RP_NetworkOrder(chunk, n / width, width);
+            total += context->interface->write(context, (const char *)chunk, n);
+        }
+    }
+    context->output_count++;
+
+    return total;
+}
+
+size_t RP_ResultBufferFloat(scpi_t *context, const float *data, uint32_t size){
+    if (context->binary_output) {
+        return RP_ResultArbitraryBlock(context, data, size, sizeof(float));
+    }
+    return SCPI_ResultBufferFloat(context, data, size);
+}
+
+size_t RP_ResultBufferInt16(scpi_t *context, const int16_t *data, uint32_t size){
+    if (context->binary_output) {
+        return RP_ResultArbitraryBlock(context, data, size, sizeof(int16_t));
+    }
+    return SCPI_ResultBufferInt16(context, data, size);
+}
@@ -15,22 +15,31 @@
 #ifndef COMMON_H_
 #define COMMON_H_
 
+#include <stdint.h>
+#include <stdbool.h>
 #include <syslog.h>
 
 #include "scpi/parser.h"
 #include "redpitaya/rp.h"
+#include "redpitaya/rp_log.h"
 
 #define CH_NUM		4
 
 #define SCPI_CMD_NUM 	1
 
-#ifdef SCPI_DEBUG
+/* Per command logging, switched at run time with SYST:LOG - off by default,
+ * on in SCPI_DEBUG builds. Arguments are not evaluated while it is off,
+ * messages are queued and written to syslog by the rp_log thread. */
+extern bool rp_scpi_log;
 #define RP_LOG(...) \
-syslog(__VA_ARGS__);
-#else
-#define RP_LOG(...)
-#endif
+do { if (rp_scpi_log) RP_LOG_PRINT(__VA_ARGS__); } while (0)
 
 int RP_ParseChArgv(scpi_t *context, rp_channel_t *channel);
 
+bool RP_ParamIsBlock(scpi_t *context);
+void RP_NetworkOrder(void *data, size_t count, size_t width);
+size_t RP_ResultArbitraryBlock(scpi_t *context, const void *data, size_t count, size_t width);
+size_t RP_ResultBufferFloat(scpi_t *context, const float *data, uint32_t size);
+size_t RP_ResultBufferInt16(scpi_t *context, const int16_t *data, uint32_t size);
+
 #endif /* COMMON_H_ */
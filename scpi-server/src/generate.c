@@ -21,9 +21,18 @@
 #include "../../api/src/generate.h"
 
 #include "common.h"
+#include "scpi-commands.h"
 #include "scpi/parser.h"
 #include "scpi/units.h"
 
+/* Element type of binary blocks sent with SOUR#:TRAC:DATA:DATA, set per
+ * connection */
+const scpi_choice_def_t scpi_RpArbFormat[] = {
+    {"FLOAT",   0},
+    {"INT16",   1},
+    SCPI_CHOICE_LIST_END
+};
+
 /* These structures are a direct API mirror 
 and should not be altered! */
 const scpi_choice_def_t scpi_RpWForm[] = {
@@ -61,6 +70,8 @@ scpi_result_t RP_GenReset(scpi_t *context) {
         return SCPI_RES_ERR;
     }
 
+    RP_ScpiConn(context)->arb_format = RP_SCPI_ARB_FLOAT;
+
     RP_LOG(LOG_INFO, "*GEN:RST Successfully reset Red "
         "Pitaya generate module.\n");
     return SCPI_RES_OK;
@@ -416,10 +427,38 @@ scpi_result_t RP_GenDutyCycleQ(scpi_t *context) {
     return SCPI_RES_OK;
 }
 
+/* Sets waveform from a binary block of float32 values or int16 DAC codes,
+ * in network byte order like the blocks sent by the server */
+static int genArbitraryWaveFormBlock(scpi_t *context, rp_channel_t channel) {
+    const char *data;
+    size_t len;
+
+    if(!SCPI_ParamArbitraryBlock(context, &data, &len, true)){
+        return RP_EIPV;
+    }
+
+    if(RP_ScpiConn(context)->arb_format == RP_SCPI_ARB_INT16){
+        int16_t buffer[BUFFER_LENGTH];
+        if(len % sizeof(int16_t) || len > sizeof(buffer)){
+            return RP_EOOR;
+        }
+        memcpy(buffer, data, len);    // block data are not aligned
+        RP_NetworkOrder(buffer, len / sizeof(int16_t), sizeof(int16_t));
+        return rp_GenArbWaveformRaw(channel, buffer, len / sizeof(int16_t));
+    }
+
+    float buffer[BUFFER_LENGTH];
+    if(len % sizeof(float) || len > sizeof(buffer)){
+        return RP_EOOR;
+    }
+    memcpy(buffer, data, len);
+    RP_NetworkOrder(buffer, len / sizeof(float), sizeof(float));
+    return rp_GenArbWaveform(channel, buffer, len / sizeof(float));
+}
+
 scpi_result_t RP_GenArbitraryWaveForm(scpi_t *context) {
     
     rp_channel_t channel;
-    float buffer[BUFFER_LENGTH];
     uint32_t size;
     int result;
 
@@ -427,13 +466,18 @@ scpi_result_t RP_GenArbitraryWaveForm(scpi_t *context) {
         return SCPI_RES_ERR;
     }
 
-    if(!SCPI_ParamBufferFloat(context, buffer, &size, true)){
-        RP_LOG(LOG_ERR, "*SOUR#:TRAC:DATA:DATA Failed to "
-            "arbitrary waveform data parameter.\n");
-        return SCPI_RES_ERR;
+    if(RP_ParamIsBlock(context)){
+        result = genArbitraryWaveFormBlock(context, channel);
+    }else{
+        float buffer[BUFFER_LENGTH];
+        if(!SCPI_ParamBufferFloat(context, buffer, &size, true)){
+            RP_LOG(LOG_ERR, "*SOUR#:TRAC:DATA:DATA Failed to "
+                "arbitrary waveform data parameter.\n");
+            return SCPI_RES_ERR;
+        }
+        result = rp_GenArbWaveform(channel, buffer, size);
     }
 
-    result = rp_GenArbWaveform(channel, buffer, size);
     if(result != RP_OK){
         RP_LOG(LOG_ERR, "*SOUR#:TRAC:DATA:DATA Failed to "
             "set arbitrary waveform data: %s\n", rp_GetError(result));
@@ -444,6 +488,36 @@ scpi_result_t RP_GenArbitraryWaveForm(scpi_t *context) {
     return SCPI_RES_OK;
 }
 
+scpi_result_t RP_GenArbitraryFormat(scpi_t *context) {
+
+    int32_t choice;
+
+    if(!SCPI_ParamChoice(context, scpi_RpArbFormat, &choice, true)){
+        RP_LOG(LOG_ERR, "*SOUR:TRAC:DATA:FORMAT Missing first parameter.\n");
+        return SCPI_RES_ERR;
+    }
+
+    RP_ScpiConn(context)->arb_format = choice;
+
+    RP_LOG(LOG_INFO, "*SOUR:TRAC:DATA:FORMAT Successfully set block format.\n");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_GenArbitraryFormatQ(scpi_t *context) {
+
+    const char *name;
+
+    if(!SCPI_ChoiceToName(scpi_RpArbFormat, RP_ScpiConn(context)->arb_format, &name)){
+        RP_LOG(LOG_ERR, "*SOUR:TRAC:DATA:FORMAT? Failed to get block format.\n");
+        return SCPI_RES_ERR;
+    }
+
+    SCPI_ResultMnemonic(context, name);
+
+    RP_LOG(LOG_INFO, "*SOUR:TRAC:DATA:FORMAT? Successfully returned block format.\n");
+    return SCPI_RES_OK;
+}
+
 scpi_result_t RP_GenArbitraryWaveFormQ(scpi_t *context) {
     
     rp_channel_t channel;
@@ -462,7 +536,7 @@ scpi_result_t RP_GenArbitraryWaveFormQ(scpi_t *context) {
         return SCPI_RES_ERR;
     }
 
-    SCPI_ResultBufferFloat(context, buffer, size);
+    RP_ResultBufferFloat(context, buffer, size);
 
     RP_LOG(LOG_INFO, "*SOUR#:TRAC:DATA:DATA? Successfully "
         "returned arbitrary waveform data to client.\n");
@@ -18,6 +18,11 @@
 
 #include "scpi/types.h"
 
+typedef enum {
+    RP_SCPI_ARB_FLOAT,      // float32 values, -1.0 .. 1.0
+    RP_SCPI_ARB_INT16,      // int16 DAC codes, -8192 .. 8191
+} rp_scpi_arb_format_t;
+
 scpi_result_t RP_GenState(scpi_t * context);
 scpi_result_t RP_GenStateQ(scpi_t * context);
 scpi_result_t RP_GenReset(scpi_t * context);
@@ -35,6 +40,8 @@ scpi_result_t RP_GenDutyCycle(scpi_t * context);
 scpi_result_t RP_GenDutyCycleQ(scpi_t * context);
 scpi_result_t RP_GenArbitraryWaveForm(scpi_t * context);
 scpi_result_t RP_GenArbitraryWaveFormQ(scpi_t * context);
+scpi_result_t RP_GenArbitraryFormat(scpi_t * context);
+scpi_result_t RP_GenArbitraryFormatQ(scpi_t * context);
 scpi_result_t RP_GenGenerateMode(scpi_t * context);
 scpi_result_t RP_GenGenerateModeQ(scpi_t * context);
 scpi_result_t RP_GenBurstCount(scpi_t * context);
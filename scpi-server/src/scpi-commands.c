@@ -13,16 +13,22 @@
  */
 
 #include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <syslog.h>
 
+#include "scpi-commands.h"
 #include "api_cmd.h"
 #include "common.h"
 #include "dpin.h"
 #include "apin.h"
 #include "acquire.h"
 #include "generate.h"
+#include "sweep.h"
 #include "scpi/error.h"
 #include "scpi/ieee488.h"
 #include "scpi/minimal.h"
@@ -31,27 +37,171 @@
 
 bool RST_executed = FALSE;
 
+/* Connection owning the hardware (SYST:LOCK), NULL when nobody does */
+static scpi_t *hw_owner = NULL;
+
+void RP_ScpiConnInit(rp_scpi_conn_t *conn, int fd, int epfd) {
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = fd;
+    conn->epfd = epfd;
+    conn->unit = RP_SCPI_VOLTS;
+    conn->arb_format = RP_SCPI_ARB_FLOAT;
+}
+
+void RP_ScpiConnClean(rp_scpi_conn_t *conn) {
+    free(conn->out);
+    conn->out = NULL;
+    conn->out_len = conn->out_start = conn->out_end = 0;
+}
+
+size_t RP_ScpiConnPending(const rp_scpi_conn_t *conn) {
+    return conn->out_end - conn->out_start;
+}
+
+/* Requests the epoll events the connection needs now: input unless the
+ * client finished or does not take its output, EPOLLOUT while output or a
+ * stream record waits */
+void RP_ScpiConnUpdate(rp_scpi_conn_t *conn) {
+    if (conn->epfd < 0 || conn->failed) {
+        return;
+    }
+
+    size_t pending = RP_ScpiConnPending(conn);
+    uint32_t events = 0;
+    if (!conn->closing && pending < RP_SCPI_OUTPUT_HIGH) {
+        events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (pending > 0 || conn->out_hold) {
+        events |= EPOLLOUT;
+    }
+    if (events != conn->events) {
+        struct epoll_event ev = { .events = events, .data.ptr = conn };
+        epoll_ctl(conn->epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->events = events;
+    }
+}
+
+/* Drops all output and makes the event loop close the connection */
+void RP_ScpiConnFail(rp_scpi_conn_t *conn) {
+    if (!conn->failed) {
+        conn->failed = true;
+        conn->out_start = conn->out_end = 0;
+        shutdown(conn->fd, SHUT_RDWR);
+    }
+}
+
+/* Returns true if the connection can be closed */
+bool RP_ScpiConnDone(const rp_scpi_conn_t *conn) {
+    return conn->failed || (conn->closing && RP_ScpiConnPending(conn) == 0);
+}
+
+static int connQueue(rp_scpi_conn_t *conn, const char *data, size_t len) {
+    if (conn->out_start > 0 && conn->out_end + len > conn->out_len) {
+        memmove(conn->out, conn->out + conn->out_start, RP_ScpiConnPending(conn));
+        conn->out_end -= conn->out_start;
+        conn->out_start = 0;
+    }
+    if (conn->out_end + len > RP_SCPI_OUTPUT_MAX) {
+        syslog(LOG_ERR, "Client does not read its output, closing connection.");
+        return -1;
+    }
+    if (conn->out_end + len > conn->out_len) {
+        size_t size = conn->out_len ? conn->out_len : 4096;
+        while (conn->out_end + len > size) {
+            size *= 2;
+        }
+        char *out = realloc(conn->out, size);
+        if (out == NULL) {
+            syslog(LOG_ERR, "Failed to grow output queue.");
+            return -1;
+        }
+        conn->out = out;
+        conn->out_len = size;
+    }
+    memcpy(conn->out + conn->out_end, data, len);
+    conn->out_end += len;
+    return 0;
+}
+
+/* Sends as much of the output queue as the socket takes without blocking,
+ * nothing while a stream record is partly sent. Returns -1 if the
+ * connection failed. */
+int RP_ScpiConnFlush(rp_scpi_conn_t *conn) {
+    while (RP_ScpiConnPending(conn) > 0 && !conn->out_hold) {
+        ssize_t written = send(conn->fd, conn->out + conn->out_start,
+                               RP_ScpiConnPending(conn), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (written < 0) {
+            syslog(LOG_ERR, "Failed to write into the socket (%s)", strerror(errno));
+            RP_ScpiConnFail(conn);
+            return -1;
+        }
+        conn->out_start += written;
+    }
+    if (RP_ScpiConnPending(conn) == 0) {
+        conn->out_start = conn->out_end = 0;
+    }
+    RP_ScpiConnUpdate(conn);
+    return 0;
+}
+
 /**
  * Interface general commands
  */
 size_t SCPI_Write(scpi_t * context, const char * data, size_t len) {
 
+    rp_scpi_conn_t *conn = RP_ScpiConn(context);
     size_t total = 0;
 
-    if (context->user_context != NULL) {
-        int fd = *(int *)(context->user_context);
-        while (len > 0) {
-            size_t written =  write(fd, data, len);
-            if (written < 0) {
-                syslog(LOG_ERR,
-                    "Failed to write into the socket. Should send %zu bytes. Could send only %zu bytes",
-                    len, written);
+    if (conn == NULL || conn->failed) {
+        return 0;
+    }
+
+    // Event loop - whatever the socket does not take now is queued
+    if (conn->epfd >= 0) {
+        if (RP_ScpiConnPending(conn) == 0 && !conn->out_hold) {
+            ssize_t written;
+            do {
+                written = send(conn->fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+            } while (written < 0 && errno == EINTR);
+            if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                syslog(LOG_ERR, "Failed to write into the socket (%s)", strerror(errno));
+                RP_ScpiConnFail(conn);
+                return 0;
+            }
+            if (written > 0) {
+                total = written;
+            }
+        }
+        if (total < len) {
+            if (connQueue(conn, data + total, len - total) < 0) {
+                RP_ScpiConnFail(conn);
                 return total;
             }
-            len -= written;
-            data += written;
-            total += written;
+            RP_ScpiConnUpdate(conn);
+        }
+        return len;
+    }
+
+    while (len > 0) {
+        ssize_t written =  write(conn->fd, data, len);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0) {
+            syslog(LOG_ERR,
+                "Failed to write into the socket. Should send %zu bytes. Could send only %zu bytes",
+                len + total, total);
+            return total;
         }
+        len -= written;
+        data += written;
+        total += written;
     }
     return total;
 }
@@ -89,6 +239,119 @@ scpi_result_t SCPI_SystemCommTcpipControlQ(scpi_t * context) {
     return SCPI_RES_ERR;
 }
 
+/**
+ * Hardware ownership arbiter - a connection can lock the hardware with
+ * SYST:LOCK:REQ?, other connections can then only send queries until the
+ * owner releases the lock or disconnects.
+ */
+scpi_result_t RP_SystemLockRequestQ(scpi_t * context) {
+    bool granted = (hw_owner == NULL || hw_owner == context);
+
+    if (granted) {
+        hw_owner = context;
+    }
+    SCPI_ResultInt32(context, granted ? 1 : 0);
+
+    RP_LOG(LOG_INFO, "*SYST:LOCK:REQ? Lock %s.", granted ? "granted" : "refused");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_SystemLockRelease(scpi_t * context) {
+    if (hw_owner != context) {
+        RP_LOG(LOG_ERR, "*SYST:LOCK:REL Lock is not owned by this connection.");
+        return SCPI_RES_ERR;
+    }
+    hw_owner = NULL;
+
+    RP_LOG(LOG_INFO, "*SYST:LOCK:REL Successfully released lock.");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_SystemLockOwnerQ(scpi_t * context) {
+    SCPI_ResultMnemonic(context, hw_owner == NULL ? "NONE" :
+                                 (hw_owner == context ? "THIS" : "OTHER"));
+    return SCPI_RES_OK;
+}
+
+/* Returns true if the command header cmd[0..len) is name */
+static bool isCommand(const char * cmd, size_t len, const char * name) {
+    if (len > 0 && cmd[0] == ':') {
+        cmd++;
+        len--;
+    }
+    return len == strlen(name) && strncasecmp(cmd, name, len) == 0;
+}
+
+/* Commands allowed while another connection holds the lock: they only
+ * change settings of the connection itself, so a data connection can pick
+ * its format next to the owner's control connection */
+static const char * const conn_local_commands[] = {
+    "ACQ:STREAM:OBSERVE",       // watches the owner's records
+    "ACQ:DATA:UNITS",
+    "ACQ:DATA:FORMAT",
+    "SOUR:TRAC:DATA:FORMAT",
+    NULL
+};
+
+static bool isConnLocalCommand(const char * cmd, size_t len) {
+    for (int i = 0; conn_local_commands[i] != NULL; i++) {
+        if (isCommand(cmd, len, conn_local_commands[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Returns true if command(s) in cmd may be executed by context. While the
+ * hardware is locked by another connection only queries and the
+ * connection-local settings above are allowed. SWEEP:RUN? is a query which
+ * drives the generator and the acquisition, it is reserved to the owner. */
+bool RP_ScpiAccessAllowed(scpi_t * context, const char * cmd, size_t len) {
+    if (hw_owner == NULL || hw_owner == context) {
+        return true;
+    }
+
+    // Check the header of every ';' separated command
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && (cmd[i] == ' ' || cmd[i] == '\t' || cmd[i] == ';')) {
+            i++;
+        }
+        size_t hdr_end = i;
+        while (hdr_end < len && cmd[hdr_end] != ' ' && cmd[hdr_end] != '\t' &&
+               cmd[hdr_end] != ';' && cmd[hdr_end] != '\r' && cmd[hdr_end] != '\n') {
+            hdr_end++;
+        }
+        if (hdr_end > i && cmd[hdr_end - 1] != '?' && !isConnLocalCommand(cmd + i, hdr_end - i)) {
+            return false;
+        }
+        if (isCommand(cmd + i, hdr_end - i, "SWEEP:RUN?")) {
+            return false;
+        }
+        while (hdr_end < len && cmd[hdr_end] != ';') {
+            hdr_end++;
+        }
+        i = hdr_end;
+    }
+    return true;
+}
+
+scpi_result_t RP_SystemLog(scpi_t * context) {
+    scpi_bool_t value;
+
+    if (!SCPI_ParamBool(context, &value, true)) {
+        syslog(LOG_ERR, "*SYST:LOG is missing first parameter.");
+        return SCPI_RES_ERR;
+    }
+    rp_scpi_log = value;
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_SystemLogQ(scpi_t * context) {
+    SCPI_ResultBool(context, rp_scpi_log);
+    return SCPI_RES_OK;
+}
+
 /**
  * SCPI Configuration
  */
@@ -120,6 +383,11 @@ static const scpi_command_t scpi_commands[] = {
     {.pattern = "STATus:PRESet",                .callback = SCPI_StatusPreset,},
 
     {.pattern = "SYSTem:COMMunication:TCPIP:CONTROL?", .callback = SCPI_SystemCommTcpipControlQ,},
+    {.pattern = "SYSTem:LOCK:REQuest?",         .callback = RP_SystemLockRequestQ,},
+    {.pattern = "SYSTem:LOCK:RELease",          .callback = RP_SystemLockRelease,},
+    {.pattern = "SYSTem:LOCK:OWNer?",           .callback = RP_SystemLockOwnerQ,},
+    {.pattern = "SYSTem:LOG",                   .callback = RP_SystemLog,},
+    {.pattern = "SYSTem:LOG?",                  .callback = RP_SystemLogQ,},
 
     /* RedPitaya */
 
@@ -166,12 +434,23 @@ static const scpi_command_t scpi_commands[] = {
     {.pattern = "ACQ:DATA:UNITS", .callback             = RP_AcqScpiDataUnits,},
     {.pattern = "ACQ:DATA:UNITS?", .callback            = RP_AcqScpiDataUnitsQ,},
     {.pattern = "ACQ:DATA:FORMAT", .callback            = RP_AcqSetDataFormat,},
+    {.pattern = "ACQ:DATA:FORMAT?", .callback           = RP_AcqDataFormatQ,},
     {.pattern = "ACQ:SOUR#:DATA:STA:END?", .callback    = RP_AcqDataPosQ,},
     {.pattern = "ACQ:SOUR#:DATA:STA:N?", .callback      = RP_AcqDataQ,},
     {.pattern = "ACQ:SOUR#:DATA:OLD:N?", .callback      = RP_AcqOldestDataQ,},
     {.pattern = "ACQ:SOUR#:DATA?", .callback            = RP_AcqDataOldestAllQ,},
     {.pattern = "ACQ:SOUR#:DATA:LAT:N?", .callback      = RP_AcqLatestDataQ,},
     {.pattern = "ACQ:BUF:SIZE?", .callback              = RP_AcqBufferSizeQ,},
+    {.pattern = "ACQ:SOUR#:MEAS:MIN?", .callback        = RP_AcqMeasMinQ,},
+    {.pattern = "ACQ:SOUR#:MEAS:MAX?", .callback        = RP_AcqMeasMaxQ,},
+    {.pattern = "ACQ:SOUR#:MEAS:PP?", .callback         = RP_AcqMeasPeakToPeakQ,},
+    {.pattern = "ACQ:SOUR#:MEAS:MEAN?", .callback       = RP_AcqMeasMeanQ,},
+    {.pattern = "ACQ:SOUR#:MEAS:RMS?", .callback        = RP_AcqMeasRmsQ,},
+    {.pattern = "ACQ:SOUR#:MEAS:FREQ?", .callback       = RP_AcqMeasFreqQ,},
+    {.pattern = "ACQ:STREAM:START", .callback           = RP_AcqStreamStart,},
+    {.pattern = "ACQ:STREAM:STOP", .callback            = RP_AcqStreamStop,},
+    {.pattern = "ACQ:STREAM:OBSERVE", .callback         = RP_AcqStreamObserve,},
+    {.pattern = "ACQ:STREAM:OBSERVE?", .callback        = RP_AcqStreamObserveQ,},
 
     /* Generate */
     {.pattern = "GEN:RST", .callback                    = RP_GenReset,},
@@ -191,6 +470,8 @@ static const scpi_command_t scpi_commands[] = {
     {.pattern = "SOUR#:DCYC?", .callback                = RP_GenDutyCycleQ,},
     {.pattern = "SOUR#:TRAC:DATA:DATA", .callback       = RP_GenArbitraryWaveForm,},
     {.pattern = "SOUR#:TRAC:DATA:DATA?", .callback      = RP_GenArbitraryWaveFormQ,},
+    {.pattern = "SOUR:TRAC:DATA:FORMAT", .callback      = RP_GenArbitraryFormat,},
+    {.pattern = "SOUR:TRAC:DATA:FORMAT?", .callback     = RP_GenArbitraryFormatQ,},
     {.pattern = "SOUR#:BURS:STAT", .callback            = RP_GenGenerateMode,},
     {.pattern = "SOUR#:BURS:STAT?", .callback           = RP_GenGenerateModeQ,},
     {.pattern = "SOUR#:BURS:NCYC", .callback            = RP_GenBurstCount,},
@@ -203,6 +484,19 @@ static const scpi_command_t scpi_commands[] = {
     {.pattern = "SOUR#:TRIG:SOUR?", .callback           = RP_GenTriggerSourceQ,},
     {.pattern = "SOUR#:TRIG:IMM", .callback             = RP_GenTrigger,},
 
+    /* Sweep */
+    {.pattern = "SWEEP:FREQ:START", .callback           = RP_SweepFreqStart,},
+    {.pattern = "SWEEP:FREQ:START?", .callback          = RP_SweepFreqStartQ,},
+    {.pattern = "SWEEP:FREQ:STOP", .callback            = RP_SweepFreqStop,},
+    {.pattern = "SWEEP:FREQ:STOP?", .callback           = RP_SweepFreqStopQ,},
+    {.pattern = "SWEEP:POINTS", .callback               = RP_SweepPoints,},
+    {.pattern = "SWEEP:POINTS?", .callback              = RP_SweepPointsQ,},
+    {.pattern = "SWEEP:AVER", .callback                 = RP_SweepAveraging,},
+    {.pattern = "SWEEP:AVER?", .callback                = RP_SweepAveragingQ,},
+    {.pattern = "SWEEP:SCALE", .callback                = RP_SweepScale,},
+    {.pattern = "SWEEP:SCALE?", .callback               = RP_SweepScaleQ,},
+    {.pattern = "SWEEP:RUN?", .callback                 = RP_SweepRunQ,},
+
     SCPI_CMD_LIST_END
 };
 
@@ -232,3 +526,45 @@ scpi_t scpi_context = {
     .idn = {"REDPITAYA", "INSTR2014", NULL, "01-02"},
 };
 
+
+/**
+ * Creates SCPI context for one connection (event loop server mode). Each
+ * context gets its own input buffer and registers, the command list and
+ * the interface are shared with scpi_context.
+ */
+scpi_t *RP_ScpiContextCreate(rp_scpi_conn_t *conn) {
+    scpi_t *context = malloc(sizeof(scpi_t));
+    char *buffer = malloc(SCPI_INPUT_BUFFER_LENGTH);
+    scpi_reg_val_t *regs = calloc(SCPI_REG_COUNT, sizeof(scpi_reg_val_t));
+
+    if (context == NULL || buffer == NULL || regs == NULL) {
+        syslog(LOG_ERR, "Failed to allocate SCPI context.");
+        free(context);
+        free(buffer);
+        free(regs);
+        return NULL;
+    }
+
+    memcpy(context, &scpi_context, sizeof(scpi_t));
+    context->buffer.data = buffer;
+    context->registers = regs;
+    context->user_context = conn;
+    context->binary_output = false;
+    SCPI_Init(context);
+
+    return context;
+}
+
+void RP_ScpiContextDestroy(scpi_t *context) {
+    if (context == NULL) {
+        return;
+    }
+    if (hw_owner == context) {
+        hw_owner = NULL;
+    }
+    RP_AcqStreamRelease(context);
+
+    free(context->buffer.data);
+    free(context->registers);
+    free(context);
+}
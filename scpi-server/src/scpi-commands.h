@@ -15,9 +15,55 @@
 #ifndef SCPI_COMMANDS_H_
 #define SCPI_COMMANDS_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "scpi/scpi.h"
+#include "acquire.h"
+#include "generate.h"
+
+/* Queued output above RP_SCPI_OUTPUT_HIGH stops reading commands from the
+ * connection until the client takes it, above RP_SCPI_OUTPUT_MAX the
+ * connection is closed */
+#define RP_SCPI_OUTPUT_HIGH     (1024 * 1024)
+#define RP_SCPI_OUTPUT_MAX      (64 * 1024 * 1024)
+
+/* State of one client connection, user_context of its SCPI context points
+ * to it. In the event loop (epfd >= 0) the socket is non-blocking: output
+ * the socket does not take at once is queued and sent on EPOLLOUT, so one
+ * slow client does not stall the others. */
+typedef struct {
+    int                 fd;
+    int                 epfd;       // -1 for a blocking connection (forked server)
+    uint32_t            events;     // epoll events requested now
+    char               *out;        // output queue
+    size_t              out_len;    // allocated size
+    size_t              out_start;  // first byte not sent yet
+    size_t              out_end;    // end of queued output
+    bool                out_hold;   // a stream record is partly sent, output waits behind it
+    bool                closing;    // client sent everything, close when output is sent
+    bool                failed;     // connection broken, close it
+    rp_scpi_acq_unit_t  unit;       // ACQ:DATA:UNITS
+    rp_scpi_arb_format_t arb_format; // SOUR:TRAC:DATA:FORMAT
+} rp_scpi_conn_t;
 
 extern scpi_t scpi_context;
 
+static inline rp_scpi_conn_t *RP_ScpiConn(scpi_t *context) {
+    return (rp_scpi_conn_t *)context->user_context;
+}
+
+void RP_ScpiConnInit(rp_scpi_conn_t *conn, int fd, int epfd);
+void RP_ScpiConnClean(rp_scpi_conn_t *conn);
+size_t RP_ScpiConnPending(const rp_scpi_conn_t *conn);
+int RP_ScpiConnFlush(rp_scpi_conn_t *conn);
+void RP_ScpiConnUpdate(rp_scpi_conn_t *conn);
+void RP_ScpiConnFail(rp_scpi_conn_t *conn);
+bool RP_ScpiConnDone(const rp_scpi_conn_t *conn);
+
+scpi_t *RP_ScpiContextCreate(rp_scpi_conn_t *conn);
+void RP_ScpiContextDestroy(scpi_t *context);
+bool RP_ScpiAccessAllowed(scpi_t * context, const char * cmd, size_t len);
+
 
 #endif /* SCPI_COMMANDS_H_ */
@@ -19,14 +19,19 @@
 
 #include <netinet/in.h>
 #include <sys/prctl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <arpa/inet.h>
 #include <signal.h>
 #include <unistd.h>
 #include <syslog.h>
+#include <poll.h>
 
 #include "scpi-commands.h"
 #include "common.h"
+#include "acquire.h"
 
 #include "scpi/parser.h"
 #include "redpitaya/rp.h"
@@ -37,6 +42,8 @@
 #define LISTEN_BACKLOG 50
 #define LISTEN_PORT 5000
 #define MAX_BUFF_SIZE 1024
+#define MAX_EVENTS 16
+#define MAX_BATCH_SIZE (256 * 1024)
 
 static bool app_exit = false;
 static char delimiter[] = "\r\n";
@@ -68,33 +75,118 @@ static void installTermSignalHandler()
     sigaction(SIGINT, &action, NULL);
 }
 
+void LogMessage(char *m, size_t len) {
+    if (!rp_scpi_log) {
+        return;
+    }
+
+    const size_t buff_len = 50;
+    char buff[buff_len];
+
+    len = MIN(len, buff_len);
+    strncpy(buff, m, len);
+    buff[len - 1] = '\0';
+
+    RP_LOG(LOG_INFO, "Processing command: %s\n", buff);
+}
+
+/* Commands collected between SYST:BATCH:BEGIN and SYST:BATCH:END */
+typedef struct {
+    bool    active;
+    char   *data;
+    size_t  len;        // allocated size
+    size_t  end;        // size of collected commands
+} batch_t;
+
+/* Receive buffer of one connection */
+typedef struct {
+    char   *data;
+    size_t  len;        // allocated size
+    size_t  end;        // size of received and not yet processed data
+    size_t  scan;       // data before this offset contain no delimiter
+    batch_t batch;
+} message_t;
+
+/**
+ * Makes sure that at least size bytes are free at the end of the message buffer.
+ * @return 0 on success, -1 if the buffer can not be grown.
+ */
+static int reserveMessage(message_t *msg, size_t size)
+{
+    size_t len = msg->len;
+    while (msg->end + size >= len) {
+        len *= 2;
+    }
+    if (len != msg->len) {
+        char *data = realloc(msg->data, len);
+        if (data == NULL) {
+            RP_LOG(LOG_ERR, "Failed to grow message buffer.");
+            return -1;
+        }
+        msg->data = data;
+        msg->len = len;
+    }
+    return 0;
+}
+
 /**
  * Helper method which returns next command position from the buffer.
- * @param buffer     Input buffer
- * @param bufferLen  Input buffer length
+ * Scanning continues where the previous call stopped, so every received
+ * byte is searched only once. Payloads of IEEE 488.2 definite length
+ * blocks (#<n><len><data>) are skipped, they may contain delimiters.
+ * @param msg    Message buffer, command starts at the beginning
  * @return Position of next command within buffer, or -1 if not found.
  */
-static size_t getNextCommand(const char* buffer, size_t bufferLen)
+static size_t getNextCommand(message_t *msg)
 {
-    size_t delimiterLen = sizeof(delimiter) - 1; // dont count last null char.
-    size_t i = 0;
-    for (i = 0; i < bufferLen; i++) {
+    const size_t delimiterLen = sizeof(delimiter) - 1; // dont count last null char.
+    const char *buffer = msg->data;
 
-        // Find match for end of delimiter
-        if (buffer[i] == delimiter[delimiterLen - 1]) {
+    while (msg->scan < msg->end) {
+        const char *start = buffer + msg->scan;
+        size_t avail = msg->end - msg->scan;
 
-            // Now go back checking if all delimiter character matches
-            size_t dist = 0;
-            while (i - dist >= 0 && delimiterLen - dist > 0) {
-                if (buffer[i - dist] != delimiter[delimiterLen - dist - 1]) {
-                    break;
+        // Find match for end of delimiter
+        const char *last = memchr(start, delimiter[delimiterLen - 1], avail);
+        size_t span = last ? (size_t)(last - start) : avail;
+
+        const char *block = memchr(start, '#', span);
+        if (block != NULL) {
+            size_t hdr = block - buffer;
+            if (hdr + 1 >= msg->end) {
+                msg->scan = hdr;            // wait for the digit count
+                return -1;
+            }
+            size_t digits = buffer[hdr + 1] - '0';
+            if (digits >= 1 && digits <= 9) {
+                if (hdr + 2 + digits > msg->end) {
+                    msg->scan = hdr;        // wait for the whole length
+                    return -1;
                 }
-                if (delimiterLen - dist - 1 == 0) {
-                    return i + 1; // Position of next command
+                size_t len = 0, i;
+                for (i = 0; i < digits && buffer[hdr + 2 + i] >= '0' && buffer[hdr + 2 + i] <= '9'; i++) {
+                    len = len * 10 + (buffer[hdr + 2 + i] - '0');
+                }
+                if (i == digits) {
+                    msg->scan = hdr + 2 + digits + len;
+                    continue;
                 }
-
-                dist++;
             }
+            msg->scan = hdr + 1;            // not a block, plain character
+            continue;
+        }
+
+        if (last == NULL) {
+            msg->scan = msg->end;
+            return -1;
+        }
+
+        // Now check that the whole delimiter matches
+        size_t pos = last - buffer + 1;
+        msg->scan = pos;
+        if (pos >= delimiterLen &&
+            memcmp(buffer + pos - delimiterLen, delimiter, delimiterLen) == 0) {
+            return pos; // Position of next command
         }
     }
 
@@ -102,15 +194,161 @@ static size_t getNextCommand(const char* buffer, size_t bufferLen)
     return -1;
 }
 
-void LogMessage(char *m, size_t len) {
-    const size_t buff_len = 50;
-    char buff[buff_len];
+/* Matches short or long form of a mnemonic, case insensitive */
+static bool matchMnemonic(const char **p, const char *end, const char *shortForm, const char *longForm)
+{
+    size_t len = 0;
+    while (*p + len < end && (*p)[len] != ':' && (*p)[len] != ' ' &&
+           (*p)[len] != '\r' && (*p)[len] != '\n') {
+        len++;
+    }
+    if ((len == strlen(shortForm) && strncasecmp(*p, shortForm, len) == 0) ||
+        (len == strlen(longForm) && strncasecmp(*p, longForm, len) == 0)) {
+        *p += len;
+        return true;
+    }
+    return false;
+}
 
-    len = MIN(len, buff_len);
-    strncpy(buff, m, len);
-    buff[len - 1] = '\0';
+/* Returns true if the command is SYST:BATCH:<keyword> */
+static bool isBatchCommand(const char *m, size_t len, const char *shortForm, const char *longForm)
+{
+    const char *p = m, *end = m + len;
 
-    RP_LOG(LOG_INFO, "Processing command: %s\n", buff);
+    while (p < end && (*p == ' ' || *p == ':')) {
+        p++;
+    }
+    if (!matchMnemonic(&p, end, "SYST", "SYSTEM") || p == end || *p++ != ':' ||
+        !matchMnemonic(&p, end, "BATC", "BATCH") || p == end || *p++ != ':' ||
+        !matchMnemonic(&p, end, shortForm, longForm)) {
+        return false;
+    }
+    while (p < end && (*p == ' ' || *p == '\r' || *p == '\n')) {
+        p++;
+    }
+    return p == end;
+}
+
+/* Appends command without delimiter to the batch as ';' separated compound command */
+static int appendBatch(batch_t *batch, const char *m, size_t len)
+{
+    const size_t delimiterLen = sizeof(delimiter) - 1;
+
+    if (len >= delimiterLen) {
+        len -= delimiterLen;
+    }
+    // 2 bytes for ";:" and room for the final delimiter
+    if (batch->end + len + 2 + delimiterLen > MAX_BATCH_SIZE) {
+        RP_LOG(LOG_ERR, "Batch is too large.");
+        return -1;
+    }
+    if (batch->end + len + 2 + delimiterLen > batch->len) {
+        size_t size = batch->len ? batch->len : MAX_BUFF_SIZE;
+        while (batch->end + len + 2 + delimiterLen > size) {
+            size *= 2;
+        }
+        char *data = realloc(batch->data, size);
+        if (data == NULL) {
+            RP_LOG(LOG_ERR, "Failed to grow batch buffer.");
+            return -1;
+        }
+        batch->data = data;
+        batch->len = size;
+    }
+
+    // Every command starts from the root of the command tree
+    if (batch->end > 0) {
+        batch->data[batch->end++] = ';';
+    }
+    if (len > 0 && m[0] != ':' && m[0] != '*') {
+        batch->data[batch->end++] = ':';
+    }
+    memcpy(batch->data + batch->end, m, len);
+    batch->end += len;
+    return 0;
+}
+
+/**
+ * Executes the collected batch as one compound command, so all results are
+ * returned in one response. Waveform synthesis is deferred until all
+ * generator settings are applied.
+ */
+static void executeBatch(scpi_t *context, batch_t *batch)
+{
+    const size_t delimiterLen = sizeof(delimiter) - 1;
+
+    batch->active = false;
+    if (batch->end == 0) {
+        return;
+    }
+    memcpy(batch->data + batch->end, delimiter, delimiterLen);
+
+    LogMessage(batch->data, batch->end + delimiterLen);
+
+    if (RP_ScpiAccessAllowed(context, batch->data, batch->end)) {
+        rp_GenDeferSynthesis(true);
+        SCPI_Input(context, batch->data, batch->end + delimiterLen);
+        rp_GenDeferSynthesis(false);
+    } else {
+        RP_LOG(LOG_ERR, "Hardware is locked by another connection.");
+        SCPI_ErrorPush(context, SCPI_ERROR_EXECUTION_ERROR);
+    }
+    batch->end = 0;
+}
+
+/**
+ * Executes all complete commands from the message buffer and moves the
+ * incomplete rest to the beginning of the buffer.
+ */
+static void processMessage(scpi_t *context, message_t *msg)
+{
+    batch_t *batch = &msg->batch;
+
+    // Now try to parse each command out
+    size_t start = 0;
+    size_t pos = -1;
+    while ((pos = getNextCommand(msg)) != -1) {
+        char *m = msg->data + start;
+        size_t len = pos - start;
+        start = pos;
+
+        // Batch mode - collect commands until SYST:BATCH:END
+        if (batch->active) {
+            if (isBatchCommand(m, len, "END", "END")) {
+                executeBatch(context, batch);
+            } else if (appendBatch(batch, m, len) < 0) {
+                batch->active = false;
+                batch->end = 0;
+                SCPI_ErrorPush(context, SCPI_ERROR_EXECUTION_ERROR);
+            }
+            continue;
+        }
+        if (isBatchCommand(m, len, "BEG", "BEGIN")) {
+            batch->active = true;
+            batch->end = 0;
+            continue;
+        }
+
+        // Log out message
+        LogMessage(m, len);
+
+        //Parse the message and return response
+        if (RP_ScpiAccessAllowed(context, m, len)) {
+            SCPI_Input(context, m, len);
+        } else {
+            RP_LOG(LOG_ERR, "Hardware is locked by another connection.");
+            SCPI_ErrorPush(context, SCPI_ERROR_EXECUTION_ERROR);
+        }
+    }
+
+    // Move the rest of the message to the beginning of the buffer
+    if (start > 0) {
+        msg->end -= start;
+        msg->scan -= start;
+        if (msg->end > 0) {
+            memmove(msg->data, msg->data + start, msg->end);
+        }
+    }
 }
 
 /**
@@ -120,11 +358,12 @@ void LogMessage(char *m, size_t len) {
  */
 static int handleConnection(int connfd) {
     int read_size;
+    rp_scpi_conn_t conn;
+
+    message_t msg = { .data = malloc(MAX_BUFF_SIZE), .len = MAX_BUFF_SIZE, .end = 0, .scan = 0 };
 
-    size_t message_len = MAX_BUFF_SIZE;
-    char *message_buff = malloc(message_len);
-    char buffer[MAX_BUFF_SIZE];
-    size_t msg_end = 0;
+    RP_ScpiConnInit(&conn, connfd, -1);
+    scpi_context.user_context = &conn;
 
     installTermSignalHandler();
 
@@ -133,45 +372,42 @@ static int handleConnection(int connfd) {
     RP_LOG(LOG_INFO, "Waiting for first client request.");
 
     //Receive a message from client
-    while( (read_size = recv(connfd , buffer , MAX_BUFF_SIZE , 0)) > 0 )
+    while(1)
     {
-        if (app_exit) {
-            break;
+        // While streaming, push records until the client sends something
+        if (RP_AcqStreamActive()) {
+            struct pollfd pfd = { .fd = connfd, .events = POLLIN };
+            if (poll(&pfd, 1, 0) == 0) {
+                RP_AcqStreamPoll();
+                if (app_exit) {
+                    break;
+                }
+                continue;
+            }
         }
 
-        // First make sure that message buffer is large enough
-        while (msg_end + read_size >= message_len) {
-            message_len *= 2;
-            message_buff = realloc(message_buff, message_len);
+        // Receive directly into the message buffer
+        if (reserveMessage(&msg, MAX_BUFF_SIZE) < 0) {
+            break;
         }
-
-        // Copy read buffer into message buffer
-        memcpy(message_buff + msg_end, buffer, read_size);
-        msg_end += read_size;
-
-        // Now try to parse each command out
-        char *m = message_buff;
-        size_t pos = -1;
-        while ((pos = getNextCommand(m, msg_end)) != -1) {
-
-            // Log out message
-            LogMessage(m, pos);
-
-            //Parse the message and return response
-            SCPI_Input(&scpi_context, m, pos);
-            m += pos;
-            msg_end -= pos;
+        read_size = recv(connfd, msg.data + msg.end, msg.len - msg.end - 1, 0);
+        if (read_size < 0 || app_exit) {
+            break;
         }
+        msg.end += read_size;
 
-        // Move the rest of the message to the beginning of the buffer
-        if (message_buff != m && msg_end > 0) {
-            memmove(message_buff, m, msg_end);
+        // Commands received together with the end of the connection are executed too
+        processMessage(&scpi_context, &msg);
+        if (read_size == 0) {
+            break;
         }
 
         RP_LOG(LOG_INFO, "Waiting for next client request.\n");
     }
 
-    free(message_buff);
+    free(msg.batch.data);
+    free(msg.data);
+    RP_ScpiConnClean(&conn);
 
     RP_LOG(LOG_INFO, "Closing client connection...");
 
@@ -190,16 +426,211 @@ static int handleConnection(int connfd) {
 }
 
 
+/* Connection of the event loop server */
+typedef struct {
+    rp_scpi_conn_t  io;         // must be first - epoll events point to it
+    scpi_t         *context;
+    message_t       msg;
+    struct in_addr  addr;
+} connection_t;
+
+static connection_t *openConnection(int listenfd, int epfd)
+{
+    struct sockaddr_in cliaddr;
+    socklen_t clilen = sizeof(cliaddr);
+
+    int connfd = accept(listenfd, (struct sockaddr *)&cliaddr, &clilen);
+    if (connfd == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            RP_LOG(LOG_ERR, "Failed to accept connection (%s)", strerror(errno));
+        }
+        return NULL;
+    }
+    fcntl(connfd, F_SETFL, fcntl(connfd, F_GETFL, 0) | O_NONBLOCK);
+
+    connection_t *conn = calloc(1, sizeof(connection_t));
+    if (conn != NULL) {
+        RP_ScpiConnInit(&conn->io, connfd, epfd);
+        conn->addr = cliaddr.sin_addr;
+        conn->msg.len = MAX_BUFF_SIZE;
+        conn->msg.data = malloc(conn->msg.len);
+        conn->context = RP_ScpiContextCreate(&conn->io);
+    }
+    if (conn == NULL || conn->msg.data == NULL || conn->context == NULL) {
+        RP_LOG(LOG_ERR, "Failed to allocate connection.");
+        if (conn != NULL) {
+            RP_ScpiContextDestroy(conn->context);
+            free(conn->msg.data);
+            free(conn);
+        }
+        close(connfd);
+        return NULL;
+    }
+
+    RP_LOG(LOG_INFO, "Connection with client ip %s established.", inet_ntoa(conn->addr));
+    return conn;
+}
+
+static void closeConnection(connection_t *conn)
+{
+    RP_LOG(LOG_INFO, "Closing connection with client ip %s.", inet_ntoa(conn->addr));
+
+    // closing the descriptor also removes it from the epoll set
+    close(conn->io.fd);
+    RP_ScpiContextDestroy(conn->context);
+    RP_ScpiConnClean(&conn->io);
+    free(conn->msg.batch.data);
+    free(conn->msg.data);
+    free(conn);
+}
+
+/**
+ * Reads everything available on a non-blocking connection and executes the
+ * complete commands. When the client has finished sending, the commands
+ * received before are still executed and the connection is closed once
+ * their output is sent.
+ * @return 0 if the connection stays open, -1 if it has to be closed.
+ */
+static int readConnection(connection_t *conn)
+{
+    message_t *msg = &conn->msg;
+
+    while (1) {
+        // Receive directly into the message buffer
+        if (reserveMessage(msg, MAX_BUFF_SIZE) < 0) {
+            return -1;
+        }
+        ssize_t read_size = recv(conn->io.fd, msg->data + msg->end, msg->len - msg->end - 1, 0);
+        if (read_size > 0) {
+            msg->end += read_size;
+            continue;
+        }
+        if (read_size == 0) {
+            RP_LOG(LOG_INFO, "Client is disconnected");
+            conn->io.closing = true;
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        RP_LOG(LOG_ERR, "Receive message failed (%s)", strerror(errno));
+        return -1;
+    }
+
+    processMessage(conn->context, msg);
+    RP_ScpiConnUpdate(&conn->io);
+    return RP_ScpiConnDone(&conn->io) ? -1 : 0;
+}
+
+/**
+ * Single process server - all connections are served by one epoll loop,
+ * each with its own SCPI context. Access to the hardware is arbitrated with
+ * SYST:LOCK commands, other connections may watch the owner's stream with
+ * ACQ:STREAM:OBSERVE.
+ * @param listenfd Listening socket
+ * @return
+ */
+static int runEventLoop(int listenfd)
+{
+    struct epoll_event ev, events[MAX_EVENTS];
+
+    int epfd = epoll_create1(0);
+    if (epfd == -1) {
+        RP_LOG(LOG_ERR, "Failed to create epoll instance (%s)", strerror(errno));
+        return -1;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;         // NULL marks the listening socket
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &ev) == -1) {
+        RP_LOG(LOG_ERR, "Failed to add listening socket to epoll (%s)", strerror(errno));
+        close(epfd);
+        return -1;
+    }
+
+    while (!app_exit) {
+        // Do not block while a stream is active, RP_AcqStreamPoll() waits instead,
+        // unless it waits for its client to take the output. Observers are
+        // continued on EPOLLOUT.
+        int timeout = RP_AcqStreamReady() ? 0 : -1;
+        int n = epoll_wait(epfd, events, MAX_EVENTS, timeout);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            RP_LOG(LOG_ERR, "epoll_wait failed (%s)", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            connection_t *conn = events[i].data.ptr;
+
+            if (conn == NULL) {
+                while ((conn = openConnection(listenfd, epfd)) != NULL) {
+                    ev.events = EPOLLIN | EPOLLRDHUP;
+                    ev.data.ptr = conn;
+                    if (epoll_ctl(epfd, EPOLL_CTL_ADD, conn->io.fd, &ev) == -1) {
+                        RP_LOG(LOG_ERR, "Failed to add connection to epoll (%s)", strerror(errno));
+                        closeConnection(conn);
+                        continue;
+                    }
+                    conn->io.events = ev.events;
+                }
+                continue;
+            }
+
+            uint32_t flags = events[i].events;
+            if (flags & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(conn);
+                continue;
+            }
+            // Queued output goes first, new commands may queue more behind it
+            if (flags & EPOLLOUT) {
+                RP_ScpiConnFlush(&conn->io);
+                RP_AcqStreamWritable(conn->context);
+            }
+            if (((flags & (EPOLLIN | EPOLLRDHUP)) && readConnection(conn) < 0) ||
+                RP_ScpiConnDone(&conn->io)) {
+                closeConnection(conn);
+            }
+        }
+
+        if (RP_AcqStreamActive()) {
+            RP_AcqStreamPoll();
+        }
+    }
+
+    close(epfd);
+    return 0;
+}
+
 /**
  * Main daemon entrance point. Opens a socket and listens for any incoming connection.
  * When client connects, if forks the conversation into a new socket and the daemon (parent process)
  * waits for another connection. It can handle multiple connections simultaneously.
- * @param argc  not used
- * @param argv  not used
+ * With option -e all connections are served by a single process event loop instead.
+ * @param argc  number of arguments
+ * @param argv  command line options
  * @return
  */
 int main(int argc, char *argv[])
 {
+    bool event_loop = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e")) != -1) {
+        switch (opt) {
+        case 'e':
+            event_loop = true;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-e]\n", argv[0]);
+            return (EXIT_FAILURE);
+        }
+    }
 
     // Open logging into "/var/log/messages" or /var/log/syslog" or other configured...
     setlogmask (LOG_UPTO (LOG_INFO));
@@ -264,8 +695,18 @@ int main(int argc, char *argv[])
 
     RP_LOG(LOG_INFO, "Server is listening on port %d\n", LISTEN_PORT);
 
+    if (event_loop) {
+        // A client closing its socket must not terminate the whole server
+        signal(SIGPIPE, SIG_IGN);
+        fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK);
+        if (runEventLoop(listenfd) < 0) {
+            return (EXIT_FAILURE);
+        }
+    }
+
+
     // Socket is opened and listening on port. Now we can accept connections
-    while(1)
+    while(!event_loop)
     {
         struct sockaddr_in cliaddr;
         socklen_t clilen;
@@ -291,8 +732,6 @@ int main(int argc, char *argv[])
             // this is the child process
             close(listenfd); // child doesn't need the listener
 
-            scpi_context.user_context = &connfd;
-
             result = handleConnection(connfd);
 
             close(connfd);
@@ -320,6 +759,7 @@ int main(int argc, char *argv[])
 
     RP_LOG(LOG_INFO, "scpi-server stopped.");
 
+    rp_log_stop();
     closelog ();
 
     return (EXIT_SUCCESS);
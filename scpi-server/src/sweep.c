@@ -0,0 +1,311 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya Scpi server frequency sweep SCPI commands implementation
+ *
+ * The whole sweep (generator frequency, settling, acquisition and lock-in
+ * detection) runs on the device, SWEEP:RUN? returns a binary table with
+ * frequency, amplitude ratio and phase (CH2 relative to CH1) per point.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "sweep.h"
+#include "acquire.h"
+#include "common.h"
+
+#include "scpi/parser.h"
+
+#include "redpitaya/rp.h"
+
+#define SWEEP_FREQ_MIN          1.0
+#define SWEEP_FREQ_MAX          62.5e6
+#define SWEEP_POINTS_MAX        1000
+#define SWEEP_AVER_MAX          100
+#define SWEEP_PERIODS_MIN       10      // periods in one record
+#define SWEEP_SETTLE_MIN_US     1000
+#define ADC_SAMPLE_RATE         125e6
+
+static float                 sweep_start  = 1000;
+static float                 sweep_stop   = 100000;
+static uint32_t              sweep_points = 20;
+static uint32_t              sweep_aver   = 1;
+static rp_scpi_sweep_scale_t sweep_scale  = RP_SCPI_SWEEP_LOG;
+
+const scpi_choice_def_t scpi_RpSweepScale[] = {
+    {"LIN", 0},
+    {"LOG", 1},
+    SCPI_CHOICE_LIST_END
+};
+
+static const struct {
+    rp_acq_decimation_t decimation;
+    uint32_t            factor;
+} sweep_decimations[] = {
+    {RP_DEC_1,     1},
+    {RP_DEC_8,     8},
+    {RP_DEC_64,    64},
+    {RP_DEC_1024,  1024},
+    {RP_DEC_8192,  8192},
+    {RP_DEC_65536, 65536},
+};
+
+static float sweep_ch1[ADC_BUFFER_SIZE];
+static float sweep_ch2[ADC_BUFFER_SIZE];
+
+/* Selects the highest sample rate at which a record holds SWEEP_PERIODS_MIN periods */
+static int sweepDecimation(float frequency, uint32_t *factor) {
+    int n = sizeof(sweep_decimations) / sizeof(sweep_decimations[0]);
+    int i;
+
+    for (i = 0; i < n - 1; i++) {
+        double record_time = ADC_BUFFER_SIZE * sweep_decimations[i].factor / ADC_SAMPLE_RATE;
+        if (record_time * frequency >= SWEEP_PERIODS_MIN) {
+            break;
+        }
+    }
+    *factor = sweep_decimations[i].factor;
+    return rp_AcqSetDecimation(sweep_decimations[i].decimation);
+}
+
+/* Single bin DFT at w (rad/sample) over whole periods of the record, the
+ * reference is rotated recursively instead of calling sin/cos per sample */
+static void sweepLockIn(const float *x, uint32_t size, double w, double *re, double *im) {
+    uint32_t periods = (uint32_t)(size * w / (2 * M_PI));
+    uint32_t n = periods ? (uint32_t)(periods * 2 * M_PI / w) : size;
+    double c = 1, s = 0, cw = cos(w), sw = sin(w);
+    double sum_re = 0, sum_im = 0;
+
+    if (n > size) {
+        n = size;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        sum_re += x[i] * c;
+        sum_im -= x[i] * s;
+        double t = c * cw - s * sw;
+        s = s * cw + c * sw;
+        c = t;
+    }
+    *re = 2 * sum_re / n;
+    *im = 2 * sum_im / n;
+}
+
+/* Measures one point, returns amplitude ratio and phase in degrees */
+static int sweepMeasure(float frequency, float *amplitude, float *phase) {
+    double re1 = 0, im1 = 0, re2 = 0, im2 = 0;
+    uint32_t factor;
+    int result;
+
+    if ((result = rp_GenFreq(RP_CH_1, frequency)) != RP_OK ||
+        (result = sweepDecimation(frequency, &factor)) != RP_OK) {
+        return result;
+    }
+
+    uint32_t settle_us = (uint32_t)(SWEEP_PERIODS_MIN * 1e6 / frequency);
+    usleep(settle_us > SWEEP_SETTLE_MIN_US ? settle_us : SWEEP_SETTLE_MIN_US);
+
+    double w = 2 * M_PI * frequency * factor / ADC_SAMPLE_RATE;
+    for (uint32_t i = 0; i < sweep_aver; i++) {
+        uint32_t size = ADC_BUFFER_SIZE;
+        double re, im;
+
+        if ((result = RP_AcqCaptureV(sweep_ch1, sweep_ch2, &size)) != RP_OK) {
+            return result;
+        }
+        sweepLockIn(sweep_ch1, size, w, &re, &im);
+        re1 += re;
+        im1 += im;
+        sweepLockIn(sweep_ch2, size, w, &re, &im);
+        re2 += re;
+        im2 += im;
+    }
+
+    double amp1 = hypot(re1, im1);
+    double ph = (atan2(im2, re2) - atan2(im1, re1)) * 180 / M_PI;
+    if (ph > 180) {
+        ph -= 360;
+    } else if (ph <= -180) {
+        ph += 360;
+    }
+
+    *amplitude = amp1 > 0 ? hypot(re2, im2) / amp1 : 0;
+    *phase = ph;
+    return RP_OK;
+}
+
+scpi_result_t RP_SweepFreqStart(scpi_t *context) {
+    float value;
+
+    if (!SCPI_ParamFloat(context, &value, true)) {
+        RP_LOG(LOG_ERR, "*SWEEP:FREQ:START is missing first parameter.\n");
+        return SCPI_RES_ERR;
+    }
+    if (value < SWEEP_FREQ_MIN || value > SWEEP_FREQ_MAX) {
+        RP_LOG(LOG_ERR, "*SWEEP:FREQ:START Frequency is out of range.\n");
+        return SCPI_RES_ERR;
+    }
+    sweep_start = value;
+
+    RP_LOG(LOG_INFO, "*SWEEP:FREQ:START Successfully set start frequency.\n");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_SweepFreqStartQ(scpi_t *context) {
+    SCPI_ResultFloat(context, sweep_start);
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_SweepFreqStop(scpi_t *context) {
+    float value;
+
+    if (!SCPI_ParamFloat(context, &value, true)) {
+        RP_LOG(LOG_ERR, "*SWEEP:FREQ:STOP is missing first parameter.\n");
+        return SCPI_RES_ERR;
+    }
+    if (value < SWEEP_FREQ_MIN || value > SWEEP_FREQ_MAX) {
+        RP_LOG(LOG_ERR, "*SWEEP:FREQ:STOP Frequency is out of range.\n");
+        return SCPI_RES_ERR;
+    }
+    sweep_stop = value;
+
+    RP_LOG(LOG_INFO, "*SWEEP:FREQ:STOP Successfully set stop frequency.\n");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_SweepFreqStopQ(scpi_t *context) {
+    SCPI_ResultFloat(context, sweep_stop);
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_SweepPoints(scpi_t *context) {
+    uint32_t value;
+
+    if (!SCPI_ParamUInt32(context, &value, true)) {
+        RP_LOG(LOG_ERR, "*SWEEP:POINTS is missing first parameter.\n");
+        return SCPI_RES_ERR;
+    }
+    if (value < 1 || value > SWEEP_POINTS_MAX) {
+        RP_LOG(LOG_ERR, "*SWEEP:POINTS Number of points is out of range.\n");
+        return SCPI_RES_ERR;
+    }
+    sweep_points = value;
+
+    RP_LOG(LOG_INFO, "*SWEEP:POINTS Successfully set number of points.\n");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_SweepPointsQ(scpi_t *context) {
+    SCPI_ResultUInt32Base(context, sweep_points, 10);
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_SweepAveraging(scpi_t *context) {
+    uint32_t value;
+
+    if (!SCPI_ParamUInt32(context, &value, true)) {
+        RP_LOG(LOG_ERR, "*SWEEP:AVER is missing first parameter.\n");
+        return SCPI_RES_ERR;
+    }
+    if (value < 1 || value > SWEEP_AVER_MAX) {
+        RP_LOG(LOG_ERR, "*SWEEP:AVER Averaging is out of range.\n");
+        return SCPI_RES_ERR;
+    }
+    sweep_aver = value;
+
+    RP_LOG(LOG_INFO, "*SWEEP:AVER Successfully set averaging.\n");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_SweepAveragingQ(scpi_t *context) {
+    SCPI_ResultUInt32Base(context, sweep_aver, 10);
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_SweepScale(scpi_t *context) {
+    int32_t choice;
+
+    if (!SCPI_ParamChoice(context, scpi_RpSweepScale, &choice, true)) {
+        RP_LOG(LOG_ERR, "*SWEEP:SCALE is missing first parameter.\n");
+        return SCPI_RES_ERR;
+    }
+    sweep_scale = choice;
+
+    RP_LOG(LOG_INFO, "*SWEEP:SCALE Successfully set scale.\n");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_SweepScaleQ(scpi_t *context) {
+    const char *name;
+
+    if (!SCPI_ChoiceToName(scpi_RpSweepScale, sweep_scale, &name)) {
+        RP_LOG(LOG_ERR, "*SWEEP:SCALE? Failed to get scale.\n");
+        return SCPI_RES_ERR;
+    }
+    SCPI_ResultMnemonic(context, name);
+    return SCPI_RES_OK;
+}
+
+/**
+ * Runs the sweep with generator output 1 as stimulus, CH1 as reference and
+ * CH2 as response input. Returns a binary block of float32 triplets
+ * (frequency [Hz], amplitude ratio, phase [deg]) per point, in network byte
+ * order.
+ *
+ * The sweep runs synchronously: the server handles no other connection
+ * until it is done, which takes about
+ * points * (max(10 periods, 1 ms) settling + SWEEP:AVER acquisitions).
+ * Low start frequencies and many points block the server for long, only
+ * the owner of SYST:LOCK may run it while the hardware is locked.
+ */
+scpi_result_t RP_SweepRunQ(scpi_t *context) {
+    rp_acq_decimation_t decimation;
+    float frequency;
+    int result = RP_OK;
+
+    float *table = malloc(sweep_points * 3 * sizeof(float));
+    if (table == NULL) {
+        RP_LOG(LOG_ERR, "*SWEEP:RUN? Failed to allocate result table.\n");
+        return SCPI_RES_ERR;
+    }
+
+    // Settings changed by the sweep are restored afterwards
+    rp_AcqGetDecimation(&decimation);
+    rp_GenGetFreq(RP_CH_1, &frequency);
+
+    for (uint32_t i = 0; i < sweep_points && result == RP_OK; i++) {
+        double x = sweep_points > 1 ? (double)i / (sweep_points - 1) : 0;
+        float f = (sweep_scale == RP_SCPI_SWEEP_LOG) ?
+                  sweep_start * pow(sweep_stop / sweep_start, x) :
+                  sweep_start + (sweep_stop - sweep_start) * x;
+
+        table[3 * i] = f;
+        result = sweepMeasure(f, &table[3 * i + 1], &table[3 * i + 2]);
+    }
+
+    rp_AcqSetDecimation(decimation);
+    rp_GenFreq(RP_CH_1, frequency);
+
+    if (result != RP_OK) {
+        RP_LOG(LOG_ERR, "*SWEEP:RUN? Failed to measure: %s\n", rp_GetError(result));
+        free(table);
+        return SCPI_RES_ERR;
+    }
+
+    RP_ResultArbitraryBlock(context, table, sweep_points * 3, sizeof(float));
+    free(table);
+
+    RP_LOG(LOG_INFO, "*SWEEP:RUN? Successfully returned sweep data.\n");
+    return SCPI_RES_OK;
+}
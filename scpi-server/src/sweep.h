@@ -0,0 +1,38 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya Scpi server frequency sweep SCPI commands interface
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+
+#ifndef SWEEP_H_
+#define SWEEP_H_
+
+#include "scpi/types.h"
+
+typedef enum {
+    RP_SCPI_SWEEP_LIN,
+    RP_SCPI_SWEEP_LOG,
+} rp_scpi_sweep_scale_t;
+
+scpi_result_t RP_SweepFreqStart(scpi_t * context);
+scpi_result_t RP_SweepFreqStartQ(scpi_t * context);
+scpi_result_t RP_SweepFreqStop(scpi_t * context);
+scpi_result_t RP_SweepFreqStopQ(scpi_t * context);
+scpi_result_t RP_SweepPoints(scpi_t * context);
+scpi_result_t RP_SweepPointsQ(scpi_t * context);
+scpi_result_t RP_SweepAveraging(scpi_t * context);
+scpi_result_t RP_SweepAveragingQ(scpi_t * context);
+scpi_result_t RP_SweepScale(scpi_t * context);
+scpi_result_t RP_SweepScaleQ(scpi_t * context);
+scpi_result_t RP_SweepRunQ(scpi_t * context);
+
+#endif /* SWEEP_H_ */